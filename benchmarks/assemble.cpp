@@ -0,0 +1,60 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+#include "bench.h"
+#include "corpus.h"
+
+namespace Bench {
+
+namespace {
+
+struct SizeClass {
+    std::string_view name;
+    std::size_t bytes;
+};
+
+/// Approximate module sizes to assemble, from tiny shaders to very large ones.
+constexpr std::array SIZE_CLASSES{
+    SizeClass{"1KB", 1 << 10}, SizeClass{"10KB", 10 << 10}, SizeClass{"100KB", 100 << 10},
+    SizeClass{"1MB", 1 << 20}, SizeClass{"10MB", 10 << 20},
+};
+
+std::size_t ArithmeticShaderBytes(std::uint32_t num_blocks) {
+    Sirit::Module m;
+    EmitArithmeticShader(m, num_blocks);
+    return m.Assemble().size() * sizeof(std::uint32_t);
+}
+
+} // Anonymous namespace
+
+void RunAssembleBenchmarks(const Context& context) {
+    // Arithmetic shaders grow linearly with their number of blocks
+    const std::size_t base = ArithmeticShaderBytes(16);
+    const std::size_t per_block = (ArithmeticShaderBytes(32) - base) / 16;
+    const std::size_t fixed = base - per_block * 16;
+
+    for (const SizeClass& size_class : SIZE_CLASSES) {
+        const std::string name = "assemble/" + std::string{size_class.name};
+        if (!context.Enabled(name)) {
+            continue;
+        }
+        const std::size_t target = std::max(size_class.bytes, fixed + per_block);
+        const auto num_blocks = static_cast<std::uint32_t>((target - fixed) / per_block);
+        Sirit::Module m;
+        EmitArithmeticShader(m, num_blocks);
+        const std::size_t bytes = m.Assemble().size() * sizeof(std::uint32_t);
+        const Timing timing = Measure([&] { DoNotOptimize(m.Assemble()); });
+        context.Report(name, timing,
+                       {{"bytes", static_cast<double>(bytes)},
+                        {"mb_per_s", timing.MegabytesPerSecond(bytes)}});
+    }
+}
+
+} // namespace Bench
@@ -0,0 +1,96 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace Bench {
+
+/// Minimum time spent measuring each benchmark.
+constexpr double MIN_SECONDS = 0.25;
+
+/// Prevents the compiler from discarding the computation of a value.
+template <typename T>
+void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+struct Timing {
+    std::uint64_t iterations{};
+    double seconds{};
+
+    double NanosecondsPerIteration() const {
+        return seconds * 1e9 / static_cast<double>(iterations);
+    }
+
+    /// Returns the throughput in megabytes per second when each iteration processes bytes.
+    double MegabytesPerSecond(std::size_t bytes) const {
+        return static_cast<double>(bytes) * static_cast<double>(iterations) / seconds / 1e6;
+    }
+};
+
+/// Runs body in batches of growing size until MIN_SECONDS have been spent measuring it.
+template <typename Func>
+Timing Measure(Func&& body) {
+    using Clock = std::chrono::steady_clock;
+    Timing timing;
+    for (std::uint64_t batch = 1;; batch *= 2) {
+        const auto start = Clock::now();
+        for (std::uint64_t iteration = 0; iteration < batch; ++iteration) {
+            body();
+        }
+        timing.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        timing.iterations += batch;
+        if (timing.seconds >= MIN_SECONDS) {
+            return timing;
+        }
+    }
+}
+
+/// Selects the benchmarks to run and prints their results as one JSON object per line.
+class Context {
+public:
+    explicit Context(std::string_view filter_) : filter{filter_} {}
+
+    bool Enabled(std::string_view name) const {
+        return name.find(filter) != std::string_view::npos;
+    }
+
+    void Report(std::string_view name, const Timing& timing,
+                std::initializer_list<std::pair<std::string_view, double>> metrics = {}) const {
+        std::printf("{\"name\":\"%.*s\",\"iterations\":%llu,\"ns_per_iteration\":%.1f",
+                    static_cast<int>(name.size()), name.data(),
+                    static_cast<unsigned long long>(timing.iterations),
+                    timing.NanosecondsPerIteration());
+        for (const auto& [key, value] : metrics) {
+            std::printf(",\"%.*s\":%.6g", static_cast<int>(key.size()), key.data(), value);
+        }
+        std::printf("}\n");
+        std::fflush(stdout);
+    }
+
+private:
+    std::string filter;
+};
+
+void RunAssembleBenchmarks(const Context& context);
+void RunCompressionBenchmarks(const Context& context);
+void RunEmissionBenchmarks(const Context& context);
+void RunTraceBenchmarks(const Context& context);
+
+} // namespace Bench
@@ -0,0 +1,43 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <string>
+
+#include "bench.h"
+#include "corpus.h"
+
+namespace Bench {
+
+void RunCompressionBenchmarks(const Context& context) {
+    for (const CorpusEntry& entry : Corpus()) {
+        const std::string name = "compression/" + std::string{entry.name};
+        if (!context.Enabled(name)) {
+            continue;
+        }
+        Sirit::Module m;
+        entry.emit(m);
+        const std::size_t raw_bytes = m.Assemble().size() * sizeof(std::uint32_t);
+        const std::vector<std::uint8_t> compressed = m.AssembleCompressed();
+        if (Sirit::Decompress(compressed) != m.Assemble()) {
+            std::fprintf(stderr, "%s: decompressed module differs\n", name.c_str());
+            continue;
+        }
+
+        const Timing encode = Measure([&] { DoNotOptimize(m.AssembleCompressed()); });
+        const Timing decode = Measure([&] { DoNotOptimize(Sirit::Decompress(compressed)); });
+        const double ratio =
+            static_cast<double>(raw_bytes) / static_cast<double>(compressed.size());
+        context.Report(name + "/encode", encode,
+                       {{"raw_bytes", static_cast<double>(raw_bytes)},
+                        {"compressed_bytes", static_cast<double>(compressed.size())},
+                        {"ratio", ratio},
+                        {"mb_per_s", encode.MegabytesPerSecond(raw_bytes)}});
+        context.Report(name + "/decode", decode,
+                       {{"mb_per_s", decode.MegabytesPerSecond(raw_bytes)}});
+    }
+}
+
+} // namespace Bench
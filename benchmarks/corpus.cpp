@@ -0,0 +1,156 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <array>
+
+#include "corpus.h"
+
+namespace Bench {
+
+void EmitVertexShader(Sirit::Module& m) {
+    m.AddCapability(spv::Capability::Shader);
+    m.SetMemoryModel(spv::AddressingModel::Logical, spv::MemoryModel::GLSL450);
+
+    const auto t_void = m.Name(m.TypeVoid(), "void");
+    const auto t_uint = m.Name(m.TypeInt(32, false), "uint");
+    const auto t_float = m.Name(m.TypeFloat(32), "float");
+    const auto float4 = m.Name(m.TypeVector(t_float, 4), "float4");
+    const auto in_float = m.TypePointer(spv::StorageClass::Input, t_float);
+    const auto in_float4 = m.TypePointer(spv::StorageClass::Input, float4);
+    const auto out_float4 = m.TypePointer(spv::StorageClass::Output, float4);
+    const auto gl_per_vertex = m.Name(m.TypeStruct(float4), "gl_PerVertex");
+    const auto gl_per_vertex_ptr = m.TypePointer(spv::StorageClass::Output, gl_per_vertex);
+
+    const auto in_pos = m.Name(m.AddGlobalVariable(in_float4, spv::StorageClass::Input), "in_pos");
+    const auto per_vertex =
+        m.Name(m.AddGlobalVariable(gl_per_vertex_ptr, spv::StorageClass::Output), "per_vertex");
+    m.Decorate(in_pos, spv::Decoration::Location, 0);
+    m.Decorate(gl_per_vertex, spv::Decoration::Block);
+    m.MemberDecorate(gl_per_vertex, 0, spv::Decoration::BuiltIn,
+                     static_cast<std::uint32_t>(spv::BuiltIn::Position));
+
+    const auto main_func = m.Name(
+        m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void)), "main");
+    m.AddLabel();
+    const auto pos_x = m.OpLoad(t_float, m.OpAccessChain(in_float, in_pos, m.Constant(t_uint, 0u)));
+    const auto pos_y = m.OpLoad(t_float, m.OpAccessChain(in_float, in_pos, m.Constant(t_uint, 1u)));
+    auto position = m.OpUndef(float4);
+    position = m.OpCompositeInsert(float4, pos_x, position, 0);
+    position = m.OpCompositeInsert(float4, pos_y, position, 1);
+    position = m.OpCompositeInsert(float4, m.Constant(t_float, 0.0f), position, 2);
+    position = m.OpCompositeInsert(float4, m.Constant(t_float, 1.0f), position, 3);
+    m.OpStore(m.OpAccessChain(out_float4, per_vertex, m.Constant(t_uint, 0u)), position);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.AddEntryPoint(spv::ExecutionModel::Vertex, main_func, "main", in_pos, per_vertex);
+}
+
+void EmitArithmeticShader(Sirit::Module& m, std::uint32_t num_blocks) {
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_void = m.TypeVoid();
+    const auto t_uint = m.TypeInt(32, false);
+    const auto t_float = m.TypeFloat(32);
+    const auto uint3 = m.TypeVector(t_uint, 3);
+    const auto in_uint3 = m.TypePointer(spv::StorageClass::Input, uint3);
+    const auto invocation = m.AddGlobalVariable(in_uint3, spv::StorageClass::Input);
+    m.Decorate(invocation, spv::Decoration::BuiltIn, spv::BuiltIn::GlobalInvocationId);
+
+    const auto main_func =
+        m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const auto id = m.OpCompositeExtract(t_uint, m.OpLoad(uint3, invocation), 0);
+    auto integer = id;
+    auto value = m.OpConvertUToF(t_float, id);
+    for (std::uint32_t block = 0; block < num_blocks; ++block) {
+        const auto scale = m.Constant(t_float, 1.0f + static_cast<float>(block % 16) * 0.25f);
+        value = m.OpFma(t_float, value, scale, m.Constant(t_float, 0.5f));
+        value = m.OpFMul(t_float, value, value);
+        value = m.OpFClamp(t_float, value, m.Constant(t_float, -4.0f), m.Constant(t_float, 4.0f));
+        integer = m.OpIAdd(t_uint, integer, m.Constant(t_uint, block % 64));
+        integer = m.OpBitwiseXor(t_uint, integer, m.OpShiftLeftLogical(t_uint, integer, id));
+        value = m.OpFAdd(t_float, value, m.OpConvertUToF(t_float, integer));
+    }
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.AddEntryPoint(spv::ExecutionModel::GLCompute, main_func, "main", invocation);
+    m.AddExecutionMode(main_func, spv::ExecutionMode::LocalSize, 64, 1, 1);
+}
+
+void EmitTextureShader(Sirit::Module& m, std::uint32_t num_samples) {
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_void = m.TypeVoid();
+    const auto t_float = m.TypeFloat(32);
+    const auto float2 = m.TypeVector(t_float, 2);
+    const auto float4 = m.TypeVector(t_float, 4);
+    const auto image = m.TypeImage(t_float, spv::Dim::Dim2D, 0, false, false, 1,
+                                   spv::ImageFormat::Unknown);
+    const auto sampled_image = m.TypeSampledImage(image);
+    const auto sampled_image_ptr = m.TypePointer(spv::StorageClass::UniformConstant, sampled_image);
+    const auto texcoord = m.AddGlobalVariable(m.TypePointer(spv::StorageClass::Input, float2),
+                                              spv::StorageClass::Input);
+    const auto color = m.AddGlobalVariable(m.TypePointer(spv::StorageClass::Output, float4),
+                                           spv::StorageClass::Output);
+    m.Decorate(texcoord, spv::Decoration::Location, 0);
+    m.Decorate(color, spv::Decoration::Location, 0);
+
+    std::vector<Sirit::Id> textures;
+    for (std::uint32_t index = 0; index < num_samples; ++index) {
+        const auto texture =
+            m.AddGlobalVariable(sampled_image_ptr, spv::StorageClass::UniformConstant);
+        m.Decorate(texture, spv::Decoration::DescriptorSet, 0);
+        m.Decorate(texture, spv::Decoration::Binding, index);
+        textures.push_back(texture);
+    }
+
+    const auto main_func =
+        m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const auto coord = m.OpLoad(float2, texcoord);
+    auto result = m.ConstantNull(float4);
+    for (std::uint32_t index = 0; index < num_samples; ++index) {
+        const auto offset = m.Constant(t_float, static_cast<float>(index) / 64.0f);
+        const auto shifted = m.OpFAdd(float2, coord, m.ConstantComposite(float2, offset, offset));
+        const auto sample = m.OpImageSampleImplicitLod(
+            float4, m.OpLoad(sampled_image, textures[index]), shifted);
+        result = m.OpFAdd(float4, result, sample);
+    }
+    m.OpStore(color, result);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    std::vector<Sirit::Id> interfaces{texcoord, color};
+    m.AddEntryPoint(spv::ExecutionModel::Fragment, main_func, "main", interfaces);
+    m.AddExecutionMode(main_func, spv::ExecutionMode::OriginUpperLeft);
+}
+
+std::vector<CorpusEntry> Corpus() {
+    return {
+        {"vertex", EmitVertexShader},
+        {"arithmetic_64", [](Sirit::Module& m) { EmitArithmeticShader(m, 64); }},
+        {"arithmetic_4096", [](Sirit::Module& m) { EmitArithmeticShader(m, 4096); }},
+        {"texture_16", [](Sirit::Module& m) { EmitTextureShader(m, 16); }},
+        {"texture_256", [](Sirit::Module& m) { EmitTextureShader(m, 256); }},
+        {"synthetic_vertex",
+         [](Sirit::Module& m) {
+             EmitSyntheticShader(m, {.seed = 1, .stage = spv::ExecutionModel::Vertex,
+                                     .size = 2048});
+         }},
+        {"synthetic_fragment",
+         [](Sirit::Module& m) {
+             EmitSyntheticShader(m, {.seed = 2, .stage = spv::ExecutionModel::Fragment,
+                                     .size = 8192, .image_density = 0.1});
+         }},
+        {"synthetic_compute",
+         [](Sirit::Module& m) {
+             EmitSyntheticShader(m, {.seed = 3, .stage = spv::ExecutionModel::GLCompute,
+                                     .size = 8192, .max_depth = 5, .branch_density = 0.05});
+         }},
+    };
+}
+
+} // namespace Bench
@@ -0,0 +1,37 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include <sirit/sirit.h>
+
+#include "generator.h"
+
+namespace Bench {
+
+struct CorpusEntry {
+    std::string_view name;
+    std::function<void(Sirit::Module&)> emit;
+};
+
+/// Emits a minimal vertex shader writing its input position.
+void EmitVertexShader(Sirit::Module& m);
+
+/// Emits a compute shader with num_blocks blocks of dependent float and integer arithmetic.
+void EmitArithmeticShader(Sirit::Module& m, std::uint32_t num_blocks);
+
+/// Emits a fragment shader sampling num_samples textures and blending the results.
+void EmitTextureShader(Sirit::Module& m, std::uint32_t num_samples);
+
+/// Fixed set of modules used by the benchmarks, including seeded synthetic shaders.
+std::vector<CorpusEntry> Corpus();
+
+} // namespace Bench
@@ -0,0 +1,141 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "corpus.h"
+
+namespace Bench {
+
+namespace {
+
+constexpr std::uint32_t NUM_DECLARATIONS = 4096;
+constexpr std::uint32_t NUM_PHIS = 4096;
+
+/// Distinct values emitted by the high hit ratio declaration benchmarks.
+constexpr std::uint32_t HIGH_HIT_DISTINCT = 64;
+
+void RunDeclarationBenchmark(const Context& context, std::string_view name, bool high_hit,
+                             bool types) {
+    if (!context.Enabled(name)) {
+        return;
+    }
+    const std::uint32_t distinct = high_hit ? HIGH_HIT_DISTINCT : NUM_DECLARATIONS;
+    const Timing timing = Measure([&] {
+        Sirit::Module m;
+        const auto t_uint = m.TypeInt(32, false);
+        for (std::uint32_t index = 0; index < NUM_DECLARATIONS; ++index) {
+            const auto value = m.Constant(t_uint, index % distinct);
+            if (types) {
+                DoNotOptimize(m.TypeArray(t_uint, value));
+            }
+        }
+        DoNotOptimize(m);
+    });
+    const double hit_ratio = 1.0 - static_cast<double>(distinct) / NUM_DECLARATIONS;
+    context.Report(name, timing,
+                   {{"declarations", NUM_DECLARATIONS * (types ? 2.0 : 1.0)},
+                    {"hit_ratio", hit_ratio},
+                    {"ns_per_declaration", timing.NanosecondsPerIteration() / NUM_DECLARATIONS /
+                                               (types ? 2.0 : 1.0)}});
+}
+
+void RunEmitBenchmark(const Context& context, std::string_view name,
+                      const std::function<void(Sirit::Module&)>& emit) {
+    if (!context.Enabled(name)) {
+        return;
+    }
+    Sirit::Module sample;
+    emit(sample);
+    const std::size_t bytes = sample.Assemble().size() * sizeof(std::uint32_t);
+    const Timing timing = Measure([&] {
+        Sirit::Module m;
+        emit(m);
+        DoNotOptimize(m);
+    });
+    context.Report(name, timing,
+                   {{"bytes", static_cast<double>(bytes)},
+                    {"mb_per_s", timing.MegabytesPerSecond(bytes)}});
+}
+
+void RunPhiBenchmark(const Context& context) {
+    static constexpr std::string_view name = "emit/deferred_phi_patch";
+    if (!context.Enabled(name)) {
+        return;
+    }
+    Sirit::Module m;
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_void = m.TypeVoid();
+    const auto t_bool = m.TypeBool();
+    const auto t_float = m.TypeFloat(32);
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    const auto entry = m.AddLabel();
+    const auto body = m.OpLabel();
+    const auto merge = m.OpLabel();
+    m.OpSelectionMerge(merge, spv::SelectionControlMask::MaskNone);
+    m.OpBranchConditional(m.ConstantTrue(t_bool), body, merge);
+    m.AddLabel(body);
+    m.OpBranch(merge);
+    m.AddLabel(merge);
+    const std::array blocks{entry, body};
+    for (std::uint32_t index = 0; index < NUM_PHIS; ++index) {
+        m.DeferredOpPhi(t_float, blocks);
+    }
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    const std::array values{m.Constant(t_float, 0.0f), m.Constant(t_float, 1.0f)};
+    const Timing timing = Measure([&] {
+        m.PatchDeferredPhi([&](std::size_t index) { return values[index]; });
+    });
+    context.Report(name, timing,
+                   {{"phis", NUM_PHIS},
+                    {"ns_per_phi", timing.NanosecondsPerIteration() / NUM_PHIS}});
+}
+
+} // Anonymous namespace
+
+void RunEmissionBenchmarks(const Context& context) {
+    RunDeclarationBenchmark(context, "declare/constants_high_hit", true, false);
+    RunDeclarationBenchmark(context, "declare/constants_low_hit", false, false);
+    RunDeclarationBenchmark(context, "declare/types_high_hit", true, true);
+    RunDeclarationBenchmark(context, "declare/types_low_hit", false, true);
+    RunEmitBenchmark(context, "emit/arithmetic",
+                     [](Sirit::Module& m) { EmitArithmeticShader(m, 1024); });
+    RunEmitBenchmark(context, "emit/image", [](Sirit::Module& m) { EmitTextureShader(m, 1024); });
+    // Large enough for the code section to move to mapped storage when enabled
+    RunEmitBenchmark(context, "emit/arithmetic_large",
+                     [](Sirit::Module& m) { EmitArithmeticShader(m, 65536); });
+    RunEmitBenchmark(context, "emit/arithmetic_large/mapped", [](Sirit::Module& m) {
+        m.EnableMappedStorage();
+        EmitArithmeticShader(m, 65536);
+    });
+    RunPhiBenchmark(context);
+    for (const CorpusEntry& entry : Corpus()) {
+        if (entry.name.starts_with("synthetic_")) {
+            RunEmitBenchmark(context, "emit/" + std::string{entry.name}, entry.emit);
+            // Same shader, pre-sized from a profile of a previous compile
+            Sirit::CapacityProfile profile;
+            Sirit::Module sample;
+            entry.emit(sample);
+            profile.Record(sample);
+            RunEmitBenchmark(context, "emit/" + std::string{entry.name} + "/profiled",
+                             [&](Sirit::Module& m) {
+                                 m.ReserveSections(profile.Sizes());
+                                 entry.emit(m);
+                             });
+        }
+    }
+    RunEmitBenchmark(context, "emit/synthetic_low_reuse", [](Sirit::Module& m) {
+        EmitSyntheticShader(m, {.size = 8192, .constant_reuse = 0.1, .type_reuse = 0.1});
+    });
+}
+
+} // namespace Bench
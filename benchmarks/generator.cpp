@@ -0,0 +1,476 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+#include "generator.h"
+
+namespace Bench {
+
+namespace {
+
+/// Number of values in the constant pool drawn from when constants are reused.
+constexpr std::uint32_t CONSTANT_POOL_SIZE = 16;
+
+/// Lengths given to local arrays when types are reused.
+constexpr std::array<std::uint32_t, 3> COMMON_ARRAY_LENGTHS{4, 8, 16};
+
+/// Operations emitted per local array declared by the shader.
+constexpr std::uint32_t OPERATIONS_PER_LOCAL_ARRAY = 64;
+
+/// Probability of an operation storing to and loading from a local array.
+constexpr double MEMORY_DENSITY = 0.05;
+
+/// Number of sampled textures bound to shaders with image operations.
+constexpr std::uint32_t NUM_TEXTURES = 8;
+
+/// Maximum number of operations emitted inside a single construct.
+constexpr std::uint32_t MAX_CONSTRUCT_SIZE = 64;
+
+/// Number of values considered for phis or loop carried values when leaving a construct.
+constexpr std::uint32_t PHI_CANDIDATES = 4;
+
+/// SplitMix64, chosen over the standard distributions to stay reproducible across platforms.
+class Random {
+public:
+    explicit Random(std::uint64_t seed) : state{seed} {}
+
+    std::uint64_t Next() {
+        std::uint64_t value = (state += 0x9e3779b97f4a7c15ULL);
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    /// Returns a value in [0, bound).
+    std::uint32_t Below(std::uint32_t bound) {
+        return static_cast<std::uint32_t>(Next() % bound);
+    }
+
+    /// Returns a value in [0, 1).
+    float Float() {
+        return static_cast<float>(Next() >> 40) * 0x1.0p-24f;
+    }
+
+    bool Chance(double probability) {
+        return static_cast<double>(Next() >> 11) * 0x1.0p-53 < probability;
+    }
+
+private:
+    std::uint64_t state;
+};
+
+struct LocalArray {
+    Sirit::Id variable;
+    std::uint32_t length;
+};
+
+class Generator {
+public:
+    explicit Generator(Sirit::Module& m_, const ShaderParams& params_)
+        : m{m_}, params{params_}, random{params_.seed} {}
+
+    void Emit() {
+        m.AddCapability(spv::Capability::Shader);
+        m.SetMemoryModel(spv::AddressingModel::Logical, spv::MemoryModel::GLSL450);
+        t_void = m.TypeVoid();
+        t_bool = m.TypeBool();
+        t_uint = m.TypeInt(32, false);
+        t_float = m.TypeFloat(32);
+        float2 = m.TypeVector(t_float, 2);
+        float4 = m.TypeVector(t_float, 4);
+
+        DeclareTextures();
+        switch (params.stage) {
+        case spv::ExecutionModel::Vertex:
+            EmitVertex();
+            break;
+        case spv::ExecutionModel::GLCompute:
+            EmitCompute();
+            break;
+        default:
+            EmitFragment();
+            break;
+        }
+
+        std::size_t cursor = 0;
+        m.PatchDeferredPhi([&](std::size_t) { return deferred_values[cursor++]; });
+    }
+
+private:
+    void DeclareTextures() {
+        if (params.image_density <= 0.0) {
+            return;
+        }
+        const auto image = m.TypeImage(t_float, spv::Dim::Dim2D, 0, false, false, 1,
+                                       spv::ImageFormat::Unknown);
+        sampled_image_type = m.TypeSampledImage(image);
+        const auto sampled_image_ptr =
+            m.TypePointer(spv::StorageClass::UniformConstant, sampled_image_type);
+        for (std::uint32_t index = 0; index < NUM_TEXTURES; ++index) {
+            const auto texture =
+                m.AddGlobalVariable(sampled_image_ptr, spv::StorageClass::UniformConstant);
+            m.Decorate(texture, spv::Decoration::DescriptorSet, 0);
+            m.Decorate(texture, spv::Decoration::Binding, index);
+            textures.push_back(texture);
+        }
+    }
+
+    Sirit::Id AddInterface(spv::StorageClass storage_class, Sirit::Id type) {
+        const auto variable =
+            m.AddGlobalVariable(m.TypePointer(storage_class, type), storage_class);
+        interfaces.push_back(variable);
+        return variable;
+    }
+
+    Sirit::Id AddLocation(spv::StorageClass storage_class, std::uint32_t location) {
+        const auto variable = AddInterface(storage_class, float4);
+        m.Decorate(variable, spv::Decoration::Location, location);
+        return variable;
+    }
+
+    void EmitVertex() {
+        const auto in_position = AddLocation(spv::StorageClass::Input, 0);
+        const auto in_attribute = AddLocation(spv::StorageClass::Input, 1);
+        const auto out_varying = AddLocation(spv::StorageClass::Output, 0);
+        const auto out_position = AddInterface(spv::StorageClass::Output, float4);
+        m.Decorate(out_position, spv::Decoration::BuiltIn, spv::BuiltIn::Position);
+
+        const auto main_func = BeginMain();
+        values.push_back(m.OpLoad(float4, in_position));
+        values.push_back(m.OpLoad(float4, in_attribute));
+        EmitBody(0, params.size);
+        m.OpStore(out_position, values.front());
+        m.OpStore(out_varying, values.back());
+        EndMain();
+
+        m.AddEntryPoint(spv::ExecutionModel::Vertex, main_func, "main", interfaces);
+    }
+
+    void EmitFragment() {
+        const auto in_color = AddLocation(spv::StorageClass::Input, 0);
+        const auto in_texcoord = AddLocation(spv::StorageClass::Input, 1);
+        const auto out_color = AddLocation(spv::StorageClass::Output, 0);
+
+        const auto main_func = BeginMain();
+        values.push_back(m.OpLoad(float4, in_color));
+        values.push_back(m.OpLoad(float4, in_texcoord));
+        EmitBody(0, params.size);
+        m.OpStore(out_color, values.back());
+        EndMain();
+
+        m.AddEntryPoint(spv::ExecutionModel::Fragment, main_func, "main", interfaces);
+        m.AddExecutionMode(main_func, spv::ExecutionMode::OriginUpperLeft);
+    }
+
+    void EmitCompute() {
+        const auto uint3 = m.TypeVector(t_uint, 3);
+        const auto invocation = AddInterface(spv::StorageClass::Input, uint3);
+        m.Decorate(invocation, spv::Decoration::BuiltIn, spv::BuiltIn::GlobalInvocationId);
+
+        const auto float4_array = m.TypeRuntimeArray(float4);
+        const auto buffer_type = m.TypeStruct(float4_array);
+        m.Decorate(float4_array, spv::Decoration::ArrayStride, 16);
+        m.Decorate(buffer_type, spv::Decoration::BufferBlock);
+        m.MemberDecorate(buffer_type, 0, spv::Decoration::Offset, 0);
+        const auto buffer = m.AddGlobalVariable(
+            m.TypePointer(spv::StorageClass::Uniform, buffer_type), spv::StorageClass::Uniform);
+        m.Decorate(buffer, spv::Decoration::DescriptorSet, 0);
+        m.Decorate(buffer, spv::Decoration::Binding, NUM_TEXTURES);
+
+        const auto main_func = BeginMain();
+        const auto index = m.OpCompositeExtract(t_uint, m.OpLoad(uint3, invocation), 0);
+        const auto scalar = m.OpConvertUToF(t_float, index);
+        values.push_back(m.OpCompositeConstruct(float4, scalar, scalar, scalar, scalar));
+        EmitBody(0, params.size);
+        const auto uniform_float4 = m.TypePointer(spv::StorageClass::Uniform, float4);
+        m.OpStore(m.OpAccessChain(uniform_float4, buffer, m.Constant(t_uint, 0u), index),
+                  values.back());
+        EndMain();
+
+        m.AddEntryPoint(spv::ExecutionModel::GLCompute, main_func, "main", interfaces);
+        m.AddExecutionMode(main_func, spv::ExecutionMode::LocalSize, 64, 1, 1);
+    }
+
+    Sirit::Id BeginMain() {
+        const auto main_func =
+            m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+        current_label = m.AddLabel();
+
+        // Function variables must be declared at the start of the entry block
+        const std::uint32_t num_arrays = 1 + params.size / OPERATIONS_PER_LOCAL_ARRAY;
+        for (std::uint32_t index = 0; index < num_arrays; ++index) {
+            const std::uint32_t length =
+                random.Chance(params.type_reuse)
+                    ? COMMON_ARRAY_LENGTHS[random.Below(
+                          static_cast<std::uint32_t>(COMMON_ARRAY_LENGTHS.size()))]
+                    : 17 + random.Below(1024);
+            const auto type = m.TypeArray(t_float, m.Constant(t_uint, length));
+            const auto pointer = m.TypePointer(spv::StorageClass::Function, type);
+            local_arrays.push_back({m.AddLocalVariable(pointer, spv::StorageClass::Function),
+                                    length});
+        }
+        return main_func;
+    }
+
+    void EndMain() {
+        m.OpReturn();
+        m.OpFunctionEnd();
+    }
+
+    /// Emits count operations, opening nested constructs along the way.
+    void EmitBody(std::uint32_t depth, std::uint32_t count) {
+        while (count > 0) {
+            if (depth < params.max_depth && count > 1 && random.Chance(params.branch_density)) {
+                const std::uint32_t inner =
+                    1 + random.Below(std::min(count - 1, MAX_CONSTRUCT_SIZE));
+                if (random.Chance(0.5)) {
+                    EmitSelection(depth, inner);
+                } else {
+                    EmitLoop(depth, inner);
+                }
+                count -= inner;
+                continue;
+            }
+            EmitOperation();
+            --count;
+        }
+    }
+
+    /// Emits an if/else and merges values computed on both sides with phis.
+    void EmitSelection(std::uint32_t depth, std::uint32_t count) {
+        const auto scalar = m.OpCompositeExtract(t_float, Pick(), random.Below(4));
+        const auto condition = m.OpFOrdLessThan(t_bool, scalar, RandomConstant());
+        const auto true_label = m.OpLabel();
+        const auto false_label = m.OpLabel();
+        const auto merge_label = m.OpLabel();
+        m.OpSelectionMerge(merge_label, spv::SelectionControlMask::MaskNone);
+        m.OpBranchConditional(condition, true_label, false_label);
+
+        const std::size_t scope = values.size();
+        const std::uint32_t true_count = count / 2;
+        const auto [true_end, true_values] = EmitBranch(true_label, merge_label, depth,
+                                                        true_count, scope);
+        const auto [false_end, false_values] = EmitBranch(false_label, merge_label, depth,
+                                                          count - true_count, scope);
+
+        current_label = m.AddLabel(merge_label);
+        for (std::uint32_t candidate = 0; candidate < PHI_CANDIDATES; ++candidate) {
+            if (!random.Chance(params.phi_density)) {
+                continue;
+            }
+            const std::array operands{PickFrom(true_values), true_end, PickFrom(false_values),
+                                      false_end};
+            values.push_back(m.OpPhi(float4, operands));
+        }
+    }
+
+    /// Emits one side of a selection and returns its last block and the values it defined.
+    std::pair<Sirit::Id, std::vector<Sirit::Id>> EmitBranch(Sirit::Id label, Sirit::Id merge,
+                                                            std::uint32_t depth,
+                                                            std::uint32_t count,
+                                                            std::size_t scope) {
+        current_label = m.AddLabel(label);
+        EmitBody(depth + 1, count);
+        std::vector<Sirit::Id> defined(values.begin() + static_cast<std::ptrdiff_t>(scope),
+                                       values.end());
+        values.resize(scope);
+        m.OpBranch(merge);
+        return {current_label, std::move(defined)};
+    }
+
+    /// Emits a counted loop carrying values through the iterations with deferred phis.
+    void EmitLoop(std::uint32_t depth, std::uint32_t count) {
+        const auto preheader = current_label;
+        const auto header = m.OpLabel();
+        const auto body = m.OpLabel();
+        const auto continue_target = m.OpLabel();
+        const auto merge = m.OpLabel();
+        m.OpBranch(header);
+
+        m.AddLabel(header);
+        const std::array predecessors{preheader, continue_target};
+        const auto counter = m.DeferredOpPhi(t_uint, predecessors);
+        deferred_values.push_back(m.Constant(t_uint, 0u));
+        const std::size_t counter_slot = deferred_values.size();
+        deferred_values.emplace_back();
+
+        std::vector<std::size_t> carried_slots;
+        std::vector<Sirit::Id> carried;
+        for (std::uint32_t candidate = 0; candidate < PHI_CANDIDATES; ++candidate) {
+            if (!random.Chance(params.phi_density)) {
+                continue;
+            }
+            const auto initial = Pick();
+            carried.push_back(m.DeferredOpPhi(float4, predecessors));
+            deferred_values.push_back(initial);
+            carried_slots.push_back(deferred_values.size());
+            deferred_values.emplace_back();
+        }
+        values.insert(values.end(), carried.begin(), carried.end());
+
+        const auto trip_count = m.Constant(t_uint, 2 + random.Below(15));
+        m.OpLoopMerge(merge, continue_target, spv::LoopControlMask::MaskNone);
+        m.OpBranchConditional(m.OpULessThan(t_bool, counter, trip_count), body, merge);
+
+        current_label = m.AddLabel(body);
+        const std::size_t scope = values.size();
+        EmitBody(depth + 1, count);
+        std::vector<Sirit::Id> defined(values.begin() + static_cast<std::ptrdiff_t>(scope),
+                                       values.end());
+        values.resize(scope);
+        for (std::size_t index = 0; index < carried_slots.size(); ++index) {
+            deferred_values[carried_slots[index]] =
+                defined.empty() ? carried[index] : PickFrom(defined);
+        }
+        m.OpBranch(continue_target);
+
+        m.AddLabel(continue_target);
+        deferred_values[counter_slot] = m.OpIAdd(t_uint, counter, m.Constant(t_uint, 1u));
+        m.OpBranch(header);
+
+        current_label = m.AddLabel(merge);
+    }
+
+    void EmitOperation() {
+        if (!textures.empty() && random.Chance(params.image_density)) {
+            EmitImageSample();
+            return;
+        }
+        if (random.Chance(MEMORY_DENSITY)) {
+            EmitLocalArrayAccess();
+            return;
+        }
+        const auto a = Pick();
+        const auto b = Pick();
+        switch (random.Below(8)) {
+        case 0:
+            values.push_back(m.OpFAdd(float4, a, b));
+            break;
+        case 1:
+            values.push_back(m.OpFSub(float4, a, b));
+            break;
+        case 2:
+            values.push_back(m.OpFMul(float4, a, b));
+            break;
+        case 3:
+            values.push_back(m.OpFma(float4, a, b, RandomSplat()));
+            break;
+        case 4:
+            values.push_back(m.OpFClamp(float4, a, RandomSplat(), RandomSplat()));
+            break;
+        case 5:
+            values.push_back(m.OpFract(float4, m.OpSin(float4, a)));
+            break;
+        case 6: {
+            const auto x = m.OpCompositeExtract(t_float, a, random.Below(4));
+            const auto y = m.OpCompositeExtract(t_float, b, random.Below(4));
+            values.push_back(m.OpCompositeConstruct(float4, x, y, x, y));
+            break;
+        }
+        default: {
+            const auto scalar = m.OpCompositeExtract(t_float, a, random.Below(4));
+            auto integer = m.OpConvertFToU(t_uint, scalar);
+            integer = m.OpIAdd(t_uint, integer, m.Constant(t_uint, random.Below(64)));
+            const auto converted = m.OpConvertUToF(t_float, integer);
+            values.push_back(m.OpCompositeConstruct(float4, converted, converted, converted,
+                                                    converted));
+            break;
+        }
+        }
+    }
+
+    void EmitImageSample() {
+        const auto texture = textures[random.Below(NUM_TEXTURES)];
+        const auto source = Pick();
+        const auto coord = m.OpCompositeConstruct(float2, m.OpCompositeExtract(t_float, source, 0),
+                                                  m.OpCompositeExtract(t_float, source, 1));
+        const auto sampled_image = m.OpLoad(sampled_image_type, texture);
+        // Implicit level of detail is only available to fragment shaders
+        if (params.stage == spv::ExecutionModel::Fragment) {
+            values.push_back(m.OpImageSampleImplicitLod(float4, sampled_image, coord));
+        } else {
+            values.push_back(m.OpImageSampleExplicitLod(float4, sampled_image, coord,
+                                                        spv::ImageOperandsMask::Lod,
+                                                        m.Constant(t_float, 0.0f)));
+        }
+    }
+
+    void EmitLocalArrayAccess() {
+        const LocalArray& array = local_arrays[random.Below(
+            static_cast<std::uint32_t>(local_arrays.size()))];
+        const auto index = m.Constant(t_uint, random.Below(array.length));
+        const auto pointer = m.OpAccessChain(
+            m.TypePointer(spv::StorageClass::Function, t_float), array.variable, index);
+        m.OpStore(pointer, m.OpCompositeExtract(t_float, Pick(), random.Below(4)));
+        const auto value = m.OpLoad(t_float, pointer);
+        values.push_back(m.OpCompositeConstruct(float4, value, value, value, value));
+    }
+
+    /// Picks a live value, favouring recently defined ones like real shaders do.
+    Sirit::Id Pick() {
+        return PickFrom(values);
+    }
+
+    Sirit::Id PickFrom(const std::vector<Sirit::Id>& candidates) {
+        if (candidates.empty()) {
+            return Pick();
+        }
+        const auto size = static_cast<std::uint32_t>(candidates.size());
+        if (random.Chance(0.75)) {
+            return candidates[size - 1 - random.Below(std::min(size, 8u))];
+        }
+        return candidates[random.Below(size)];
+    }
+
+    Sirit::Id RandomConstant() {
+        if (random.Chance(params.constant_reuse)) {
+            const auto pooled = static_cast<float>(random.Below(CONSTANT_POOL_SIZE));
+            return m.Constant(t_float, pooled * 0.25f);
+        }
+        return m.Constant(t_float, random.Float() * 100.0f);
+    }
+
+    Sirit::Id RandomSplat() {
+        const auto value = RandomConstant();
+        return m.ConstantComposite(float4, value, value, value, value);
+    }
+
+    Sirit::Module& m;
+    const ShaderParams& params;
+    Random random;
+
+    Sirit::Id t_void{};
+    Sirit::Id t_bool{};
+    Sirit::Id t_uint{};
+    Sirit::Id t_float{};
+    Sirit::Id float2{};
+    Sirit::Id float4{};
+    Sirit::Id sampled_image_type{};
+
+    std::vector<Sirit::Id> interfaces;
+    std::vector<Sirit::Id> textures;
+    std::vector<LocalArray> local_arrays;
+
+    /// Live float4 values, in definition order.
+    std::vector<Sirit::Id> values;
+
+    /// Operands of the deferred phis, in the order PatchDeferredPhi visits them.
+    std::vector<Sirit::Id> deferred_values;
+
+    Sirit::Id current_label{};
+};
+
+} // Anonymous namespace
+
+void EmitSyntheticShader(Sirit::Module& m, const ShaderParams& params) {
+    Generator{m, params}.Emit();
+}
+
+} // namespace Bench
@@ -0,0 +1,48 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <sirit/sirit.h>
+
+namespace Bench {
+
+/// Shape of a synthetic shader. Equal parameters always produce the same module.
+struct ShaderParams {
+    /// Seed of the pseudo random sequence driving every choice of the generator.
+    std::uint64_t seed = 1;
+
+    /// Vertex, Fragment or GLCompute.
+    spv::ExecutionModel stage = spv::ExecutionModel::Fragment;
+
+    /// Number of value producing operations, excluding control flow.
+    std::uint32_t size = 1024;
+
+    /// Probability of drawing a constant from a small pool instead of creating a new one.
+    double constant_reuse = 0.9;
+
+    /// Probability of giving a local array one of a few common lengths instead of a new one.
+    double type_reuse = 0.9;
+
+    /// Maximum nesting of selections and loops.
+    std::uint32_t max_depth = 3;
+
+    /// Probability of opening a selection or a loop before each operation.
+    double branch_density = 0.02;
+
+    /// Probability of merging each candidate value with a phi when leaving a construct.
+    double phi_density = 0.5;
+
+    /// Probability of an operation being an image sample.
+    double image_density = 0.05;
+};
+
+/// Emits a structured shader of the given shape through the Module API.
+void EmitSyntheticShader(Sirit::Module& m, const ShaderParams& params);
+
+} // namespace Bench
@@ -0,0 +1,18 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include "bench.h"
+
+// Usage: sirit_bench [filter]
+// Runs the benchmarks whose name contains filter and prints one JSON object per result.
+int main(int argc, char** argv) {
+    const Bench::Context context{argc > 1 ? argv[1] : ""};
+    Bench::RunEmissionBenchmarks(context);
+    Bench::RunAssembleBenchmarks(context);
+    Bench::RunCompressionBenchmarks(context);
+    Bench::RunTraceBenchmarks(context);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bench.h"
+#include "corpus.h"
+
+namespace {
+
+int Usage() {
+    std::fprintf(stderr, "usage: sirit_replay <trace>\n"
+                         "       sirit_replay --record <corpus entry> <trace>\n");
+    return 1;
+}
+
+int Record(std::string_view name, const char* path) {
+    for (const Bench::CorpusEntry& entry : Bench::Corpus()) {
+        if (entry.name != name) {
+            continue;
+        }
+        Sirit::Module m;
+        m.StartRecording();
+        entry.emit(m);
+        const std::vector<std::uint8_t> trace = m.StopRecording();
+        std::ofstream file{path, std::ios::binary};
+        file.write(reinterpret_cast<const char*>(trace.data()),
+                   static_cast<std::streamsize>(trace.size()));
+        return file ? 0 : 1;
+    }
+    std::fprintf(stderr, "unknown corpus entry %.*s\n", static_cast<int>(name.size()),
+                 name.data());
+    return 1;
+}
+
+int Replay(const char* path) {
+    std::ifstream file{path, std::ios::binary};
+    const std::vector<std::uint8_t> trace{std::istreambuf_iterator<char>{file},
+                                          std::istreambuf_iterator<char>{}};
+    Sirit::Module m;
+    if (!file.is_open() || !m.Replay(trace)) {
+        std::fprintf(stderr, "%s: malformed trace\n", path);
+        return 1;
+    }
+    const std::size_t bytes = m.Assemble().size() * sizeof(std::uint32_t);
+    const Bench::Timing timing = Bench::Measure([&] {
+        Sirit::Module replayed;
+        Bench::DoNotOptimize(replayed.Replay(trace));
+    });
+    Bench::Context{""}.Report(path, timing,
+                              {{"trace_bytes", static_cast<double>(trace.size())},
+                               {"module_bytes", static_cast<double>(bytes)},
+                               {"mb_per_s", timing.MegabytesPerSecond(bytes)}});
+    return 0;
+}
+
+} // Anonymous namespace
+
+// Replays a trace recorded with Module::StartRecording, printing its timing as a JSON object.
+// Corpus entries can be recorded into traces to try it out.
+int main(int argc, char** argv) {
+    if (argc == 4 && std::string_view{argv[1]} == "--record") {
+        return Record(argv[2], argv[3]);
+    }
+    if (argc != 2) {
+        return Usage();
+    }
+    return Replay(argv[1]);
+}
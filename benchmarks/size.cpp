@@ -0,0 +1,127 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "corpus.h"
+
+namespace {
+
+struct SizeResult {
+    std::string name;
+    std::size_t words;
+};
+
+/// Runs the passes whose effect on the output size is tracked.
+void Optimize(Sirit::Module& m) {
+    m.PromoteLocalVariables();
+    m.ForwardLocalMemory();
+    m.FoldConstantBranches();
+    m.CombineCompositeOperations();
+    m.Canonicalize();
+}
+
+/// Prints the size of a module as a JSON object and returns its total words.
+std::size_t Report(const std::string& name, const Sirit::Module& m) {
+    const Sirit::ModuleStats stats = m.GetStats();
+    const std::size_t words = m.Assemble().size();
+    std::size_t instructions = 0;
+    for (const auto& [opcode, count] : stats.opcode_counts) {
+        instructions += count;
+    }
+    std::size_t section_words = 0;
+    std::printf("{\"name\":\"%s\",\"words\":%zu,\"instructions\":%zu,\"bound\":%u", name.c_str(),
+                words, instructions, stats.bound);
+    for (const Sirit::SectionStats& section : stats.sections) {
+        std::printf(",\"words_%.*s\":%zu", static_cast<int>(section.name.size()),
+                    section.name.data(), section.words);
+        section_words += section.words;
+    }
+    // Header, capabilities, extensions and the memory model
+    std::printf(",\"words_header\":%zu}\n", words - section_words);
+    return words;
+}
+
+std::map<std::string, std::size_t> ReadBaseline(const char* path) {
+    std::map<std::string, std::size_t> baseline;
+    std::ifstream file{path};
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream stream{line};
+        std::string name;
+        std::size_t words = 0;
+        if (stream >> name >> words) {
+            baseline.emplace(std::move(name), words);
+        }
+    }
+    return baseline;
+}
+
+bool WriteBaseline(const char* path, const std::vector<SizeResult>& results) {
+    std::ofstream file{path};
+    file << "# Words of the assembled corpus modules, generated with sirit_size --update\n";
+    for (const SizeResult& result : results) {
+        file << result.name << ' ' << result.words << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+/// Returns the number of modules larger than their baseline size.
+int Compare(const char* path, const std::vector<SizeResult>& results) {
+    const std::map<std::string, std::size_t> baseline = ReadBaseline(path);
+    int regressions = 0;
+    for (const SizeResult& result : results) {
+        const auto it = baseline.find(result.name);
+        if (it == baseline.end()) {
+            std::fprintf(stderr, "%s: missing from the baseline\n", result.name.c_str());
+            ++regressions;
+        } else if (result.words > it->second) {
+            std::fprintf(stderr, "%s: %zu words, baseline is %zu\n", result.name.c_str(),
+                         result.words, it->second);
+            ++regressions;
+        } else if (result.words < it->second) {
+            std::fprintf(stderr, "%s: shrank from %zu to %zu words, update the baseline\n",
+                         result.name.c_str(), it->second, result.words);
+        }
+    }
+    return regressions;
+}
+
+} // Anonymous namespace
+
+// Usage: sirit_size [--update] [baseline]
+// Prints the size of each corpus module, as emitted and after optimization, as one JSON object
+// per line. With a baseline, fails when a module grows past it; --update rewrites the baseline.
+int main(int argc, char** argv) {
+    const bool update = argc > 1 && std::string_view{argv[1]} == "--update";
+    const char* const baseline = argc > (update ? 2 : 1) ? argv[update ? 2 : 1] : nullptr;
+
+    std::vector<SizeResult> results;
+    for (const Bench::CorpusEntry& entry : Bench::Corpus()) {
+        Sirit::Module m;
+        entry.emit(m);
+        const std::string name{entry.name};
+        results.push_back({name, Report(name, m)});
+        Optimize(m);
+        results.push_back({name + "+opt", Report(name + "+opt", m)});
+    }
+    if (!baseline) {
+        return 0;
+    }
+    if (update) {
+        return WriteBaseline(baseline, results) ? 0 : 1;
+    }
+    return Compare(baseline, results) == 0 ? 0 : 1;
+}
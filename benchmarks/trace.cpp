@@ -0,0 +1,48 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <string>
+
+#include "bench.h"
+#include "corpus.h"
+
+namespace Bench {
+
+void RunTraceBenchmarks(const Context& context) {
+    for (const CorpusEntry& entry : Corpus()) {
+        const std::string record_name = "trace/" + std::string{entry.name} + "/record";
+        const std::string replay_name = "trace/" + std::string{entry.name} + "/replay";
+        if (!context.Enabled(record_name) && !context.Enabled(replay_name)) {
+            continue;
+        }
+        Sirit::Module m;
+        m.StartRecording();
+        entry.emit(m);
+        const std::vector<std::uint8_t> trace = m.StopRecording();
+        const std::size_t bytes = m.Assemble().size() * sizeof(std::uint32_t);
+
+        if (context.Enabled(record_name)) {
+            const Timing timing = Measure([&] {
+                Sirit::Module recorded;
+                recorded.StartRecording();
+                entry.emit(recorded);
+                DoNotOptimize(recorded.StopRecording());
+            });
+            context.Report(record_name, timing,
+                           {{"trace_bytes", static_cast<double>(trace.size())},
+                            {"module_bytes", static_cast<double>(bytes)}});
+        }
+        if (context.Enabled(replay_name)) {
+            const Timing timing = Measure([&] {
+                Sirit::Module replayed;
+                DoNotOptimize(replayed.Replay(trace));
+            });
+            context.Report(replay_name, timing, {{"mb_per_s", timing.MegabytesPerSecond(bytes)}});
+        }
+    }
+}
+
+} // namespace Bench
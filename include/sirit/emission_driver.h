@@ -0,0 +1,165 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "sirit/sirit.h"
+
+namespace Sirit {
+
+/**
+ * Coroutine emitting instructions into a module in slices.
+ * The coroutine suspends at each co_yield, which takes the id of the label or function just
+ * completed, so emission is sliced at block and function boundaries:
+ *
+ *     EmissionTask EmitShader(Module& m) {
+ *         ...
+ *         co_yield m.AddLabel();
+ *         ...
+ *         co_yield m.OpFunctionEnd();
+ *     }
+ *
+ * It starts suspended and only runs when resumed.
+ */
+class EmissionTask {
+public:
+    struct promise_type {
+        EmissionTask get_return_object() noexcept {
+            return EmissionTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() const noexcept {
+            return {};
+        }
+
+        std::suspend_always final_suspend() const noexcept {
+            return {};
+        }
+
+        std::suspend_always yield_value(Id) const noexcept {
+            return {};
+        }
+
+        void return_void() const noexcept {}
+
+        void unhandled_exception() noexcept {
+            exception = std::current_exception();
+        }
+
+        std::exception_ptr exception;
+    };
+
+    EmissionTask() = default;
+
+    explicit EmissionTask(std::coroutine_handle<promise_type> handle_) noexcept
+        : handle{handle_} {}
+
+    ~EmissionTask() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    EmissionTask(EmissionTask&& other) noexcept : handle{std::exchange(other.handle, {})} {}
+
+    EmissionTask& operator=(EmissionTask&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+
+    EmissionTask(const EmissionTask&) = delete;
+    EmissionTask& operator=(const EmissionTask&) = delete;
+
+    /**
+     * Runs the coroutine until its next yield or its end.
+     * Exceptions escaping the coroutine are rethrown here.
+     * @return True when the coroutine has finished.
+     */
+    bool Resume() {
+        if (!handle || handle.done()) {
+            return true;
+        }
+        handle.resume();
+        if (handle.promise().exception) {
+            std::rethrow_exception(std::exchange(handle.promise().exception, nullptr));
+        }
+        return handle.done();
+    }
+
+    /// Returns true when the coroutine has finished or there is none.
+    bool Done() const noexcept {
+        return !handle || handle.done();
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * Builds a module with an emission coroutine spread over multiple calls, for example one per
+ * frame on a thread that can't stall. Each call to Run resumes the coroutine until it finishes
+ * or a time budget is spent. The driver owns the module and the function creating the
+ * coroutine, so captures of lambda coroutines outlive the emission.
+ */
+class EmissionDriver {
+public:
+    using Generator = std::function<EmissionTask(Module&)>;
+
+    /**
+     * Creates a module and its emission coroutine, without emitting anything yet.
+     * @param generator Function returning the coroutine that emits the module.
+     * @param version   SPIR-V version of the module.
+     */
+    explicit EmissionDriver(Generator generator, std::uint32_t version = spv::Version);
+    ~EmissionDriver();
+
+    EmissionDriver(const EmissionDriver&) = delete;
+    EmissionDriver& operator=(const EmissionDriver&) = delete;
+
+    /**
+     * Resumes emission until it finishes or the budget is spent. The budget is checked at
+     * yield points, so a slice overruns it by at most the work between two yields. At least
+     * one slice is emitted per call. Exceptions escaping the coroutine are rethrown after
+     * releasing the coroutine and the module as Cancel does.
+     * @return True when the module is complete.
+     */
+    bool Run(std::chrono::nanoseconds budget);
+
+    /// Returns true when the module is complete.
+    bool Done() const noexcept {
+        return module && task.Done();
+    }
+
+    /// Stops emission and releases the coroutine and the partially emitted module.
+    void Cancel() noexcept;
+
+    /**
+     * Takes ownership of the emitted module.
+     * @return The complete module, or null when emission is unfinished, cancelled or the module
+     * was already taken.
+     */
+    std::unique_ptr<Module> TakeModule();
+
+private:
+    Generator generator;
+    std::unique_ptr<Module> module;
+    EmissionTask task;
+};
+
+} // namespace Sirit
@@ -9,13 +9,16 @@
 #include <array>
 #include <cstdint>
 #include <functional>
+#include <iterator>
+#include <map>
 #include <memory>
 #include <optional>
 #include <span>
 #include <string>
 #include <string_view>
 #include <type_traits>
-#include <unordered_set>
+#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -26,7 +29,9 @@ namespace Sirit {
 constexpr std::uint32_t GENERATOR_MAGIC_NUMBER = 0;
 
 class Declarations;
+class FunctionTable;
 class Operand;
+class Recorder;
 class Stream;
 
 using Literal =
@@ -36,15 +41,224 @@ struct Id {
     std::uint32_t value;
 };
 
+/**
+ * Pre-assembled sequence of instructions captured from a module.
+ * Ids defined by the fragment are stored relative to the base of each instantiation and its
+ * inputs are left as holes. Other ids refer to the declarations of the capturing module, so a
+ * fragment must be instantiated in the module that captured it.
+ */
+struct Fragment {
+    /// Instruction words with relative ids and zeroed holes.
+    std::vector<std::uint32_t> words;
+    /// Word offsets of the ids defined by the fragment.
+    std::vector<std::uint32_t> id_offsets;
+    /// Word offsets of the holes.
+    std::vector<std::uint32_t> hole_offsets;
+    /// Index of the input filling each hole offset.
+    std::vector<std::uint32_t> hole_inputs;
+    /// Types of the inputs.
+    std::vector<Id> input_types;
+    /// Relative ids of the values returned by the fragment.
+    std::vector<std::uint32_t> outputs;
+    /// Number of ids defined by the fragment.
+    std::uint32_t id_count{};
+};
+
+/**
+ * Word offsets of patchable literal operands in an assembled module.
+ * A cached binary can be specialized by rewriting these words directly, without rebuilding the
+ * module. Patch points are indexed in the order they were recorded.
+ */
+struct PatchTable {
+    /// Offset of patch points whose instruction is missing from the assembled module.
+    static constexpr std::uint32_t INVALID_OFFSET = ~std::uint32_t{0};
+
+    /**
+     * Rewrites the literal of a patch point in an assembled binary.
+     * @return False when the patch point is missing or out of the binary.
+     */
+    bool Patch(std::span<std::uint32_t> binary, std::size_t point,
+               std::uint32_t value) const noexcept {
+        if (point >= offsets.size() || offsets[point] >= binary.size()) {
+            return false;
+        }
+        binary[offsets[point]] = value;
+        return true;
+    }
+
+    /// Word offset of each patch point in the assembled binary.
+    std::vector<std::uint32_t> offsets;
+};
+
+/// Size and memory usage of a section of a module.
+struct SectionStats {
+    std::string_view name;
+    /// Words of the instructions in the section.
+    std::size_t words{};
+    /// Bytes allocated to hold the words, including reserved space.
+    std::size_t allocated_bytes{};
+    /// Times the storage of the section had to grow to reserve space for an instruction.
+    std::size_t growth_events{};
+};
+
+/// Words of each section of a module, and the number of declarations it deduplicates.
+struct SectionSizes {
+    std::size_t ext_inst_imports{};
+    std::size_t entry_points{};
+    std::size_t execution_modes{};
+    std::size_t debug{};
+    std::size_t annotations{};
+    std::size_t declarations{};
+    std::size_t global_variables{};
+    std::size_t code{};
+    /// Entries of the declaration deduplication table.
+    std::size_t unique_declarations{};
+};
+
+/// Emission statistics and memory usage of a module.
+struct ModuleStats {
+    /// Current id bound, one past the largest id.
+    std::uint32_t bound{};
+    /// Instructions in the assembled module by opcode, including the header instructions.
+    std::map<spv::Op, std::size_t> opcode_counts;
+    /// Sections stored as streams, in layout order.
+    std::vector<SectionStats> sections;
+    /// Declarations found already emitted and returned instead of being emitted again.
+    std::size_t declaration_hits{};
+    /// Declarations emitted because no equal declaration existed.
+    std::size_t declaration_misses{};
+    /// Estimated bytes allocated by the declaration deduplication table.
+    std::size_t dedup_table_bytes{};
+};
+
+/// Instruction decoded in place from a sequence of words.
+struct Instruction {
+    spv::Op opcode;
+    /// Words of the instruction, including the first word.
+    std::span<const std::uint32_t> words;
+};
+
+/// Forward iterator decoding instructions in place without copying their words.
+class InstructionIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Instruction;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Instruction;
+
+    InstructionIterator() = default;
+
+    /// Creates an iterator to the instruction at offset, the end iterator points past the words.
+    InstructionIterator(std::span<const std::uint32_t> words_, std::size_t offset_)
+        : words{words_}, offset{offset_} {}
+
+    Instruction operator*() const {
+        const std::size_t word_count = WordCount();
+        return Instruction{static_cast<spv::Op>(words[offset] & 0xffff),
+                           words.subspan(offset, word_count)};
+    }
+
+    InstructionIterator& operator++() {
+        offset += WordCount();
+        return *this;
+    }
+
+    InstructionIterator operator++(int) {
+        InstructionIterator copy = *this;
+        ++*this;
+        return copy;
+    }
+
+    bool operator==(const InstructionIterator& other) const noexcept {
+        return offset == other.offset;
+    }
+
+private:
+    /// Returns the word count of the current instruction, truncated words end the sequence.
+    std::size_t WordCount() const noexcept {
+        const std::size_t word_count = words[offset] >> 16;
+        if (word_count == 0 || word_count > words.size() - offset) {
+            return words.size() - offset;
+        }
+        return word_count;
+    }
+
+    std::span<const std::uint32_t> words;
+    std::size_t offset{};
+};
+
+/// Range of the instructions in a sequence of words, such as a module section.
+class InstructionRange {
+public:
+    explicit InstructionRange(std::span<const std::uint32_t> words_) : words{words_} {}
+
+    InstructionIterator begin() const {
+        return InstructionIterator{words, 0};
+    }
+
+    InstructionIterator end() const {
+        return InstructionIterator{words, words.size()};
+    }
+
+private:
+    std::span<const std::uint32_t> words;
+};
+
 [[nodiscard]] inline bool ValidId(Id id) noexcept {
     return id.value != 0;
 }
 
+#ifdef SIRIT_TRACING
+/**
+ * Receives the phases of the library, only available when built with SIRIT_TRACING.
+ * Names are string literals and timestamps are steady clock nanoseconds. Hooks are called from
+ * the threads using the library, implementations must be thread safe.
+ */
+class TracingHooks {
+public:
+    virtual ~TracingHooks() = default;
+
+    /// A phase such as assembling a module or running a pass starts.
+    virtual void Begin(const char* name, std::uint64_t timestamp_ns) = 0;
+
+    /// The latest phase started on this thread ends.
+    virtual void End(const char* name, std::uint64_t timestamp_ns) = 0;
+
+    /// Something without duration happens, such as constructing a module or a new declaration.
+    virtual void Instant(const char* name, std::uint64_t timestamp_ns) = 0;
+};
+
+/// Installs hooks receiving the phases of every module, or removes them when null.
+void SetTracingHooks(TracingHooks* hooks) noexcept;
+#endif
+
+/**
+ * Expands a stream produced by Module::AssembleCompressed into the assembled SPIR-V words.
+ * @return The assembled module, or an empty vector when the stream is malformed.
+ */
+std::vector<std::uint32_t> Decompress(std::span<const std::uint8_t> compressed);
+
 class Module {
 public:
     explicit Module(std::uint32_t version = spv::Version);
     ~Module();
 
+    /**
+     * Loads an assembled SPIR-V module to continue building it.
+     * Instructions are split into sections, declarations are registered for deduplication and
+     * the bound, capabilities, extensions and the GLSL.std.450 import are restored.
+     * Module scope OpLine instructions are kept in front of the global variables they apply
+     * to, the ones applying only to declarations are dropped.
+     * @return The loaded module, or null when the words are not a SPIR-V module.
+     */
+    static std::unique_ptr<Module> FromBinary(std::span<const std::uint32_t> binary);
+
+    /// Returns a view over the instructions of a SPIR-V binary, skipping its header.
+    static InstructionRange Instructions(std::span<const std::uint32_t> binary) {
+        return InstructionRange{binary.size() < 5 ? binary.last(0) : binary.subspan(5)};
+    }
+
     /**
      * Assembles current module into a SPIR-V stream.
      * It can be called multiple times but it's recommended to copy code
@@ -53,6 +267,98 @@ public:
      */
     std::vector<std::uint32_t> Assemble() const;
 
+    /**
+     * Assembles current module into a SPIR-V stream and resolves the word offsets of the
+     * recorded patch points in it. Patch points are single literal decorations recorded with
+     * DecoratePatchable and default values recorded with AddSpecConstantPatchPoint.
+     * @param patch_table Table receiving one offset per recorded patch point.
+     */
+    std::vector<std::uint32_t> Assemble(PatchTable& patch_table) const;
+
+    /**
+     * Returns a 128-bit hash of the module contents without assembling it.
+     * Sections keep a pair of running polynomial hashes updated as instructions are completed,
+     * so this only combines a few words per section. Modules assembling to the same words have
+     * the same hash, distinct modules collide with a negligible probability unless they are
+     * crafted to. The hash is not collision resistant: its parameters are public and modules
+     * colliding on purpose can be constructed, so caches keyed by it over untrusted shaders
+     * must confirm hits by comparing the assembled binaries.
+     */
+    std::array<std::uint64_t, 2> ContentHash() const;
+
+    /**
+     * Assembles current module into a compressed SPIR-V stream, encoding the sections directly.
+     * Instructions are coded with variable length integers, result ids as deltas from the
+     * previous result and other ids as deltas from the latest result, as in SMOL-V.
+     * @return Bytes that can be expanded back into the assembled module with Decompress.
+     */
+    std::vector<std::uint8_t> AssembleCompressed() const;
+
+    /**
+     * Returns statistics about the emitted instructions and the memory held by the module.
+     * Opcode counts are computed by walking the module, call it outside of hot loops.
+     */
+    ModuleStats GetStats() const;
+
+    /// Releases the space reserved for instructions that were never emitted.
+    void ShrinkToFit();
+
+    /// Returns the words each section has needed so far, including reservations.
+    SectionSizes GetSectionSizes() const;
+
+    /**
+     * Reserves room for the given words in each section and entries in the deduplication table,
+     * so modules of the expected size are emitted without reallocating their storage.
+     */
+    void ReserveSections(const SectionSizes& sizes);
+
+    /**
+     * Moves sections growing past 1 MiB to memory mapped storage. The mapping reserves address
+     * space that is committed as it's written, uses transparent huge pages when available and
+     * grows without copying the section. Only effective on Linux.
+     */
+    void EnableMappedStorage(bool enabled = true);
+
+    /**
+     * Starts recording the changes made to the module into a compact binary trace.
+     * The trace starts with a snapshot of the module and stores each completed instruction and
+     * in place change, so replaying it goes through the same emission and deduplication paths
+     * without the frontend that produced the module. Any recording in progress is discarded.
+     * Code already passed to the code sink isn't part of the snapshot.
+     */
+    void StartRecording();
+
+    /**
+     * Stops recording the module.
+     * @return The recorded trace, or an empty vector when the module wasn't being recorded.
+     */
+    std::vector<std::uint8_t> StopRecording();
+
+    /**
+     * Applies a trace recorded with StartRecording to a new module, reproducing the recorded
+     * module as it was when the recording stopped. Code streamed to the code sink while
+     * recording goes to the sink of this module, or is kept in it when it has no sink.
+     * @return False when the trace is malformed, the module is left partially replayed.
+     */
+    bool Replay(std::span<const std::uint8_t> trace);
+
+    /**
+     * Streams completed functions to sink instead of keeping them in the module, so the code held
+     * in memory is bounded by the function being built. Functions are passed at OpFunctionEnd,
+     * unless the module has deferred phi nodes; those are passed by the next FlushCode.
+     * The assembled module is the result of Assemble followed by the words given to the sink,
+     * once FlushCode has been called. Passes only see the code that hasn't been streamed and
+     * Canonicalize can't be used after code is streamed.
+     * @param sink Function receiving the code in order, or null to keep code in the module.
+     */
+    void SetCodeSink(std::function<void(std::span<const std::uint32_t>)> sink);
+
+    /**
+     * Passes the code emitted so far to the code sink. Must be called outside of functions.
+     * Deferred phi nodes in the passed code must have been patched, they are forgotten.
+     */
+    void FlushCode();
+
     /// Patches deferred phi nodes calling the passed function on each phi argument
     void PatchDeferredPhi(const std::function<Id(std::size_t index)>& func);
 
@@ -65,6 +371,51 @@ public:
     /// Sets module memory model.
     void SetMemoryModel(spv::AddressingModel addressing_model_, spv::MemoryModel memory_model_);
 
+    /**
+     * Enables discarding completed functions identical to a previous function, modulo the
+     * renaming of the ids they define. When a function is discarded, OpFunctionEnd returns the
+     * id of the existing function and callers must use it instead of the id from OpFunction.
+     * Functions with unpatched deferred phi nodes, decorated results or entry points are kept.
+     */
+    void EnableFunctionDeduplication(bool enabled = true);
+
+    /**
+     * Links functions from an assembled SPIR-V library into the module.
+     * Imported functions are looked up by their export linkage name or their debug name.
+     * They are copied into the code section together with the functions they call, and the
+     * global variables and imports they use. Library ids are rebased over the module bound.
+     * Types and constants are merged with the existing declarations.
+     * Libraries using OpTypeForwardPointer or decoration groups are not supported, and malformed
+     * libraries, such as ones using ids past their bound, can throw std::out_of_range instead of
+     * returning invalid ids. Must be called outside of functions.
+     * @param library_binary Words of the library module.
+     * @param imports        Names of the functions to import.
+     * @return Ids of the imported functions in the order of imports, invalid ids for names that
+     * were not found.
+     */
+    std::vector<Id> Link(std::span<const std::uint32_t> library_binary,
+                         std::span<const std::string_view> imports);
+
+    /**
+     * Captures the code emitted by a callback into a relocatable fragment.
+     * The callback receives one placeholder id per input type, emits instructions into the
+     * current function and returns the ids the fragment outputs, which must be defined by the
+     * emitted code. The emitted code is removed from the module, declarations created by the
+     * callback are kept. Names and decorations the callback gives to emitted results are
+     * removed with them and are not part of the fragment.
+     * Deferred phi nodes are not supported inside fragments.
+     */
+    Fragment CaptureFragment(
+        std::span<const Id> input_types,
+        const std::function<std::vector<Id>(std::span<const Id> inputs)>& emit);
+
+    /**
+     * Instantiates a fragment into the code section with a bulk copy of its words, rebasing the
+     * ids it defines over the module bound and filling its holes with inputs.
+     * @return Ids of the fragment outputs.
+     */
+    std::vector<Id> InstantiateFragment(const Fragment& fragment, std::span<const Id> inputs);
+
     /// Adds an entry point.
     void AddEntryPoint(spv::ExecutionModel execution_model, Id entry_point, std::string_view name,
                        std::span<const Id> interfaces = {});
@@ -225,13 +576,52 @@ public:
     /// Returns a null constant value.
     Id ConstantNull(Id result_type);
 
+    /// Returns a boolean specialization constant defaulting to true.
+    Id SpecConstantTrue(Id result_type);
+
+    /// Returns a boolean specialization constant defaulting to false.
+    Id SpecConstantFalse(Id result_type);
+
+    /// Returns a numeric scalar specialization constant.
+    Id SpecConstant(Id result_type, const Literal& default_value);
+
+    /// Returns a composite specialization constant.
+    Id SpecConstantComposite(Id result_type, std::span<const Id> constituents);
+
+    /// Returns a composite specialization constant.
+    template <typename... Ts>
+    requires(...&& std::is_convertible_v<Ts, Id>) Id
+        SpecConstantComposite(Id result_type, Ts&&... constituents) {
+        return SpecConstantComposite(result_type, std::span<const Id>({constituents...}));
+    }
+
+    /**
+     * Returns a specialization constant computed by an operation on other constants.
+     * @param opcode   Operation to compute, from the set allowed by OpSpecConstantOp.
+     * @param operands Id operands of the operation.
+     * @param literals Literal operands following the ids, such as composite indices.
+     */
+    Id SpecConstantOp(Id result_type, spv::Op opcode, std::span<const Id> operands,
+                      std::span<const std::uint32_t> literals = {});
+
+    /// Returns a specialization constant computed by an operation on other constants.
+    template <typename... Ts>
+    requires(...&& std::is_convertible_v<Ts, Id>) Id
+        SpecConstantOp(Id result_type, spv::Op opcode, Ts&&... operands) {
+        return SpecConstantOp(result_type, opcode, std::span<const Id>({operands...}));
+    }
+
     // Function
 
     /// Declares a function.
     Id OpFunction(Id result_type, spv::FunctionControlMask function_control, Id function_type);
 
-    /// Ends a function.
-    void OpFunctionEnd();
+    /**
+     * Ends a function.
+     * @return Id of the function, or the id of an identical function when deduplication is
+     * enabled and the ended function was discarded.
+     */
+    Id OpFunctionEnd();
 
     /// Call a function.
     Id OpFunctionCall(Id result_type, Id function, std::span<const Id> arguments = {});
@@ -365,6 +755,19 @@ public:
     /// Make a copy of a vector, with a single, variably selected, component modified.
     Id OpVectorInsertDynamic(Id result_type, Id vector, Id component, Id index);
 
+    /// Select arbitrary components from two vectors to make a new vector.
+    Id OpVectorShuffle(Id result_type, Id vector_1, Id vector_2,
+                       std::span<const Literal> components);
+
+    /// Select arbitrary components from two vectors to make a new vector.
+    template <typename... Ts>
+    requires(...&& std::is_convertible_v<Ts, Literal>) Id
+        OpVectorShuffle(Id result_type, Id vector_1, Id vector_2, Ts&&... components) {
+        const Literal stack_components[] = {std::forward<Ts>(components)...};
+        return OpVectorShuffle(result_type, vector_1, vector_2,
+                               std::span<const Literal>{stack_components});
+    }
+
     /// Make a copy of a composite object, while modifying one part of it.
     Id OpCompositeInsert(Id result_type, Id object, Id composite,
                          std::span<const Literal> indexes = {});
@@ -418,6 +821,24 @@ public:
         return Decorate(target, decoration, static_cast<std::uint32_t>(literal));
     }
 
+    /**
+     * Add a decoration with a single literal to target and record the literal as a patch point,
+     * such as a descriptor set, a binding or a specialization id.
+     * The decoration is identified by its target and kind, so it stays patchable after passes
+     * rewrite the annotations.
+     * @return Index of the patch point in the table filled by Assemble.
+     */
+    std::size_t DecoratePatchable(Id target, spv::Decoration decoration, std::uint32_t literal);
+
+    /**
+     * Records the default value of a specialization constant created with SpecConstant as a
+     * patch point. The patch point is the first word of the value, the high word of a 64-bit
+     * value follows it. Boolean specialization constants encode their value in the opcode and
+     * can't be patched.
+     * @return Index of the patch point in the table filled by Assemble.
+     */
+    std::size_t AddSpecConstantPatchPoint(Id spec_constant);
+
     Id MemberDecorate(Id structure_type, Literal member, spv::Decoration decoration,
                       std::span<const Literal> literals = {});
 
@@ -1295,14 +1716,88 @@ public:
     /// 3) store the New Value back through Pointer.
     Id OpAtomicXor(Id result_type, Id pointer, Id memory, Id semantics, Id value);
 
+    // Passes
+
+    /**
+     * Promotes Function storage class variables of scalar and vector types into SSA values.
+     * Only variables accessed exclusively through direct non-volatile loads and stores are
+     * promoted, phi nodes are inserted where control flow merges different stores.
+     * Deferred phi nodes must be patched before running this pass.
+     */
+    void PromoteLocalVariables();
+
+    /**
+     * Forwards stored and loaded values to later loads of the same pointer within a block and
+     * removes stores to Function variables that are overwritten or never read.
+     * Barriers, atomics and function calls invalidate memory that may be shared.
+     * Deferred phi nodes must be patched before running this pass.
+     */
+    void ForwardLocalMemory();
+
+    /**
+     * Replaces conditional branches and switches on constant selectors with unconditional
+     * branches, removes the blocks that become unreachable and simplifies the phi nodes that
+     * referenced them. Merge blocks and continue targets of remaining constructs are kept.
+     * Selections whose merge block is the target of a break nested in the taken arm keep their
+     * merge instruction, branching to the taken target or to the merge block.
+     * Deferred phi nodes must be patched before running this pass.
+     */
+    void FoldConstantBranches();
+
+    /**
+     * Fully unrolls structured loops whose trip count is known at compile time and doesn't
+     * exceed max_trip_count. The trip count is recognized from a 32-bit integer induction phi
+     * in the loop header stepped by a constant and compared against a constant in the exit test.
+     * Loops marked with DontUnroll are kept, loops without the Unroll hint are only unrolled
+     * when unroll_unmarked is true.
+     * Deferred phi nodes must be patched before running this pass.
+     */
+    void UnrollLoops(std::uint32_t max_trip_count, bool unroll_unmarked = true);
+
+    /**
+     * Combines chains of composite instructions. Extracts are forwarded through inserts,
+     * constructs and shuffles, vector constructs, inserts and shuffles gathering components of
+     * at most two vectors become a single OpVectorShuffle or reuse their source vector.
+     * Composite instructions left without uses are removed.
+     */
+    void CombineCompositeOperations();
+
+    /**
+     * Freezes specialization constants into regular constants, keeping their ids.
+     * Scalar specialization constants take the value mapped to their SpecId decoration, or their
+     * default value when it is not in the map, and lose the decoration. Dependent
+     * OpSpecConstantOp instructions over scalar integers and booleans, and composite extracts,
+     * are folded. Operations that can't be folded are kept over the frozen operands.
+     * @param values Values of the specialization constants indexed by SpecId.
+     */
+    void Specialize(const std::unordered_map<std::uint32_t, Literal>& values);
+
+    /**
+     * Rewrites the module into a normal form, so modules differing only in the emission order
+     * of their declarations or in their id numbering assemble to the same words.
+     * Declarations are sorted topologically, ties are broken by their structure. Ids are
+     * renumbered in the order they are first found in the module, and names and decorations are
+     * sorted by their target. Must be called outside of functions; ids returned before the call
+     * are invalidated.
+     */
+    void Canonicalize();
+
 private:
     Id GetGLSLstd450();
 
+    /// Discards the function just completed when it duplicates a previous one.
+    Id DeduplicateFunction(Id function);
+
+    /// Invokes func with the words of each section after the header, in layout order.
+    void ForEachSection(const std::function<void(std::span<const std::uint32_t>)>& func) const;
+
     std::uint32_t version{};
     std::uint32_t bound{};
 
-    std::unordered_set<std::string> extensions;
-    std::unordered_set<spv::Capability> capabilities;
+    /// Sorted and unique, so the assembled module doesn't depend on insertion order.
+    std::vector<std::string> extensions;
+    /// Sorted and unique, so the assembled module doesn't depend on insertion order.
+    std::vector<spv::Capability> capabilities;
     std::optional<Id> glsl_std_450;
 
     spv::AddressingModel addressing_model{spv::AddressingModel::Logical};
@@ -1317,6 +1812,38 @@ private:
     std::unique_ptr<Stream> global_variables;
     std::unique_ptr<Stream> code;
     std::vector<std::uint32_t> deferred_phi_nodes;
+    std::function<void(std::span<const std::uint32_t>)> code_sink;
+
+    std::unique_ptr<FunctionTable> function_table;
+    std::uint32_t current_function{};
+    std::uint32_t function_code_begin{};
+    std::uint32_t function_debug_begin{};
+    std::uint32_t function_annotations_begin{};
+
+    /// Targets and decorations of the recorded patch points, no decoration stands for the
+    /// default value of a specialization constant.
+    std::vector<std::pair<std::uint32_t, std::optional<spv::Decoration>>> patch_points;
+
+    std::unique_ptr<Recorder> recorder;
+};
+
+/**
+ * Learns the section sizes of finished modules to pre-size new ones, for example with one
+ * profile per shader stage. It keeps the largest size seen for each section. Profiles are not
+ * synchronized, guard them when modules are recorded from multiple threads.
+ */
+class CapacityProfile {
+public:
+    /// Records the sizes of a finished module.
+    void Record(const Module& module);
+
+    /// Returns the sizes to pass to Module::ReserveSections.
+    const SectionSizes& Sizes() const noexcept {
+        return sizes;
+    }
+
+private:
+    SectionSizes sizes;
 };
 
 } // namespace Sirit
@@ -0,0 +1,270 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "common_types.h"
+#include "ir.h"
+#include "tracing.h"
+#include "varint.h"
+
+namespace Sirit {
+
+namespace {
+
+constexpr std::array<u8, 4> COMPRESSED_MAGIC{'S', 'P', 'Z', '1'};
+
+/// Instruction words with a word count above this are stored in an extra integer.
+constexpr u32 MAX_INLINE_WORD_COUNT = 15;
+
+/// Ids past this limit are not tracked for the literal width of switch selectors.
+constexpr u32 MAX_TRACKED_ID = 1u << 22;
+
+enum class WordKind : u8 {
+    Literal,
+    Id,
+    ResultType,
+    Result,
+};
+
+/// Returns true for instructions whose id positions depend on the value of previous operands.
+bool HasValueDependentLayout(spv::Op op) {
+    switch (op) {
+    case spv::Op::OpSource:
+    case spv::Op::OpEntryPoint:
+    case spv::Op::OpLoad:
+    case spv::Op::OpStore:
+    case spv::Op::OpCopyMemory:
+    case spv::Op::OpCopyMemorySized:
+    case spv::Op::OpSwitch:
+    case spv::Op::OpSpecConstantOp:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Model of the instruction stream shared by the encoder and the decoder.
+ * Both sides code the words of an instruction in order and classify them from the same partial
+ * instruction, where words not coded yet are zero, so they always agree on how a word is coded.
+ */
+class Model {
+public:
+    /// Codes the operands of an instruction, partial holds its first word and zeros.
+    template <typename Func>
+    void CodeOperands(std::vector<u32>& partial, Func&& code) {
+        const spv::Op op = IR::Opcode(partial[0]);
+        const bool dependent = HasValueDependentLayout(op);
+        for (size_t index = 1; index < partial.size(); ++index) {
+            if (index == 1 || dependent) {
+                Classify(partial);
+            }
+            partial[index] = code(kinds[index]);
+        }
+        Update(partial);
+    }
+
+    /// Codes an id relative to the model state, updating it for results.
+    u64 EncodeId(WordKind kind, u32 id) {
+        switch (kind) {
+        case WordKind::Result: {
+            const s64 delta = static_cast<s64>(id) - static_cast<s64>(last_result) - 1;
+            last_result = id;
+            return ZigZag(delta);
+        }
+        case WordKind::ResultType:
+            return id;
+        default:
+            return ZigZag(static_cast<s64>(last_result) - static_cast<s64>(id));
+        }
+    }
+
+    /// Inverse of EncodeId.
+    u32 DecodeId(WordKind kind, u64 value) {
+        switch (kind) {
+        case WordKind::Result:
+            last_result = static_cast<u32>(static_cast<s64>(last_result) + 1 + UnZigZag(value));
+            return last_result;
+        case WordKind::ResultType:
+            return static_cast<u32>(value);
+        default:
+            return static_cast<u32>(static_cast<s64>(last_result) - UnZigZag(value));
+        }
+    }
+
+private:
+    void Classify(std::span<const u32> inst) {
+        const spv::Op op = IR::Opcode(inst[0]);
+        const size_t size = inst.size();
+        kinds.assign(size, WordKind::Literal);
+        const auto mark = [&](size_t index) {
+            if (index < size) {
+                kinds[index] = WordKind::Id;
+            }
+        };
+        // Malformed instructions without operands are coded as literals past their results
+        if (size > IR::FirstOperandIndex(op)) {
+            IR::ForEachId(inst, mark, SwitchLiteralWords(inst));
+        }
+        const size_t result_index = IR::ResultIndex(op);
+        if (result_index == 2 && size > 2) {
+            kinds[1] = WordKind::ResultType;
+        }
+        if (result_index != 0 && result_index < size) {
+            kinds[result_index] = WordKind::Result;
+        }
+    }
+
+    size_t SwitchLiteralWords(std::span<const u32> inst) const {
+        if (IR::Opcode(inst[0]) != spv::Op::OpSwitch || inst.size() < 2) {
+            return 1;
+        }
+        return inst[1] < wide_values.size() && wide_values[inst[1]] ? 2 : 1;
+    }
+
+    /// Tracks values of 64-bit scalar types, the only state switch literals depend on.
+    void Update(std::span<const u32> inst) {
+        const spv::Op op = IR::Opcode(inst[0]);
+        const size_t result_index = IR::ResultIndex(op);
+        if (result_index == 0 || result_index >= inst.size()) {
+            return;
+        }
+        const u32 result = inst[result_index];
+        bool is_wide = false;
+        if (op == spv::Op::OpTypeInt || op == spv::Op::OpTypeFloat) {
+            is_wide = inst.size() > 2 && inst[2] > 32;
+        } else if (result_index == 2) {
+            is_wide = inst[1] < wide_values.size() && wide_values[inst[1]];
+        }
+        if (result >= MAX_TRACKED_ID) {
+            return;
+        }
+        if (result >= wide_values.size()) {
+            if (!is_wide) {
+                return;
+            }
+            wide_values.resize(static_cast<size_t>(result) + 1);
+        }
+        wide_values[result] = is_wide;
+    }
+
+    std::vector<WordKind> kinds;
+    /// Whether each id is a 64-bit scalar type or a value of one.
+    std::vector<bool> wide_values;
+    u32 last_result = 0;
+};
+
+class Encoder {
+public:
+    explicit Encoder(std::span<const u32, 5> header) {
+        bytes.assign(COMPRESSED_MAGIC.begin(), COMPRESSED_MAGIC.end());
+        for (const u32 word : header.subspan<1>()) {
+            WriteVarint(bytes, word);
+        }
+    }
+
+    void Encode(std::span<const u32> words) {
+        IR::ForEachInstruction(words, [&](std::span<const u32> inst) {
+            const spv::Op op = IR::Opcode(inst[0]);
+            const u32 word_count = static_cast<u32>(inst.size());
+            const u32 inline_count = std::min(word_count, MAX_INLINE_WORD_COUNT);
+            WriteVarint(bytes, u64{static_cast<u32>(op)} << 4 | inline_count);
+            if (inline_count == MAX_INLINE_WORD_COUNT) {
+                WriteVarint(bytes, word_count - MAX_INLINE_WORD_COUNT);
+            }
+            partial.assign(word_count, 0);
+            partial[0] = inst[0];
+            size_t index = 1;
+            model.CodeOperands(partial, [&](WordKind kind) {
+                const u32 word = inst[index++];
+                WriteVarint(bytes, kind == WordKind::Literal ? word : model.EncodeId(kind, word));
+                return word;
+            });
+        });
+    }
+
+    std::vector<u8> Finish() && {
+        return std::move(bytes);
+    }
+
+private:
+    std::vector<u8> bytes;
+    std::vector<u32> partial;
+    Model model;
+};
+
+class Decoder {
+public:
+    explicit Decoder(std::span<const u8> bytes_) : bytes{bytes_}, reader{bytes_} {}
+
+    std::vector<u32> Decode() {
+        if (bytes.size() < COMPRESSED_MAGIC.size() ||
+            !std::equal(COMPRESSED_MAGIC.begin(), COMPRESSED_MAGIC.end(), bytes.begin())) {
+            return {};
+        }
+        reader = VarintReader{bytes, COMPRESSED_MAGIC.size()};
+        std::vector<u32> words{spv::MagicNumber};
+        for (size_t index = 1; index < 5; ++index) {
+            words.push_back(static_cast<u32>(reader.Read()));
+        }
+        while (reader.Ok() && !reader.Done()) {
+            const u64 first = reader.Read();
+            u64 word_count = first & 0xf;
+            if (word_count == MAX_INLINE_WORD_COUNT) {
+                word_count += reader.Read();
+            }
+            const u64 op = first >> 4;
+            if (word_count == 0 || word_count > 0xffff || op > 0xffff) {
+                return {};
+            }
+            // Each word takes at least one byte
+            if (word_count - 1 > reader.Remaining()) {
+                return {};
+            }
+            partial.assign(static_cast<size_t>(word_count), 0);
+            partial[0] = IR::MakeWord0(static_cast<spv::Op>(op), static_cast<size_t>(word_count));
+            model.CodeOperands(partial, [&](WordKind kind) {
+                const u64 value = reader.Read();
+                return kind == WordKind::Literal ? static_cast<u32>(value)
+                                                 : model.DecodeId(kind, value);
+            });
+            words.insert(words.end(), partial.begin(), partial.end());
+        }
+        if (!reader.Ok()) {
+            return {};
+        }
+        return words;
+    }
+
+private:
+    std::span<const u8> bytes;
+    VarintReader reader;
+    std::vector<u32> partial;
+    Model model;
+};
+
+} // Anonymous namespace
+
+std::vector<std::uint8_t> Module::AssembleCompressed() const {
+    SIRIT_TRACE_SCOPE("Module::AssembleCompressed");
+    const std::array<u32, 5> header{spv::MagicNumber, version, GENERATOR_MAGIC_NUMBER, bound + 1,
+                                    0};
+    Encoder encoder{header};
+    ForEachSection([&encoder](std::span<const u32> words) { encoder.Encode(words); });
+    return std::move(encoder).Finish();
+}
+
+std::vector<std::uint32_t> Decompress(std::span<const std::uint8_t> compressed) {
+    return Decoder{compressed}.Decode();
+}
+
+} // namespace Sirit
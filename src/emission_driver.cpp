@@ -0,0 +1,55 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include "sirit/emission_driver.h"
+
+#include "tracing.h"
+
+namespace Sirit {
+
+EmissionDriver::EmissionDriver(Generator generator_, std::uint32_t version)
+    : generator{std::move(generator_)}, module{std::make_unique<Module>(version)},
+      task{generator(*module)} {}
+
+EmissionDriver::~EmissionDriver() = default;
+
+bool EmissionDriver::Run(std::chrono::nanoseconds budget) {
+    if (!module) {
+        return false;
+    }
+    SIRIT_TRACE_SCOPE("EmissionDriver::Run");
+    const auto deadline = std::chrono::steady_clock::now() + budget;
+    do {
+        bool done;
+        try {
+            done = task.Resume();
+        } catch (...) {
+            // The coroutine can't be resumed anymore, don't hand out its partial module
+            Cancel();
+            throw;
+        }
+        if (done) {
+            return true;
+        }
+    } while (std::chrono::steady_clock::now() < deadline);
+    return false;
+}
+
+void EmissionDriver::Cancel() noexcept {
+    // The coroutine frame references the module, destroy it first
+    task = EmissionTask{};
+    module.reset();
+}
+
+std::unique_ptr<Module> EmissionDriver::TakeModule() {
+    if (!Done()) {
+        return nullptr;
+    }
+    task = EmissionTask{};
+    return std::move(module);
+}
+
+} // namespace Sirit
@@ -0,0 +1,132 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <cassert>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "common_types.h"
+#include "ir.h"
+#include "stream.h"
+
+namespace Sirit {
+
+Fragment Module::CaptureFragment(
+    std::span<const Id> input_types,
+    const std::function<std::vector<Id>(std::span<const Id> inputs)>& emit) {
+    std::unordered_map<u32, u32> holes;
+    std::vector<Id> inputs;
+    for (size_t index = 0; index < input_types.size(); ++index) {
+        inputs.push_back(Id{++bound});
+        holes.emplace(bound, static_cast<u32>(index));
+    }
+    const u32 begin = code->LocalAddress();
+    const u32 debug_begin = debug->LocalAddress();
+    const u32 annotations_begin = annotations->LocalAddress();
+    [[maybe_unused]] const size_t num_deferred_phis = deferred_phi_nodes.size();
+    const std::vector<Id> outputs = emit(inputs);
+    assert(deferred_phi_nodes.size() == num_deferred_phis);
+
+    Fragment fragment;
+    fragment.input_types.assign(input_types.begin(), input_types.end());
+    const std::span<const u32> words = code->Words().subspan(begin);
+    fragment.words.assign(words.begin(), words.end());
+
+    std::unordered_set<u32> local_ids;
+    std::unordered_map<u32, u32> local_types;
+    bool has_switch = false;
+    IR::ForEachInstruction(fragment.words, [&](std::span<const u32> inst) {
+        const spv::Op op = IR::Opcode(inst[0]);
+        if (const size_t result_index = IR::ResultIndex(op); result_index != 0) {
+            local_ids.insert(inst[result_index]);
+            if (result_index == 2) {
+                local_types.emplace(inst[2], inst[1]);
+            }
+        }
+        has_switch |= op == spv::Op::OpSwitch;
+    });
+    std::optional<IR::DeclarationTable> table;
+    if (has_switch) {
+        table.emplace(declarations->Words());
+    }
+
+    // Relocations are recorded in word order, renumbering local ids from zero
+    std::unordered_map<u32, u32> relative_ids;
+    const auto relative_id = [&](u32 id) {
+        const auto [it, inserted] = relative_ids.emplace(id, static_cast<u32>(relative_ids.size()));
+        return it->second;
+    };
+    size_t offset = 0;
+    IR::ForEachInstruction(words, [&](std::span<const u32> inst) {
+        size_t literal_words = 1;
+        if (IR::Opcode(inst[0]) == spv::Op::OpSwitch) {
+            const auto it = local_types.find(inst[1]);
+            const std::span<const u32> def = table->Find(inst[1]);
+            const u32 type = it != local_types.end() ? it->second : def.size() > 1 ? def[1] : 0;
+            literal_words = table->LiteralWords(type);
+        }
+        IR::ForEachId(
+            inst,
+            [&](size_t index) {
+                const u32 id = inst[index];
+                const u32 word_offset = static_cast<u32>(offset + index);
+                if (local_ids.contains(id)) {
+                    fragment.words[word_offset] = relative_id(id);
+                    fragment.id_offsets.push_back(word_offset);
+                } else if (const auto hole = holes.find(id); hole != holes.end()) {
+                    fragment.words[word_offset] = 0;
+                    fragment.hole_offsets.push_back(word_offset);
+                    fragment.hole_inputs.push_back(hole->second);
+                }
+            },
+            literal_words);
+        offset += inst.size();
+    });
+    for (const Id output : outputs) {
+        assert(local_ids.contains(output.value));
+        fragment.outputs.push_back(relative_id(output.value));
+    }
+    fragment.id_count = static_cast<u32>(relative_ids.size());
+    code->Truncate(begin);
+
+    // Names and decorations of the removed results would target undefined ids
+    const auto remove_targets = [&](Stream& stream, u32 stream_begin) {
+        const std::vector<u32> kept =
+            IR::RemoveTargets(stream.Words().subspan(stream_begin), local_ids);
+        stream.Truncate(stream_begin);
+        stream.Append(kept);
+    };
+    remove_targets(*debug, debug_begin);
+    remove_targets(*annotations, annotations_begin);
+    return fragment;
+}
+
+std::vector<Id> Module::InstantiateFragment(const Fragment& fragment, std::span<const Id> inputs) {
+    assert(inputs.size() == fragment.input_types.size());
+    const u32 base = bound + 1;
+    bound += fragment.id_count;
+
+    const std::span<u32> words = code->Append(fragment.words);
+    for (const u32 offset : fragment.id_offsets) {
+        words[offset] += base;
+    }
+    for (size_t index = 0; index < fragment.hole_offsets.size(); ++index) {
+        words[fragment.hole_offsets[index]] = inputs[fragment.hole_inputs[index]].value;
+    }
+
+    std::vector<Id> outputs;
+    outputs.reserve(fragment.outputs.size());
+    for (const u32 output : fragment.outputs) {
+        outputs.push_back(Id{output + base});
+    }
+    return outputs;
+}
+
+} // namespace Sirit
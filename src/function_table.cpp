@@ -0,0 +1,72 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <optional>
+
+#include "sirit/sirit.h"
+
+#include "function_table.h"
+#include "ir.h"
+
+namespace Sirit {
+
+CanonicalFunction CanonicalizeFunction(std::span<const u32> function,
+                                       std::span<const u32> declarations) {
+    CanonicalFunction result;
+    std::unordered_map<u32, u32> local_types;
+    bool has_switch = false;
+    IR::ForEachInstruction(function, [&](std::span<const u32> inst) {
+        const spv::Op op = IR::Opcode(inst[0]);
+        const size_t result_index = IR::ResultIndex(op);
+        if (result_index != 0) {
+            result.local_ids.insert(inst[result_index]);
+            if (result_index == 2) {
+                local_types.emplace(inst[2], inst[1]);
+            }
+        }
+        has_switch |= op == spv::Op::OpSwitch;
+    });
+
+    // Case literals of 64-bit selectors take two words
+    std::optional<IR::DeclarationTable> table;
+    if (has_switch) {
+        table.emplace(declarations);
+    }
+    const auto switch_literal_words = [&](std::span<const u32> inst) -> size_t {
+        if (IR::Opcode(inst[0]) != spv::Op::OpSwitch) {
+            return 1;
+        }
+        if (const auto it = local_types.find(inst[1]); it != local_types.end()) {
+            return table->LiteralWords(it->second);
+        }
+        const std::span<const u32> def = table->Find(inst[1]);
+        return def.size() > 1 ? table->LiteralWords(def[1]) : 1;
+    };
+
+    std::unordered_map<u32, u32> renames;
+    result.words.reserve(function.size());
+    IR::ForEachInstruction(function, [&](std::span<const u32> inst) {
+        const size_t offset = result.words.size();
+        result.words.insert(result.words.end(), inst.begin(), inst.end());
+        const std::span<u32> words = std::span(result.words).subspan(offset);
+        IR::ForEachId(
+            inst,
+            [&](size_t index) {
+                const u32 id = inst[index];
+                if (!result.local_ids.contains(id)) {
+                    words[index] = id << 1;
+                    return;
+                }
+                const auto [it, inserted] =
+                    renames.emplace(id, static_cast<u32>(renames.size()));
+                words[index] = it->second << 1 | 1;
+            },
+            switch_literal_words(inst));
+    });
+    return result;
+}
+
+} // namespace Sirit
@@ -0,0 +1,55 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "common_types.h"
+#include "ir.h"
+
+namespace Sirit {
+
+/// Function words with local ids renumbered in order of appearance.
+struct CanonicalFunction {
+    std::vector<u32> words;
+    /// Ids defined by the function.
+    std::unordered_set<u32> local_ids;
+};
+
+/**
+ * Renumbers the ids defined in a function in order of appearance, so functions that only differ
+ * in the ids they define have the same words. Local ids are encoded as odd words and other ids
+ * as even words, literals are kept as they are.
+ */
+CanonicalFunction CanonicalizeFunction(std::span<const u32> function,
+                                       std::span<const u32> declarations);
+
+/// Hash-consing table of completed functions.
+class FunctionTable {
+public:
+    /**
+     * Looks up an identical function, inserting the canonical words when there's none.
+     * @return The id of the identical function or nothing when the function is new.
+     */
+    std::optional<u32> Insert(std::vector<u32> canonical_words, u32 function_id) {
+        const auto [entry, inserted] = existing_functions.emplace(std::move(canonical_words),
+                                                                  function_id);
+        if (inserted) {
+            return std::nullopt;
+        }
+        return entry->second;
+    }
+
+private:
+    std::unordered_map<std::vector<u32>, u32, IR::HashWords> existing_functions;
+};
+
+} // namespace Sirit
@@ -8,6 +8,7 @@
 
 #include "sirit/sirit.h"
 
+#include "common_types.h"
 #include "stream.h"
 
 namespace Sirit {
@@ -17,6 +18,17 @@ Id Module::Decorate(Id target, spv::Decoration decoration, std::span<const Liter
     return *annotations << spv::Op::OpDecorate << target << decoration << literals << EndOp{};
 }
 
+std::size_t Module::DecoratePatchable(Id target, spv::Decoration decoration, u32 literal) {
+    Decorate(target, decoration, literal);
+    patch_points.emplace_back(target.value, decoration);
+    return patch_points.size() - 1;
+}
+
+std::size_t Module::AddSpecConstantPatchPoint(Id spec_constant) {
+    patch_points.emplace_back(spec_constant.value, std::nullopt);
+    return patch_points.size() - 1;
+}
+
 Id Module::MemberDecorate(Id structure_type, Literal member, spv::Decoration decoration,
                           std::span<const Literal> literals) {
     annotations->Reserve(4 + literals.size());
@@ -45,4 +45,34 @@ Id Module::ConstantNull(Id result_type) {
     return *declarations << OpId{spv::Op::OpConstantNull, result_type} << EndOp{};
 }
 
+Id Module::SpecConstantTrue(Id result_type) {
+    declarations->Reserve(3);
+    return *declarations << OpId{spv::Op::OpSpecConstantTrue, result_type} << EndOp{};
+}
+
+Id Module::SpecConstantFalse(Id result_type) {
+    declarations->Reserve(3);
+    return *declarations << OpId{spv::Op::OpSpecConstantFalse, result_type} << EndOp{};
+}
+
+Id Module::SpecConstant(Id result_type, const Literal& default_value) {
+    declarations->Reserve(3 + 2);
+    return *declarations << OpId{spv::Op::OpSpecConstant, result_type} << default_value
+                         << EndOp{};
+}
+
+Id Module::SpecConstantComposite(Id result_type, std::span<const Id> constituents) {
+    declarations->Reserve(3 + constituents.size());
+    return *declarations << OpId{spv::Op::OpSpecConstantComposite, result_type} << constituents
+                         << EndOp{};
+}
+
+Id Module::SpecConstantOp(Id result_type, spv::Op opcode, std::span<const Id> operands,
+                          std::span<const std::uint32_t> literals) {
+    declarations->Reserve(4 + operands.size() + literals.size());
+    return *declarations << OpId{spv::Op::OpSpecConstantOp, result_type}
+                         << static_cast<std::uint32_t>(opcode) << operands << literals
+                         << EndOp{};
+}
+
 } // namespace Sirit
@@ -4,21 +4,82 @@
  * 3-Clause BSD License
  */
 
+#include <utility>
+
 #include "sirit/sirit.h"
 
+#include "function_table.h"
+#include "ir.h"
 #include "stream.h"
 
 namespace Sirit {
 
 Id Module::OpFunction(Id result_type, spv::FunctionControlMask function_control, Id function_type) {
+    function_code_begin = code->LocalAddress();
+    function_debug_begin = debug->LocalAddress();
+    function_annotations_begin = annotations->LocalAddress();
     code->Reserve(5);
-    return *code << OpId{spv::Op::OpFunction, result_type} << function_control << function_type
-                 << EndOp{};
+    const Id function = *code << OpId{spv::Op::OpFunction, result_type} << function_control
+                              << function_type << EndOp{};
+    current_function = function.value;
+    return function;
 }
 
-void Module::OpFunctionEnd() {
+Id Module::OpFunctionEnd() {
     code->Reserve(1);
     *code << spv::Op::OpFunctionEnd << EndOp{};
+
+    const Id function = DeduplicateFunction(Id{std::exchange(current_function, 0)});
+    // Deferred phi nodes are patched through their offset in the code section
+    if (code_sink && deferred_phi_nodes.empty()) {
+        FlushCode();
+    }
+    return function;
+}
+
+Id Module::DeduplicateFunction(Id function) {
+    if (!function_table) {
+        return function;
+    }
+    // Deferred phi nodes are patched through their offset in the code section
+    if (!deferred_phi_nodes.empty() && deferred_phi_nodes.back() >= function_code_begin) {
+        return function;
+    }
+    bool is_referenced = false;
+    IR::ForEachInstruction(entry_points->Words(), [&](std::span<const u32> inst) {
+        is_referenced |= inst[2] == function.value;
+    });
+    IR::ForEachInstruction(execution_modes->Words(), [&](std::span<const u32> inst) {
+        is_referenced |= inst[1] == function.value;
+    });
+    if (is_referenced) {
+        return function;
+    }
+    CanonicalFunction canonical = CanonicalizeFunction(
+        code->Words().subspan(function_code_begin), declarations->Words());
+
+    // Decorations on results change the meaning of the function
+    bool is_decorated = false;
+    IR::ForEachInstruction(annotations->Words().subspan(function_annotations_begin),
+                           [&](std::span<const u32> inst) {
+                               is_decorated |= canonical.local_ids.contains(inst[1]);
+                           });
+    if (is_decorated) {
+        return function;
+    }
+    const std::optional<u32> existing =
+        function_table->Insert(std::move(canonical.words), function.value);
+    if (!existing) {
+        return function;
+    }
+    code->Truncate(function_code_begin);
+
+    // Drop the debug names of the discarded ids
+    const std::vector<u32> names =
+        IR::RemoveTargets(debug->Words().subspan(function_debug_begin), canonical.local_ids);
+    debug->Truncate(function_debug_begin);
+    debug->Append(names);
+    return Id{*existing};
 }
 
 Id Module::OpFunctionCall(Id result_type, Id function, std::span<const Id> arguments) {
@@ -0,0 +1,200 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <cassert>
+
+#include "sirit/sirit.h"
+
+#include "ir.h"
+
+namespace Sirit::IR {
+
+std::vector<Function> ParseFunctions(std::span<const u32> code) {
+    std::vector<Function> functions;
+    Function* function = nullptr;
+    ForEachInstruction(code, [&](std::span<const u32> words) {
+        Inst inst{{words.begin(), words.end()}};
+        switch (inst.Op()) {
+        case spv::Op::OpFunction:
+            function = &functions.emplace_back();
+            function->def = std::move(inst);
+            break;
+        case spv::Op::OpFunctionParameter:
+            assert(function && function->blocks.empty());
+            function->params.push_back(std::move(inst));
+            break;
+        case spv::Op::OpLabel:
+            assert(function);
+            function->blocks.push_back(Block{words[1], {}});
+            break;
+        case spv::Op::OpFunctionEnd:
+            assert(function);
+            function->end = std::move(inst);
+            function = nullptr;
+            break;
+        default:
+            assert(function && !function->blocks.empty());
+            function->blocks.back().insts.push_back(std::move(inst));
+            break;
+        }
+    });
+    return functions;
+}
+
+void Serialize(const Function& function, std::vector<u32>& output) {
+    const auto insert = [&output](const Inst& inst) {
+        output.insert(output.end(), inst.words.begin(), inst.words.end());
+    };
+    insert(function.def);
+    for (const Inst& param : function.params) {
+        insert(param);
+    }
+    for (const Block& block : function.blocks) {
+        output.push_back(MakeWord0(spv::Op::OpLabel, 2));
+        output.push_back(block.label);
+        for (const Inst& inst : block.insts) {
+            insert(inst);
+        }
+    }
+    insert(function.end);
+}
+
+std::vector<u32> Serialize(std::span<const Function> functions) {
+    std::vector<u32> output;
+    for (const Function& function : functions) {
+        Serialize(function, output);
+    }
+    return output;
+}
+
+size_t SwitchLiteralWords(const Function& function, const Inst& inst,
+                          const DeclarationTable& table) {
+    if (inst.Op() != spv::Op::OpSwitch) {
+        return 1;
+    }
+    const u32 selector = inst.words[1];
+    if (const std::span<const u32> def = table.Find(selector); !def.empty()) {
+        return table.LiteralWords(def[1]);
+    }
+    for (const Inst& param : function.params) {
+        if (param.Result() == selector) {
+            return table.LiteralWords(param.Type());
+        }
+    }
+    for (const Block& block : function.blocks) {
+        for (const Inst& def : block.insts) {
+            if (def.Result() == selector) {
+                return table.LiteralWords(def.Type());
+            }
+        }
+    }
+    return 1;
+}
+
+CFG::CFG(const Function& function, const DeclarationTable& table) {
+    const size_t num_blocks = function.blocks.size();
+    block_index.reserve(num_blocks);
+    for (size_t index = 0; index < num_blocks; ++index) {
+        block_index.emplace(function.blocks[index].label, index);
+    }
+    succs.resize(num_blocks);
+    preds.resize(num_blocks);
+    for (size_t index = 0; index < num_blocks; ++index) {
+        const Inst& terminator = function.blocks[index].Terminator();
+        const size_t literal_words = SwitchLiteralWords(function, terminator, table);
+        ForEachSuccessor(
+            terminator,
+            [&](u32 label) {
+                const size_t succ = block_index.at(label);
+                if (std::ranges::find(succs[index], succ) == succs[index].end()) {
+                    succs[index].push_back(succ);
+                    preds[succ].push_back(index);
+                }
+            },
+            literal_words);
+    }
+
+    // Iterative depth first search to compute the post-order
+    rpo_index.assign(num_blocks, UNREACHABLE);
+    if (num_blocks == 0) {
+        return;
+    }
+    std::vector<bool> visited(num_blocks);
+    std::vector<std::pair<size_t, size_t>> stack{{0, 0}};
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& [block, next_succ] = stack.back();
+        if (next_succ < succs[block].size()) {
+            const size_t succ = succs[block][next_succ++];
+            if (!visited[succ]) {
+                visited[succ] = true;
+                stack.emplace_back(succ, 0);
+            }
+            continue;
+        }
+        rpo.push_back(block);
+        stack.pop_back();
+    }
+    std::ranges::reverse(rpo);
+    for (size_t index = 0; index < rpo.size(); ++index) {
+        rpo_index[rpo[index]] = index;
+    }
+
+    // "A Simple, Fast Dominance Algorithm" by Cooper, Harvey and Kennedy
+    idom.assign(num_blocks, UNREACHABLE);
+    idom[0] = 0;
+    const auto intersect = [this](size_t a, size_t b) {
+        while (a != b) {
+            while (rpo_index[a] > rpo_index[b]) {
+                a = idom[a];
+            }
+            while (rpo_index[b] > rpo_index[a]) {
+                b = idom[b];
+            }
+        }
+        return a;
+    };
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const size_t block : std::span(rpo).subspan(1)) {
+            size_t new_idom = UNREACHABLE;
+            for (const size_t pred : preds[block]) {
+                if (idom[pred] == UNREACHABLE) {
+                    continue;
+                }
+                new_idom = new_idom == UNREACHABLE ? pred : intersect(pred, new_idom);
+            }
+            if (idom[block] != new_idom) {
+                idom[block] = new_idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool CFG::Dominates(size_t a, size_t b) const {
+    assert(Reachable(a) && Reachable(b));
+    while (b != a && b != 0) {
+        b = idom[b];
+    }
+    return b == a;
+}
+
+std::unordered_map<u32, size_t> IndexDefinitions(std::span<const u32> words) {
+    std::unordered_map<u32, size_t> definitions;
+    size_t offset = 0;
+    ForEachInstruction(words, [&](std::span<const u32> inst) {
+        const size_t result_index = ResultIndex(Opcode(inst[0]));
+        if (result_index != 0) {
+            definitions.emplace(inst[result_index], offset);
+        }
+        offset += inst.size();
+    });
+    return definitions;
+}
+
+} // namespace Sirit::IR
@@ -0,0 +1,581 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <spirv/unified1/spirv.hpp>
+
+#include "common_types.h"
+
+namespace Sirit::IR {
+
+/// Returns the opcode encoded in the first word of an instruction.
+inline spv::Op Opcode(u32 first_word) noexcept {
+    return static_cast<spv::Op>(first_word & 0xffff);
+}
+
+/// Returns the word count encoded in the first word of an instruction.
+inline u32 WordCount(u32 first_word) noexcept {
+    return first_word >> 16;
+}
+
+/// Builds the first word of an instruction.
+constexpr u32 MakeWord0(spv::Op op, size_t word_count) {
+    return static_cast<u32>(op) | static_cast<u32>(word_count) << 16;
+}
+
+/// Returns the index of the result id, or zero if the instruction doesn't have one.
+inline size_t ResultIndex(spv::Op op) noexcept {
+    bool has_result;
+    bool has_result_type;
+    spv::HasResultAndType(op, &has_result, &has_result_type);
+    if (!has_result) {
+        return 0;
+    }
+    return has_result_type ? 2 : 1;
+}
+
+/// Returns the index of the first operand after the result type and result id.
+inline size_t FirstOperandIndex(spv::Op op) noexcept {
+    bool has_result;
+    bool has_result_type;
+    spv::HasResultAndType(op, &has_result, &has_result_type);
+    return size_t{1} + static_cast<size_t>(has_result) + static_cast<size_t>(has_result_type);
+}
+
+/// Returns the number of words used by a literal string starting at index.
+inline size_t StringWords(std::span<const u32> words, size_t index) {
+    size_t count = 0;
+    while (index + count < words.size()) {
+        const u32 word = words[index + count++];
+        if ((word >> 24) == 0) {
+            break;
+        }
+    }
+    return count;
+}
+
+/// Returns true for instructions declared in the types and constants section.
+inline bool IsDeclaration(spv::Op op) noexcept {
+    const u32 value = static_cast<u32>(op);
+    if (value >= static_cast<u32>(spv::Op::OpTypeVoid) &&
+        value <= static_cast<u32>(spv::Op::OpTypePipe)) {
+        return true;
+    }
+    if (value >= static_cast<u32>(spv::Op::OpConstantTrue) &&
+        value <= static_cast<u32>(spv::Op::OpSpecConstantOp)) {
+        return true;
+    }
+    return op == spv::Op::OpUndef;
+}
+
+/// Hash of a sequence of words, used to hash-cons instructions.
+struct HashWords {
+    size_t operator()(std::span<const u32> words) const noexcept {
+        size_t hash = words.size();
+        for (const u32 word : words) {
+            hash = (hash ^ word) * 0x100000001B3ULL;
+        }
+        return hash;
+    }
+};
+
+/// Decodes a literal string starting at index.
+inline std::string LiteralString(std::span<const u32> words, size_t index) {
+    std::string string;
+    for (; index < words.size(); ++index) {
+        for (u32 shift = 0; shift < 32; shift += 8) {
+            const char character = static_cast<char>((words[index] >> shift) & 0xff);
+            if (character == '\0') {
+                return string;
+            }
+            string.push_back(character);
+        }
+    }
+    return string;
+}
+
+namespace Detail {
+
+template <typename Func>
+void ForEachMemoryOperandId(std::span<const u32> words, size_t index, Func&& func) {
+    if (index >= words.size()) {
+        return;
+    }
+    const u32 mask = words[index++];
+    if ((mask & static_cast<u32>(spv::MemoryAccessMask::Aligned)) != 0) {
+        ++index;
+    }
+    if ((mask & static_cast<u32>(spv::MemoryAccessMask::MakePointerAvailable)) != 0) {
+        func(index++);
+    }
+    if ((mask & static_cast<u32>(spv::MemoryAccessMask::MakePointerVisible)) != 0) {
+        func(index++);
+    }
+}
+
+template <typename Func>
+void ForEachIdInRange(size_t begin, size_t end, Func&& func) {
+    for (size_t index = begin; index < end; ++index) {
+        func(index);
+    }
+}
+
+template <typename Func>
+void ForEachImageOperandId(std::span<const u32> words, size_t mask_index, Func&& func) {
+    const size_t first = FirstOperandIndex(Opcode(words[0]));
+    ForEachIdInRange(first, std::min(mask_index, words.size()), func);
+    ForEachIdInRange(mask_index + 1, words.size(), func);
+}
+
+} // namespace Detail
+
+/**
+ * Invokes func with the word index of each <id> operand of an instruction.
+ * The result type and the result id are not visited.
+ *
+ * @param words               Words of the instruction, including its first word.
+ * @param switch_literal_words Number of words used by each OpSwitch case literal.
+ */
+template <typename Func>
+void ForEachIdOperand(std::span<const u32> words, Func&& func, size_t switch_literal_words = 1) {
+    const spv::Op op = Opcode(words[0]);
+    const size_t size = words.size();
+    const size_t first = FirstOperandIndex(op);
+    switch (op) {
+    case spv::Op::OpCapability:
+    case spv::Op::OpExtension:
+    case spv::Op::OpMemoryModel:
+    case spv::Op::OpExtInstImport:
+    case spv::Op::OpString:
+    case spv::Op::OpSourceExtension:
+    case spv::Op::OpSourceContinued:
+    case spv::Op::OpModuleProcessed:
+    case spv::Op::OpTypeInt:
+    case spv::Op::OpTypeFloat:
+    case spv::Op::OpTypeOpaque:
+    case spv::Op::OpTypePipe:
+    case spv::Op::OpConstant:
+    case spv::Op::OpSpecConstant:
+    case spv::Op::OpConstantSampler:
+        return;
+    case spv::Op::OpSource:
+        if (size > 3) {
+            func(3);
+        }
+        return;
+    case spv::Op::OpName:
+    case spv::Op::OpMemberName:
+    case spv::Op::OpDecorate:
+    case spv::Op::OpMemberDecorate:
+    case spv::Op::OpDecorateString:
+    case spv::Op::OpMemberDecorateString:
+    case spv::Op::OpLine:
+    case spv::Op::OpExecutionMode:
+    case spv::Op::OpTypeForwardPointer:
+    case spv::Op::OpLifetimeStart:
+    case spv::Op::OpLifetimeStop:
+    case spv::Op::OpSelectionMerge:
+        func(1);
+        return;
+    case spv::Op::OpDecorateId:
+    case spv::Op::OpExecutionModeId:
+        func(1);
+        Detail::ForEachIdInRange(3, size, func);
+        return;
+    case spv::Op::OpGroupMemberDecorate:
+        func(1);
+        for (size_t index = 2; index < size; index += 2) {
+            func(index);
+        }
+        return;
+    case spv::Op::OpEntryPoint:
+        func(2);
+        Detail::ForEachIdInRange(3 + StringWords(words, 3), size, func);
+        return;
+    case spv::Op::OpTypeVector:
+    case spv::Op::OpTypeMatrix:
+    case spv::Op::OpTypeImage:
+        func(2);
+        return;
+    case spv::Op::OpTypePointer:
+        func(3);
+        return;
+    case spv::Op::OpVariable:
+        if (size > 4) {
+            func(4);
+        }
+        return;
+    case spv::Op::OpFunction:
+        func(4);
+        return;
+    case spv::Op::OpExtInst:
+        func(3);
+        Detail::ForEachIdInRange(5, size, func);
+        return;
+    case spv::Op::OpLoad:
+        func(3);
+        Detail::ForEachMemoryOperandId(words, 4, func);
+        return;
+    case spv::Op::OpStore:
+    case spv::Op::OpCopyMemory:
+        func(1);
+        func(2);
+        Detail::ForEachMemoryOperandId(words, 3, func);
+        return;
+    case spv::Op::OpCopyMemorySized:
+        Detail::ForEachIdInRange(1, 4, func);
+        Detail::ForEachMemoryOperandId(words, 4, func);
+        return;
+    case spv::Op::OpCompositeExtract:
+        func(3);
+        return;
+    case spv::Op::OpCompositeInsert:
+    case spv::Op::OpVectorShuffle:
+        func(3);
+        func(4);
+        return;
+    case spv::Op::OpSpecConstantOp:
+        switch (static_cast<spv::Op>(words[3])) {
+        case spv::Op::OpCompositeExtract:
+            func(4);
+            return;
+        case spv::Op::OpCompositeInsert:
+        case spv::Op::OpVectorShuffle:
+            func(4);
+            func(5);
+            return;
+        default:
+            Detail::ForEachIdInRange(4, size, func);
+            return;
+        }
+    case spv::Op::OpImageSampleImplicitLod:
+    case spv::Op::OpImageSampleExplicitLod:
+    case spv::Op::OpImageSampleProjImplicitLod:
+    case spv::Op::OpImageSampleProjExplicitLod:
+    case spv::Op::OpImageFetch:
+    case spv::Op::OpImageRead:
+    case spv::Op::OpImageSparseSampleImplicitLod:
+    case spv::Op::OpImageSparseSampleExplicitLod:
+    case spv::Op::OpImageSparseSampleProjImplicitLod:
+    case spv::Op::OpImageSparseSampleProjExplicitLod:
+    case spv::Op::OpImageSparseFetch:
+    case spv::Op::OpImageSparseRead:
+        Detail::ForEachImageOperandId(words, 5, func);
+        return;
+    case spv::Op::OpImageSampleDrefImplicitLod:
+    case spv::Op::OpImageSampleDrefExplicitLod:
+    case spv::Op::OpImageSampleProjDrefImplicitLod:
+    case spv::Op::OpImageSampleProjDrefExplicitLod:
+    case spv::Op::OpImageGather:
+    case spv::Op::OpImageDrefGather:
+    case spv::Op::OpImageSparseSampleDrefImplicitLod:
+    case spv::Op::OpImageSparseSampleDrefExplicitLod:
+    case spv::Op::OpImageSparseSampleProjDrefImplicitLod:
+    case spv::Op::OpImageSparseSampleProjDrefExplicitLod:
+    case spv::Op::OpImageSparseGather:
+    case spv::Op::OpImageSparseDrefGather:
+        Detail::ForEachImageOperandId(words, 6, func);
+        return;
+    case spv::Op::OpImageWrite:
+        Detail::ForEachImageOperandId(words, 4, func);
+        return;
+    case spv::Op::OpLoopMerge:
+        func(1);
+        func(2);
+        return;
+    case spv::Op::OpBranchConditional:
+        Detail::ForEachIdInRange(1, 4, func);
+        return;
+    case spv::Op::OpSwitch:
+        func(1);
+        func(2);
+        for (size_t index = 3 + switch_literal_words; index < size;
+             index += switch_literal_words + 1) {
+            func(index);
+        }
+        return;
+    case spv::Op::OpGroupNonUniformBallotBitCount:
+    case spv::Op::OpGroupNonUniformIAdd:
+    case spv::Op::OpGroupNonUniformFAdd:
+    case spv::Op::OpGroupNonUniformIMul:
+    case spv::Op::OpGroupNonUniformFMul:
+    case spv::Op::OpGroupNonUniformSMin:
+    case spv::Op::OpGroupNonUniformUMin:
+    case spv::Op::OpGroupNonUniformFMin:
+    case spv::Op::OpGroupNonUniformSMax:
+    case spv::Op::OpGroupNonUniformUMax:
+    case spv::Op::OpGroupNonUniformFMax:
+    case spv::Op::OpGroupNonUniformBitwiseAnd:
+    case spv::Op::OpGroupNonUniformBitwiseOr:
+    case spv::Op::OpGroupNonUniformBitwiseXor:
+    case spv::Op::OpGroupNonUniformLogicalAnd:
+    case spv::Op::OpGroupNonUniformLogicalOr:
+    case spv::Op::OpGroupNonUniformLogicalXor:
+        func(3);
+        Detail::ForEachIdInRange(5, size, func);
+        return;
+    default:
+        Detail::ForEachIdInRange(first, size, func);
+        return;
+    }
+}
+
+/// Invokes func with the word index of every <id> in an instruction, including its result type
+/// and result id.
+template <typename Func>
+void ForEachId(std::span<const u32> words, Func&& func, size_t switch_literal_words = 1) {
+    const size_t first = FirstOperandIndex(Opcode(words[0]));
+    for (size_t index = 1; index < first; ++index) {
+        func(index);
+    }
+    ForEachIdOperand(words, func, switch_literal_words);
+}
+
+/// Decoded instruction owning its words.
+struct Inst {
+    std::vector<u32> words;
+
+    spv::Op Op() const noexcept {
+        return Opcode(words[0]);
+    }
+
+    /// Returns the result id of the instruction, or zero if it doesn't have one.
+    u32 Result() const noexcept {
+        const size_t index = ResultIndex(Op());
+        return index != 0 ? words[index] : 0;
+    }
+
+    /// Returns the result type of the instruction, or zero if it doesn't have one.
+    u32 Type() const noexcept {
+        return ResultIndex(Op()) == 2 ? words[1] : 0;
+    }
+
+    /// Updates the word count after the instruction words have been resized.
+    void UpdateWordCount() noexcept {
+        words[0] = MakeWord0(Op(), words.size());
+    }
+};
+
+/// Basic block of a function, its instructions include the merge and the terminator.
+struct Block {
+    u32 label{};
+    std::vector<Inst> insts;
+
+    const Inst& Terminator() const {
+        assert(!insts.empty());
+        return insts.back();
+    }
+
+    /// Returns the merge instruction of the block or null if it doesn't have one.
+    const Inst* Merge() const {
+        if (insts.size() < 2) {
+            return nullptr;
+        }
+        const Inst& inst = insts[insts.size() - 2];
+        const spv::Op op = inst.Op();
+        return op == spv::Op::OpSelectionMerge || op == spv::Op::OpLoopMerge ? &inst : nullptr;
+    }
+};
+
+/// Function in the code section of a module.
+struct Function {
+    Inst def;
+    std::vector<Inst> params;
+    std::vector<Block> blocks;
+    Inst end;
+
+    /// Returns the first instruction of the entry block that is not a variable declaration.
+    std::vector<Inst>::iterator FirstNonVariable() {
+        auto& insts = blocks.front().insts;
+        return std::ranges::find_if(
+            insts, [](const Inst& inst) { return inst.Op() != spv::Op::OpVariable; });
+    }
+};
+
+/// Parses the code section of a module into functions.
+std::vector<Function> ParseFunctions(std::span<const u32> code);
+
+/// Serializes a function into a sequence of words.
+void Serialize(const Function& function, std::vector<u32>& output);
+
+/// Serializes a list of functions into a sequence of words.
+std::vector<u32> Serialize(std::span<const Function> functions);
+
+/// Invokes func on each successor label of a terminator instruction.
+template <typename Func>
+void ForEachSuccessor(const Inst& terminator, Func&& func, size_t switch_literal_words = 1) {
+    const auto& words = terminator.words;
+    switch (terminator.Op()) {
+    case spv::Op::OpBranch:
+        func(words[1]);
+        break;
+    case spv::Op::OpBranchConditional:
+        func(words[2]);
+        func(words[3]);
+        break;
+    case spv::Op::OpSwitch:
+        func(words[2]);
+        for (size_t index = 3 + switch_literal_words; index < words.size();
+             index += switch_literal_words + 1) {
+            func(words[index]);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/// Maps each definition in a section to the offset of its first word.
+std::unordered_map<u32, size_t> IndexDefinitions(std::span<const u32> words);
+
+/// Lookup table over the declarations section of a module.
+class DeclarationTable {
+public:
+    explicit DeclarationTable(std::span<const u32> words_)
+        : words{words_}, offsets{IndexDefinitions(words_)} {}
+
+    /// Returns the words declaring id, or an empty span when it's not a declaration.
+    std::span<const u32> Find(u32 id) const {
+        const auto it = offsets.find(id);
+        if (it == offsets.end()) {
+            return {};
+        }
+        return words.subspan(it->second, WordCount(words[it->second]));
+    }
+
+    /// Returns the opcode declaring id, or OpNop when it's not a declaration.
+    spv::Op OpOf(u32 id) const {
+        const std::span<const u32> def = Find(id);
+        return def.empty() ? spv::Op::OpNop : Opcode(def[0]);
+    }
+
+    /// Returns the number of words used by a literal of the given scalar type.
+    size_t LiteralWords(u32 type) const {
+        const std::span<const u32> def = Find(type);
+        if (def.empty()) {
+            return 1;
+        }
+        const spv::Op op = Opcode(def[0]);
+        const bool is_scalar = op == spv::Op::OpTypeInt || op == spv::Op::OpTypeFloat;
+        return is_scalar && def[2] > 32 ? 2 : 1;
+    }
+
+private:
+    std::span<const u32> words;
+    std::unordered_map<u32, size_t> offsets;
+};
+
+/// Returns the number of words used by each case literal of an instruction, one unless it's an
+/// OpSwitch over a 64-bit selector.
+size_t SwitchLiteralWords(const Function& function, const Inst& inst,
+                          const DeclarationTable& table);
+
+/// Control flow graph of a function, indexed by block position.
+struct CFG {
+    CFG(const Function& function, const DeclarationTable& table);
+
+    /// Returns true when the block is reachable from the entry block.
+    bool Reachable(size_t block) const {
+        return rpo_index[block] != UNREACHABLE;
+    }
+
+    /// Returns true when block a dominates block b. Both blocks must be reachable.
+    bool Dominates(size_t a, size_t b) const;
+
+    static constexpr size_t UNREACHABLE = ~size_t{0};
+
+    std::unordered_map<u32, size_t> block_index;
+    std::vector<std::vector<size_t>> succs;
+    std::vector<std::vector<size_t>> preds;
+    /// Reachable blocks in reverse post-order.
+    std::vector<size_t> rpo;
+    /// Position of each block in rpo, or UNREACHABLE.
+    std::vector<size_t> rpo_index;
+    /// Immediate dominator of each reachable block, the entry block dominates itself.
+    std::vector<size_t> idom;
+};
+
+/// Invokes func with the words of each instruction in a section.
+template <typename Func>
+void ForEachInstruction(std::span<const u32> words, Func&& func) {
+    for (size_t offset = 0; offset < words.size();) {
+        const u32 word_count = WordCount(words[offset]);
+        assert(word_count != 0);
+        func(words.subspan(offset, word_count));
+        offset += word_count;
+    }
+}
+
+/// Removes debug and annotation instructions targeting any of the ids in the set.
+template <typename Set>
+std::vector<u32> RemoveTargets(std::span<const u32> words, const Set& ids) {
+    std::vector<u32> result;
+    result.reserve(words.size());
+    ForEachInstruction(words, [&](std::span<const u32> inst) {
+        switch (Opcode(inst[0])) {
+        case spv::Op::OpName:
+        case spv::Op::OpMemberName:
+        case spv::Op::OpDecorate:
+        case spv::Op::OpDecorateId:
+        case spv::Op::OpMemberDecorate:
+        case spv::Op::OpDecorateString:
+        case spv::Op::OpMemberDecorateString:
+            if (ids.contains(inst[1])) {
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+        result.insert(result.end(), inst.begin(), inst.end());
+    });
+    return result;
+}
+
+/// Replaces debug and annotation instructions targeting ids in the map with a copy for each of
+/// the mapped ids. Instructions targeting ids mapped to an empty list are removed.
+template <typename Map>
+std::vector<u32> DuplicateTargets(std::span<const u32> words, const Map& clones) {
+    std::vector<u32> result;
+    result.reserve(words.size());
+    ForEachInstruction(words, [&](std::span<const u32> inst) {
+        switch (Opcode(inst[0])) {
+        case spv::Op::OpName:
+        case spv::Op::OpMemberName:
+        case spv::Op::OpDecorate:
+        case spv::Op::OpDecorateId:
+        case spv::Op::OpMemberDecorate:
+        case spv::Op::OpDecorateString:
+        case spv::Op::OpMemberDecorateString: {
+            const auto it = clones.find(inst[1]);
+            if (it == clones.end()) {
+                break;
+            }
+            for (const u32 clone : it->second) {
+                const size_t offset = result.size();
+                result.insert(result.end(), inst.begin(), inst.end());
+                result[offset + 1] = clone;
+            }
+            return;
+        }
+        default:
+            break;
+        }
+        result.insert(result.end(), inst.begin(), inst.end());
+    });
+    return result;
+}
+
+} // namespace Sirit::IR
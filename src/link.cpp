@@ -0,0 +1,290 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "common_types.h"
+#include "ir.h"
+#include "stream.h"
+
+namespace Sirit {
+
+namespace {
+
+bool IsAnnotation(spv::Op op) {
+    switch (op) {
+    case spv::Op::OpDecorate:
+    case spv::Op::OpMemberDecorate:
+    case spv::Op::OpDecorateString:
+    case spv::Op::OpMemberDecorateString:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// Module level view of a library binary.
+class Library {
+public:
+    explicit Library(std::span<const u32> words_) : words{words_}, table{words_} {
+        IR::ForEachInstruction(words, [&](std::span<const u32> inst) {
+            const spv::Op op = IR::Opcode(inst[0]);
+            const size_t offset = static_cast<size_t>(inst.data() - words.data());
+            if (op == spv::Op::OpFunction) {
+                current_function = inst[2];
+                functions.emplace(current_function, std::make_pair(offset, offset));
+            }
+            if (current_function != 0) {
+                if (const u32 type = ResultType(inst); type != 0) {
+                    types.emplace(inst[IR::ResultIndex(op)], type);
+                }
+                if (op == spv::Op::OpFunctionEnd) {
+                    functions.at(current_function).second = offset + inst.size();
+                    current_function = 0;
+                }
+                return;
+            }
+            module_insts.push_back(inst);
+            if (op == spv::Op::OpName) {
+                names.emplace(IR::LiteralString(inst, 2), inst[1]);
+            }
+            if (op == spv::Op::OpDecorate && inst.size() > 3 &&
+                static_cast<spv::Decoration>(inst[2]) == spv::Decoration::LinkageAttributes &&
+                static_cast<spv::LinkageType>(inst.back()) == spv::LinkageType::Export) {
+                exports.emplace(IR::LiteralString(inst, 3), inst[1]);
+            }
+        });
+    }
+
+    /// Returns the id of a function by its export name or its debug name, zero if not found.
+    u32 FindFunction(std::string_view name) const {
+        const std::string key{name};
+        for (const auto* const map : {&exports, &names}) {
+            const auto it = map->find(key);
+            if (it != map->end() && functions.contains(it->second)) {
+                return it->second;
+            }
+        }
+        return 0;
+    }
+
+    /// Collects the module level ids and functions reachable from the given functions.
+    std::unordered_set<u32> Closure(std::span<const u32> roots) const {
+        std::unordered_set<u32> needed;
+        std::vector<u32> pending(roots.begin(), roots.end());
+        const auto visit = [&](std::span<const u32> inst) {
+            IR::ForEachId(
+                inst,
+                [&](size_t index) {
+                    if (!needed.contains(inst[index])) {
+                        pending.push_back(inst[index]);
+                    }
+                },
+                SwitchLiteralWords(inst));
+        };
+        while (!pending.empty()) {
+            const u32 id = pending.back();
+            pending.pop_back();
+            if (!needed.insert(id).second) {
+                continue;
+            }
+            if (const auto it = functions.find(id); it != functions.end()) {
+                IR::ForEachInstruction(Function(id), visit);
+            } else if (const std::span<const u32> def = table.Find(id); !def.empty()) {
+                visit(def);
+            }
+        }
+        return needed;
+    }
+
+    std::span<const u32> Function(u32 id) const {
+        const auto [begin, end] = functions.at(id);
+        return words.subspan(begin, end - begin);
+    }
+
+    bool IsFunction(u32 id) const {
+        return functions.contains(id);
+    }
+
+    size_t SwitchLiteralWords(std::span<const u32> inst) const {
+        if (IR::Opcode(inst[0]) != spv::Op::OpSwitch) {
+            return 1;
+        }
+        if (const auto it = types.find(inst[1]); it != types.end()) {
+            return table.LiteralWords(it->second);
+        }
+        const std::span<const u32> def = table.Find(inst[1]);
+        return def.size() > 1 ? table.LiteralWords(def[1]) : 1;
+    }
+
+    std::span<const u32> words;
+    IR::DeclarationTable table;
+    /// Instructions outside of functions in binary order.
+    std::vector<std::span<const u32>> module_insts;
+
+private:
+    static u32 ResultType(std::span<const u32> inst) {
+        return IR::ResultIndex(IR::Opcode(inst[0])) == 2 ? inst[1] : 0;
+    }
+
+    std::unordered_map<u32, std::pair<size_t, size_t>> functions;
+    std::unordered_map<u32, u32> types;
+    std::unordered_map<std::string, u32> names;
+    std::unordered_map<std::string, u32> exports;
+    u32 current_function = 0;
+};
+
+} // Anonymous namespace
+
+std::vector<Id> Module::Link(std::span<const std::uint32_t> library_binary,
+                             std::span<const std::string_view> imports) {
+    // Library functions are appended to the code section
+    assert(current_function == 0);
+    std::vector<Id> result(imports.size());
+    if (library_binary.size() < 5 || library_binary[0] != spv::MagicNumber) {
+        return result;
+    }
+    const Library library{library_binary.subspan(5)};
+    std::vector<u32> roots;
+    for (const std::string_view name : imports) {
+        if (const u32 function = library.FindFunction(name); function != 0) {
+            roots.push_back(function);
+        }
+    }
+    const std::unordered_set<u32> needed = library.Closure(roots);
+
+    // Ids are rebased through a table, merged declarations map to the existing ids
+    std::vector<u32> remap(library_binary[3], 0);
+    std::unordered_set<u32> merged;
+    const auto rebase = [&](u32 id) {
+        u32& value = remap.at(id);
+        if (value == 0) {
+            value = ++bound;
+        }
+        return value;
+    };
+    const auto rebase_inst = [&](std::span<const u32> inst, bool with_result) {
+        std::vector<u32> copy(inst.begin(), inst.end());
+        const auto func = [&](size_t index) { copy[index] = rebase(copy[index]); };
+        if (with_result) {
+            IR::ForEachId(inst, func, library.SwitchLiteralWords(inst));
+        } else {
+            IR::ForEachIdOperand(inst, func, library.SwitchLiteralWords(inst));
+        }
+        return copy;
+    };
+
+    for (const std::span<const u32> inst : library.module_insts) {
+        const spv::Op op = IR::Opcode(inst[0]);
+        switch (op) {
+        case spv::Op::OpCapability:
+            // Linkage is only needed by the library exports, which are not copied
+            if (static_cast<spv::Capability>(inst[1]) != spv::Capability::Linkage) {
+                AddCapability(static_cast<spv::Capability>(inst[1]));
+            }
+            continue;
+        case spv::Op::OpExtension:
+            AddExtension(IR::LiteralString(inst, 1));
+            continue;
+        case spv::Op::OpExtInstImport:
+            if (!needed.contains(inst[1])) {
+                continue;
+            }
+            if (IR::LiteralString(inst, 2) == "GLSL.std.450") {
+                remap.at(inst[1]) = GetGLSLstd450().value;
+                merged.insert(inst[1]);
+            } else {
+                ext_inst_imports->Append(rebase_inst(inst, true));
+            }
+            continue;
+        case spv::Op::OpString:
+            if (needed.contains(inst[1])) {
+                debug->Append(rebase_inst(inst, true));
+            }
+            continue;
+        case spv::Op::OpVariable:
+            if (needed.contains(inst[2])) {
+                global_variables->Append(rebase_inst(inst, true));
+            }
+            continue;
+        default:
+            break;
+        }
+        if (!IR::IsDeclaration(op) || !needed.contains(inst[IR::ResultIndex(op)])) {
+            continue;
+        }
+        const size_t result_index = IR::ResultIndex(op);
+        std::vector<u32> operands = rebase_inst(inst, false);
+        if (result_index == 2) {
+            operands[1] = rebase(inst[1]);
+        }
+        const u32 previous_bound = bound;
+        declarations->Reserve(inst.size());
+        if (result_index == 2) {
+            *declarations << OpId{op, Id{operands[1]}};
+        } else {
+            *declarations << OpId{op};
+        }
+        *declarations << std::span<const u32>(operands).subspan(result_index + 1);
+        const Id id = *declarations << EndOp{};
+        remap.at(inst[result_index]) = id.value;
+        if (id.value <= previous_bound) {
+            merged.insert(inst[result_index]);
+        }
+    }
+
+    std::vector<u32> functions{needed.begin(), needed.end()};
+    std::erase_if(functions, [&](u32 id) { return !library.IsFunction(id); });
+    std::ranges::sort(functions, {}, [&](u32 id) { return library.Function(id).data(); });
+    for (const u32 function : functions) {
+        IR::ForEachInstruction(library.Function(function), [&](std::span<const u32> inst) {
+            code->Append(rebase_inst(inst, true));
+        });
+    }
+
+    // Names and decorations are copied after every target has been rebased
+    std::unordered_set<std::vector<u32>, IR::HashWords> existing_annotations;
+    IR::ForEachInstruction(annotations->Words(), [&](std::span<const u32> inst) {
+        existing_annotations.emplace(inst.begin(), inst.end());
+    });
+    for (const std::span<const u32> inst : library.module_insts) {
+        const spv::Op op = IR::Opcode(inst[0]);
+        if (!needed.contains(inst[1])) {
+            continue;
+        }
+        if (op == spv::Op::OpName || op == spv::Op::OpMemberName) {
+            if (!merged.contains(inst[1])) {
+                debug->Append(rebase_inst(inst, false));
+            }
+            continue;
+        }
+        if (!IsAnnotation(op) ||
+            (op == spv::Op::OpDecorate &&
+             static_cast<spv::Decoration>(inst[2]) == spv::Decoration::LinkageAttributes)) {
+            continue;
+        }
+        std::vector<u32> copy = rebase_inst(inst, false);
+        if (existing_annotations.insert(copy).second) {
+            annotations->Append(copy);
+        }
+    }
+
+    for (size_t index = 0; index < imports.size(); ++index) {
+        if (const u32 function = library.FindFunction(imports[index]); function != 0) {
+            result[index] = Id{remap.at(function)};
+        }
+    }
+    return result;
+}
+
+} // namespace Sirit
@@ -0,0 +1,262 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "function_table.h"
+#include "ir.h"
+#include "stream.h"
+#include "tracing.h"
+
+namespace Sirit {
+
+namespace {
+
+using Words = std::vector<u32>;
+
+std::vector<Words> SplitInstructions(std::span<const u32> words) {
+    std::vector<Words> insts;
+    IR::ForEachInstruction(words, [&](std::span<const u32> inst) {
+        insts.emplace_back(inst.begin(), inst.end());
+    });
+    return insts;
+}
+
+Words Join(std::span<const Words> insts) {
+    Words words;
+    for (const Words& inst : insts) {
+        words.insert(words.end(), inst.begin(), inst.end());
+    }
+    return words;
+}
+
+/// Invokes func with the index of each id a declaration depends on, including its result type.
+template <typename Func>
+void ForEachDependency(std::span<const u32> inst, Func&& func) {
+    if (IR::ResultIndex(IR::Opcode(inst[0])) == 2) {
+        func(1);
+    }
+    IR::ForEachIdOperand(inst, func);
+}
+
+/**
+ * Sorts declarations in a topological order independent of their ids and emission order.
+ * Declarations are grouped by their depth in the dependency graph, and each group is sorted by
+ * its words with the result id cleared and the result type and operand ids replaced by the
+ * canonical position of their declaration. Structurally identical declarations keep their relative order.
+ * @return The sorted declarations, or nullopt when they can't be ordered, such as when forward
+ * pointers are present.
+ */
+std::optional<std::vector<Words>> SortDeclarations(std::vector<Words> decls) {
+    std::unordered_map<u32, size_t> index_of;
+    std::vector<u32> depth(decls.size());
+    u32 max_depth = 0;
+    for (size_t index = 0; index < decls.size(); ++index) {
+        const Words& inst = decls[index];
+        const spv::Op op = IR::Opcode(inst[0]);
+        if (!IR::IsDeclaration(op)) {
+            return std::nullopt;
+        }
+        bool forward_reference = false;
+        ForEachDependency(inst, [&](size_t operand) {
+            const auto it = index_of.find(inst[operand]);
+            if (it == index_of.end()) {
+                forward_reference = true;
+                return;
+            }
+            depth[index] = std::max(depth[index], depth[it->second] + 1);
+        });
+        if (forward_reference) {
+            return std::nullopt;
+        }
+        max_depth = std::max(max_depth, depth[index]);
+        index_of.emplace(inst[IR::ResultIndex(op)], index);
+    }
+
+    std::vector<Words> sorted;
+    sorted.reserve(decls.size());
+    std::unordered_map<u32, u32> rank;
+    for (u32 level = 0; level <= max_depth; ++level) {
+        std::vector<std::pair<Words, size_t>> group;
+        for (size_t index = 0; index < decls.size(); ++index) {
+            if (depth[index] != level) {
+                continue;
+            }
+            Words key = decls[index];
+            key[IR::ResultIndex(IR::Opcode(key[0]))] = 0;
+            ForEachDependency(decls[index],
+                              [&](size_t operand) { key[operand] = rank.at(key[operand]); });
+            group.emplace_back(std::move(key), index);
+        }
+        std::ranges::stable_sort(group, {}, &std::pair<Words, size_t>::first);
+        for (const auto& [key, index] : group) {
+            Words& inst = decls[index];
+            rank.emplace(inst[IR::ResultIndex(IR::Opcode(inst[0]))],
+                         static_cast<u32>(sorted.size()));
+            sorted.push_back(std::move(inst));
+        }
+    }
+    return sorted;
+}
+
+/// Assigns new ids in the order they are first found.
+class Renumberer {
+public:
+    explicit Renumberer(const IR::DeclarationTable& table_) : table{table_} {}
+
+    /// Renumbers the ids of the instructions of a section in place.
+    void Run(std::vector<Words>& insts) {
+        for (Words& inst : insts) {
+            const spv::Op op = IR::Opcode(inst[0]);
+            if (const u32 type = IR::ResultIndex(op) == 2 ? inst[1] : 0; type != 0) {
+                types.emplace(inst[2], type);
+            }
+            const size_t literal_words = SwitchLiteralWords(inst);
+            IR::ForEachId(
+                inst, [&](size_t index) { inst[index] = Renumber(inst[index]); },
+                literal_words);
+        }
+    }
+
+    u32 Renumber(u32 id) {
+        const auto [it, inserted] = ids.emplace(id, next_id);
+        if (inserted) {
+            ++next_id;
+        }
+        return it->second;
+    }
+
+    /// Returns the new id of an existing id, or zero if it was never found.
+    u32 Find(u32 id) const {
+        const auto it = ids.find(id);
+        return it != ids.end() ? it->second : 0;
+    }
+
+    u32 Bound() const noexcept {
+        return next_id - 1;
+    }
+
+private:
+    size_t SwitchLiteralWords(const Words& inst) const {
+        if (IR::Opcode(inst[0]) != spv::Op::OpSwitch) {
+            return 1;
+        }
+        if (const std::span<const u32> def = table.Find(inst[1]); !def.empty()) {
+            return table.LiteralWords(def[1]);
+        }
+        const auto it = types.find(inst[1]);
+        return it != types.end() ? table.LiteralWords(it->second) : 1;
+    }
+
+    const IR::DeclarationTable& table;
+    /// Result types of the instructions outside of declarations, by their original id.
+    std::unordered_map<u32, u32> types;
+    std::unordered_map<u32, u32> ids;
+    u32 next_id = 1;
+};
+
+/// Sorts names by their target, keeping other debug instructions in their layout position.
+void SortNames(std::vector<Words>& insts) {
+    const auto is_name = [](const Words& inst) {
+        const spv::Op op = IR::Opcode(inst[0]);
+        return op == spv::Op::OpName || op == spv::Op::OpMemberName;
+    };
+    const auto begin = std::ranges::find_if(insts, is_name);
+    const auto end = std::find_if_not(begin, insts.end(), is_name);
+    std::stable_sort(begin, end, [](const Words& lhs, const Words& rhs) {
+        if (lhs[1] != rhs[1]) {
+            return lhs[1] < rhs[1];
+        }
+        // Names of a type come before the names of its members
+        if (IR::Opcode(lhs[0]) != IR::Opcode(rhs[0])) {
+            return IR::Opcode(lhs[0]) < IR::Opcode(rhs[0]);
+        }
+        return lhs < rhs;
+    });
+}
+
+/// Sorts decorations by their target, unless decoration groups impose an order.
+void SortDecorations(std::vector<Words>& insts) {
+    const bool has_groups = std::ranges::any_of(insts, [](const Words& inst) {
+        return IR::Opcode(inst[0]) == spv::Op::OpDecorationGroup;
+    });
+    if (has_groups) {
+        return;
+    }
+    std::ranges::sort(insts, [](const Words& lhs, const Words& rhs) {
+        return std::tie(lhs[1], lhs) < std::tie(rhs[1], rhs);
+    });
+    const auto [first, last] = std::ranges::unique(insts);
+    insts.erase(first, last);
+}
+
+} // Anonymous namespace
+
+void Module::Canonicalize() {
+    SIRIT_TRACE_SCOPE("Module::Canonicalize");
+    // Ids in streamed code can't be renumbered
+    assert(code->FlushedWords() == 0);
+    const IR::DeclarationTable table{declarations->Words()};
+    std::vector<Words> decls = SplitInstructions(declarations->Words());
+    if (std::optional<std::vector<Words>> sorted = SortDeclarations(decls)) {
+        decls = std::move(*sorted);
+    }
+
+    std::vector<Words> sections[] = {
+        SplitInstructions(ext_inst_imports->Words()),
+        SplitInstructions(entry_points->Words()),
+        SplitInstructions(execution_modes->Words()),
+        std::move(decls),
+        SplitInstructions(global_variables->Words()),
+        SplitInstructions(code->Words()),
+        SplitInstructions(debug->Words()),
+        SplitInstructions(annotations->Words()),
+    };
+    // Debug and annotation instructions only refer to ids, they are numbered last
+    Renumberer renumberer{table};
+    for (std::vector<Words>& section : sections) {
+        renumberer.Run(section);
+    }
+    auto& [new_ext_inst_imports, new_entry_points, new_execution_modes, new_decls,
+           new_global_variables, new_code, new_debug, new_annotations] = sections;
+    SortNames(new_debug);
+    SortDecorations(new_annotations);
+
+    bound = renumberer.Bound();
+    ext_inst_imports->Assign(Join(new_ext_inst_imports));
+    entry_points->Assign(Join(new_entry_points));
+    execution_modes->Assign(Join(new_execution_modes));
+    debug->Assign(Join(new_debug));
+    annotations->Assign(Join(new_annotations));
+    global_variables->Assign(Join(new_global_variables));
+    code->Assign(Join(new_code));
+
+    declarations->Clear();
+    for (const Words& inst : new_decls) {
+        declarations->Restore(inst, IR::ResultIndex(IR::Opcode(inst[0])));
+    }
+
+    if (glsl_std_450) {
+        glsl_std_450 = Id{renumberer.Find(glsl_std_450->value)};
+    }
+    for (auto& [target, decoration] : patch_points) {
+        target = renumberer.Find(target);
+    }
+    // Deduplicated functions were recorded with the previous ids
+    if (function_table) {
+        function_table = std::make_unique<FunctionTable>();
+    }
+    current_function = 0;
+}
+
+} // namespace Sirit
@@ -0,0 +1,429 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "ir.h"
+#include "stream.h"
+#include "tracing.h"
+
+namespace Sirit {
+
+namespace {
+
+/// Shuffle literal selecting an undefined component.
+constexpr u32 UNDEFINED_COMPONENT = 0xFFFFFFFF;
+
+/// Component index used for scalars that don't come from a vector.
+constexpr u32 SCALAR = 0xFFFFFFFF;
+
+/// Origin of a vector component, either a component of a vector, a scalar or undefined.
+struct Component {
+    u32 id;
+    u32 index;
+
+    bool IsUndefined() const noexcept {
+        return id == 0;
+    }
+
+    bool IsScalar() const noexcept {
+        return id != 0 && index == SCALAR;
+    }
+
+    bool operator==(const Component&) const = default;
+};
+
+bool IsCompositeOp(spv::Op op) {
+    switch (op) {
+    case spv::Op::OpCompositeExtract:
+    case spv::Op::OpCompositeInsert:
+    case spv::Op::OpCompositeConstruct:
+    case spv::Op::OpVectorShuffle:
+        return true;
+    default:
+        return false;
+    }
+}
+
+class Combiner {
+public:
+    explicit Combiner(IR::Function& function_, const IR::DeclarationTable& table_,
+                      std::unordered_set<u32>& removed_ids_)
+        : function{function_}, table{table_}, removed_ids{removed_ids_} {}
+
+    bool Run() {
+        for (const IR::Inst& param : function.params) {
+            types.emplace(param.Result(), param.Type());
+        }
+        for (const IR::Block& block : function.blocks) {
+            for (const IR::Inst& inst : block.insts) {
+                if (const u32 type = inst.Type(); type != 0) {
+                    types.emplace(inst.Result(), type);
+                }
+            }
+        }
+        bool changed = false;
+        for (IR::Block& block : function.blocks) {
+            for (IR::Inst& inst : block.insts) {
+                if (inst.Op() != spv::Op::OpPhi) {
+                    Resolve(inst);
+                }
+                if (!IsCompositeOp(inst.Op())) {
+                    continue;
+                }
+                defs.insert_or_assign(inst.Result(), &inst);
+                changed |= Combine(inst);
+            }
+        }
+        if (!replacements.empty()) {
+            for (IR::Block& block : function.blocks) {
+                for (IR::Inst& inst : block.insts) {
+                    Resolve(inst);
+                }
+            }
+        }
+        return RemoveDeadInstructions() || changed;
+    }
+
+private:
+    bool Combine(IR::Inst& inst) {
+        switch (inst.Op()) {
+        case spv::Op::OpCompositeExtract:
+            return CombineExtract(inst);
+        case spv::Op::OpCompositeInsert:
+            return CombineInsert(inst);
+        default:
+            return CombineVector(inst);
+        }
+    }
+
+    /// Forwards extracts through inserts, constructs and shuffles producing the extracted value.
+    bool CombineExtract(IR::Inst& inst) {
+        u32 composite = inst.words[3];
+        std::vector<u32> path(inst.words.begin() + 4, inst.words.end());
+        while (!path.empty()) {
+            const IR::Inst* const def = Definition(composite);
+            if (!def) {
+                break;
+            }
+            if (def->Op() == spv::Op::OpCompositeInsert) {
+                const std::span<const u32> inserted = std::span(def->words).subspan(5);
+                const size_t common = std::min(inserted.size(), path.size());
+                if (!std::ranges::equal(inserted.first(common), std::span(path).first(common))) {
+                    composite = def->words[4];
+                    continue;
+                }
+                if (inserted.size() > path.size()) {
+                    break;
+                }
+                composite = def->words[3];
+                path.erase(path.begin(), path.begin() + static_cast<std::ptrdiff_t>(common));
+                continue;
+            }
+            if (VectorSize(TypeOf(composite)) == 0) {
+                if (def->Op() != spv::Op::OpCompositeConstruct ||
+                    path.front() + 3 >= def->words.size()) {
+                    break;
+                }
+                composite = def->words[path.front() + 3];
+                path.erase(path.begin());
+                continue;
+            }
+            const std::optional<std::vector<Component>> components = Describe(composite);
+            if (!components || path.size() != 1 || path.front() >= components->size()) {
+                break;
+            }
+            const Component component = (*components)[path.front()];
+            if (component.IsUndefined()) {
+                break;
+            }
+            if (component.IsScalar()) {
+                composite = component.id;
+                path.clear();
+                break;
+            }
+            composite = component.id;
+            path.front() = component.index;
+        }
+        if (path.empty()) {
+            Replace(inst.Result(), composite);
+            return true;
+        }
+        const std::span<const u32> old_path = std::span(inst.words).subspan(4);
+        if (composite == inst.words[3] && std::ranges::equal(path, old_path)) {
+            return false;
+        }
+        inst.words.resize(3);
+        inst.words.push_back(composite);
+        inst.words.insert(inst.words.end(), path.begin(), path.end());
+        inst.UpdateWordCount();
+        return true;
+    }
+
+    /// Skips inserts overwritten by this one and turns vector inserts into shuffles.
+    bool CombineInsert(IR::Inst& inst) {
+        bool changed = false;
+        const std::span<const u32> path = std::span(inst.words).subspan(5);
+        for (const IR::Inst* def = Definition(inst.words[4]);
+             def && def->Op() == spv::Op::OpCompositeInsert &&
+             std::ranges::equal(std::span(def->words).subspan(5), path);
+             def = Definition(inst.words[4])) {
+            inst.words[4] = def->words[4];
+            changed = true;
+        }
+        return CombineVector(inst) || changed;
+    }
+
+    /// Rewrites a vector value as a reuse of its source or as a single shuffle of two vectors.
+    bool CombineVector(IR::Inst& inst) {
+        const u32 result_type = inst.words[1];
+        const size_t size = VectorSize(result_type);
+        if (size == 0) {
+            return false;
+        }
+        const std::optional<std::vector<Component>> components = Describe(inst.Result());
+        if (!components) {
+            return false;
+        }
+        std::vector<u32> sources;
+        for (const Component& component : *components) {
+            if (component.IsScalar()) {
+                return false;
+            }
+            const bool is_known = std::ranges::find(sources, component.id) != sources.end();
+            if (!component.IsUndefined() && !is_known) {
+                sources.push_back(component.id);
+            }
+        }
+        if (sources.empty() || sources.size() > 2) {
+            return false;
+        }
+        if (sources.size() == 1 && TypeOf(sources.front()) == result_type) {
+            bool is_identity = true;
+            for (size_t index = 0; index < size; ++index) {
+                const Component& component = (*components)[index];
+                is_identity &= component.id == sources.front() && component.index == index;
+            }
+            if (is_identity) {
+                Replace(inst.Result(), sources.front());
+                return true;
+            }
+        }
+        const u32 first_size = static_cast<u32>(VectorSize(TypeOf(sources.front())));
+        std::vector<u32> words{IR::MakeWord0(spv::Op::OpVectorShuffle, 5 + size), result_type,
+                               inst.Result(), sources.front(), sources.back()};
+        for (const Component& component : *components) {
+            if (component.IsUndefined()) {
+                words.push_back(UNDEFINED_COMPONENT);
+            } else if (component.id == sources.front()) {
+                words.push_back(component.index);
+            } else {
+                words.push_back(first_size + component.index);
+            }
+        }
+        if (words == inst.words) {
+            return false;
+        }
+        inst.words = std::move(words);
+        return true;
+    }
+
+    /// Returns the origin of each component of a vector value, looking through constructs,
+    /// shuffles and inserts. Returns nothing for values that are not built from components.
+    std::optional<std::vector<Component>> Describe(u32 id) {
+        if (const auto it = descriptions.find(id); it != descriptions.end()) {
+            return it->second;
+        }
+        const IR::Inst* const def = Definition(id);
+        if (!def || VectorSize(def->words[1]) == 0) {
+            return std::nullopt;
+        }
+        std::vector<Component> components;
+        switch (def->Op()) {
+        case spv::Op::OpCompositeConstruct:
+            for (size_t index = 3; index < def->words.size(); ++index) {
+                const u32 constituent = def->words[index];
+                if (VectorSize(TypeOf(constituent)) != 0) {
+                    const std::vector<Component> parts = Components(constituent);
+                    components.insert(components.end(), parts.begin(), parts.end());
+                } else {
+                    components.push_back(ScalarComponent(constituent));
+                }
+            }
+            break;
+        case spv::Op::OpVectorShuffle: {
+            std::vector<Component> inputs = Components(def->words[3]);
+            const std::vector<Component> second = Components(def->words[4]);
+            inputs.insert(inputs.end(), second.begin(), second.end());
+            for (size_t index = 5; index < def->words.size(); ++index) {
+                const u32 literal = def->words[index];
+                components.push_back(literal < inputs.size() ? inputs[literal] : Component{0, 0});
+            }
+            break;
+        }
+        case spv::Op::OpCompositeInsert:
+            if (def->words.size() != 6) {
+                return std::nullopt;
+            }
+            components = Components(def->words[4]);
+            if (def->words[5] >= components.size()) {
+                return std::nullopt;
+            }
+            components[def->words[5]] = ScalarComponent(def->words[3]);
+            break;
+        default:
+            return std::nullopt;
+        }
+        if (components.size() != VectorSize(def->words[1])) {
+            return std::nullopt;
+        }
+        descriptions.emplace(id, components);
+        return components;
+    }
+
+    /// Returns the components of a vector, described or as components of the vector itself.
+    std::vector<Component> Components(u32 vector) {
+        if (std::optional<std::vector<Component>> components = Describe(vector)) {
+            return std::move(*components);
+        }
+        std::vector<Component> components(VectorSize(TypeOf(vector)));
+        for (size_t index = 0; index < components.size(); ++index) {
+            components[index] = Component{vector, static_cast<u32>(index)};
+        }
+        return components;
+    }
+
+    /// Returns the origin of a scalar, looking through extracts from vectors.
+    Component ScalarComponent(u32 scalar) {
+        const IR::Inst* const def = Definition(scalar);
+        if (!def || def->Op() != spv::Op::OpCompositeExtract || def->words.size() != 5) {
+            return Component{scalar, SCALAR};
+        }
+        const u32 vector = def->words[3];
+        const std::vector<Component> components = Components(vector);
+        if (def->words[4] >= components.size()) {
+            return Component{scalar, SCALAR};
+        }
+        return components[def->words[4]];
+    }
+
+    const IR::Inst* Definition(u32 id) const {
+        const auto it = defs.find(id);
+        return it != defs.end() ? it->second : nullptr;
+    }
+
+    u32 TypeOf(u32 id) const {
+        if (const auto it = types.find(id); it != types.end()) {
+            return it->second;
+        }
+        const std::span<const u32> def = table.Find(id);
+        if (def.empty() || IR::ResultIndex(IR::Opcode(def[0])) != 2) {
+            return 0;
+        }
+        return def[1];
+    }
+
+    /// Returns the number of components of a vector type, or zero if it's not a vector type.
+    size_t VectorSize(u32 type) const {
+        const std::span<const u32> def = table.Find(type);
+        if (def.empty() || IR::Opcode(def[0]) != spv::Op::OpTypeVector) {
+            return 0;
+        }
+        return def[3];
+    }
+
+    void Replace(u32 id, u32 value) {
+        replacements.emplace(id, value);
+        removed_ids.insert(id);
+        defs.erase(id);
+    }
+
+    void Resolve(IR::Inst& inst) {
+        if (replacements.empty()) {
+            return;
+        }
+        const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+        IR::ForEachIdOperand(
+            inst.words,
+            [&](size_t index) {
+                u32& id = inst.words[index];
+                for (auto it = replacements.find(id); it != replacements.end();
+                     it = replacements.find(id)) {
+                    id = it->second;
+                }
+            },
+            literal_words);
+    }
+
+    /// Removes composite instructions without uses, including the ones replaced by this pass.
+    bool RemoveDeadInstructions() {
+        bool changed = false;
+        while (true) {
+            std::unordered_set<u32> used;
+            for (const IR::Block& block : function.blocks) {
+                for (const IR::Inst& inst : block.insts) {
+                    const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                    IR::ForEachIdOperand(
+                        inst.words, [&](size_t index) { used.insert(inst.words[index]); },
+                        literal_words);
+                }
+            }
+            bool removed = false;
+            for (IR::Block& block : function.blocks) {
+                std::erase_if(block.insts, [&](const IR::Inst& inst) {
+                    if (!IsCompositeOp(inst.Op()) || used.contains(inst.Result())) {
+                        return false;
+                    }
+                    removed_ids.insert(inst.Result());
+                    removed = true;
+                    return true;
+                });
+            }
+            if (!removed) {
+                return changed;
+            }
+            changed = true;
+        }
+    }
+
+    IR::Function& function;
+    const IR::DeclarationTable& table;
+    std::unordered_set<u32>& removed_ids;
+    std::unordered_map<u32, u32> types;
+    std::unordered_map<u32, const IR::Inst*> defs;
+    std::unordered_map<u32, std::vector<Component>> descriptions;
+    std::unordered_map<u32, u32> replacements;
+};
+
+} // Anonymous namespace
+
+void Module::CombineCompositeOperations() {
+    SIRIT_TRACE_SCOPE("Module::CombineCompositeOperations");
+    std::vector<IR::Function> functions = IR::ParseFunctions(code->Words());
+    const IR::DeclarationTable table{declarations->Words()};
+    std::unordered_set<u32> removed_ids;
+    bool changed = false;
+    for (IR::Function& function : functions) {
+        if (!function.blocks.empty()) {
+            changed |= Combiner{function, table, removed_ids}.Run();
+        }
+    }
+    if (!changed) {
+        return;
+    }
+    code->Assign(IR::Serialize(functions));
+    debug->Assign(IR::RemoveTargets(debug->Words(), removed_ids));
+    annotations->Assign(IR::RemoveTargets(annotations->Words(), removed_ids));
+    deferred_phi_nodes.clear();
+}
+
+} // namespace Sirit
@@ -0,0 +1,375 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "ir.h"
+#include "stream.h"
+#include "tracing.h"
+
+namespace Sirit {
+
+namespace {
+
+class BranchFolder {
+public:
+    explicit BranchFolder(IR::Function& function_, const IR::DeclarationTable& table_,
+                          u32& bound_, std::unordered_set<u32>& removed_ids_)
+        : function{function_}, table{table_}, bound{bound_}, removed_ids{removed_ids_} {}
+
+    bool Run() {
+        bool changed = false;
+        while (true) {
+            const bool folded = FoldTerminators();
+            const bool pruned = PruneBlocks();
+            const bool simplified = SimplifyPhis();
+            if (!folded && !pruned && !simplified) {
+                break;
+            }
+            changed = true;
+        }
+        if (!undefs.empty()) {
+            std::vector<IR::Inst> new_undefs;
+            for (const auto& [type, id] : undefs) {
+                new_undefs.push_back(IR::Inst{{IR::MakeWord0(spv::Op::OpUndef, 3), type, id}});
+            }
+            auto& insts = function.blocks.front().insts;
+            insts.insert(function.FirstNonVariable(), std::make_move_iterator(new_undefs.begin()),
+                         std::make_move_iterator(new_undefs.end()));
+        }
+        return changed;
+    }
+
+private:
+    /// Returns the label taken by a terminator when it can be resolved at compile time.
+    std::optional<u32> ConstantTarget(const IR::Inst& terminator) const {
+        const auto& words = terminator.words;
+        switch (terminator.Op()) {
+        case spv::Op::OpBranchConditional:
+            if (words[2] == words[3]) {
+                return words[2];
+            }
+            switch (table.OpOf(words[1])) {
+            case spv::Op::OpConstantTrue:
+                return words[2];
+            case spv::Op::OpConstantFalse:
+                return words[3];
+            default:
+                return std::nullopt;
+            }
+        case spv::Op::OpSwitch: {
+            const std::span<const u32> selector = table.Find(words[1]);
+            if (selector.empty() || IR::Opcode(selector[0]) != spv::Op::OpConstant) {
+                return std::nullopt;
+            }
+            const std::span<const u32> value = selector.subspan(3);
+            const size_t literal_words = value.size();
+            for (size_t index = 3; index + literal_words < words.size();
+                 index += literal_words + 1) {
+                const auto literal = std::span(words).subspan(index, literal_words);
+                if (std::ranges::equal(literal, value)) {
+                    return words[index + literal_words];
+                }
+            }
+            return words[2];
+        }
+        default:
+            return std::nullopt;
+        }
+    }
+
+    /**
+     * Returns true when a construct nested in the arm of a selection starting at target branches
+     * to the merge block of the selection, like a break out of a switch case.
+     */
+    bool HasNestedBreak(const IR::CFG& cfg, size_t header, u32 target, u32 merge_label) const {
+        const size_t merge = cfg.block_index.at(merge_label);
+        std::vector<size_t> arm;
+        std::vector<bool> visited(function.blocks.size());
+        std::vector<size_t> pending{cfg.block_index.at(target)};
+        while (!pending.empty()) {
+            const size_t index = pending.back();
+            pending.pop_back();
+            if (index == merge || visited[index] || !cfg.Dominates(header, index)) {
+                continue;
+            }
+            visited[index] = true;
+            arm.push_back(index);
+            pending.insert(pending.end(), cfg.succs[index].begin(), cfg.succs[index].end());
+        }
+        for (const size_t nested : arm) {
+            const IR::Inst* const nested_merge = function.blocks[nested].Merge();
+            if (!nested_merge) {
+                continue;
+            }
+            const size_t nested_merge_index = cfg.block_index.at(nested_merge->words[1]);
+            for (const size_t index : arm) {
+                const bool is_inside = cfg.Dominates(nested, index) &&
+                                       (!cfg.Reachable(nested_merge_index) ||
+                                        !cfg.Dominates(nested_merge_index, index));
+                const auto& succs = cfg.succs[index];
+                if (is_inside && std::ranges::find(succs, merge) != succs.end()) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /// Returns a terminator only taking target besides the merge block of its selection.
+    static IR::Inst KeepMerge(const IR::Inst& terminator, u32 target, u32 merge_label) {
+        IR::Inst inst = terminator;
+        if (inst.Op() == spv::Op::OpSwitch) {
+            inst.words.resize(3);
+            inst.words[2] = target;
+            inst.UpdateWordCount();
+        } else if (inst.words[2] != target) {
+            inst.words[2] = merge_label;
+        } else if (inst.words[3] != target) {
+            inst.words[3] = merge_label;
+        }
+        return inst;
+    }
+
+    /**
+     * Replaces terminators taking a constant target with a branch to it. Selection merges are
+     * removed unless a nested construct breaks to the merge block, in which case the selection
+     * is kept with its other targets replaced by the merge block.
+     */
+    bool FoldTerminators() {
+        bool changed = false;
+        for (size_t index = 0; index < function.blocks.size(); ++index) {
+            IR::Block& block = function.blocks[index];
+            const std::optional<u32> target = ConstantTarget(block.Terminator());
+            if (!target) {
+                continue;
+            }
+            IR::Inst terminator = std::exchange(
+                block.insts.back(), IR::Inst{{IR::MakeWord0(spv::Op::OpBranch, 2), *target}});
+            const IR::Inst* const merge = block.Merge();
+            if (!merge || merge->Op() != spv::Op::OpSelectionMerge) {
+                changed = true;
+                continue;
+            }
+            const u32 merge_label = merge->words[1];
+            if (*target != merge_label) {
+                // Look for breaks in the control flow left after folding
+                const IR::CFG cfg{function, table};
+                if (cfg.Reachable(index) && HasNestedBreak(cfg, index, *target, merge_label)) {
+                    IR::Inst kept = KeepMerge(terminator, *target, merge_label);
+                    changed |= kept.words != terminator.words;
+                    block.insts.back() = std::move(kept);
+                    continue;
+                }
+            }
+            block.insts.erase(block.insts.end() - 2);
+            changed = true;
+        }
+        return changed;
+    }
+
+    /**
+     * Removes unreachable blocks. Merge blocks and continue targets of reachable constructs are
+     * kept with the minimal contents allowed for unreachable structural blocks.
+     */
+    bool PruneBlocks() {
+        const IR::CFG cfg{function, table};
+        std::unordered_map<u32, std::optional<u32>> placeholders;
+        for (const size_t index : cfg.rpo) {
+            const IR::Block& block = function.blocks[index];
+            const IR::Inst* const merge = block.Merge();
+            if (!merge) {
+                continue;
+            }
+            if (!cfg.Reachable(cfg.block_index.at(merge->words[1]))) {
+                placeholders.emplace(merge->words[1], std::nullopt);
+            }
+            if (merge->Op() == spv::Op::OpLoopMerge &&
+                !cfg.Reachable(cfg.block_index.at(merge->words[2]))) {
+                placeholders.emplace(merge->words[2], block.label);
+            }
+        }
+        bool changed = false;
+        size_t index = 0;
+        std::erase_if(function.blocks, [&](IR::Block& block) {
+            if (cfg.Reachable(index++)) {
+                return false;
+            }
+            const auto placeholder = placeholders.find(block.label);
+            if (placeholder == placeholders.end()) {
+                RemoveDefinitions(block.insts);
+                changed = true;
+                return true;
+            }
+            IR::Inst terminator;
+            if (placeholder->second) {
+                terminator.words = {IR::MakeWord0(spv::Op::OpBranch, 2), *placeholder->second};
+            } else {
+                terminator.words = {IR::MakeWord0(spv::Op::OpUnreachable, 1)};
+            }
+            if (block.insts.size() != 1 || block.insts.front().words != terminator.words) {
+                RemoveDefinitions(block.insts);
+                block.insts = {std::move(terminator)};
+                changed = true;
+            }
+            return false;
+        });
+        return changed;
+    }
+
+    /// Matches phi operands with the current predecessors and replaces phis with a single value.
+    bool SimplifyPhis() {
+        const IR::CFG cfg{function, table};
+        bool changed = false;
+        std::unordered_map<u32, u32> replacements;
+        for (size_t index = 0; index < function.blocks.size(); ++index) {
+            IR::Block& block = function.blocks[index];
+            std::vector<u32> preds;
+            for (const size_t pred : cfg.preds[index]) {
+                preds.push_back(function.blocks[pred].label);
+            }
+            for (IR::Inst& inst : block.insts) {
+                if (inst.Op() != spv::Op::OpPhi) {
+                    break;
+                }
+                changed |= MatchPredecessors(inst, preds);
+                if (!cfg.Reachable(index)) {
+                    continue;
+                }
+                u32 unique = 0;
+                bool is_unique = true;
+                for (size_t operand = 3; operand < inst.words.size(); operand += 2) {
+                    const u32 value = inst.words[operand];
+                    if (value == inst.words[2] || value == unique) {
+                        continue;
+                    }
+                    if (unique != 0) {
+                        is_unique = false;
+                        break;
+                    }
+                    unique = value;
+                }
+                if (is_unique && unique != 0) {
+                    replacements.emplace(inst.words[2], unique);
+                }
+            }
+        }
+        if (replacements.empty()) {
+            return changed;
+        }
+        for (IR::Block& block : function.blocks) {
+            std::erase_if(block.insts, [&](const IR::Inst& inst) {
+                return inst.Op() == spv::Op::OpPhi && replacements.contains(inst.words[2]);
+            });
+        }
+        const auto resolve = [&](u32 id) {
+            for (auto it = replacements.find(id); it != replacements.end();
+                 it = replacements.find(id)) {
+                id = it->second;
+            }
+            return id;
+        };
+        for (IR::Block& block : function.blocks) {
+            for (IR::Inst& inst : block.insts) {
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words,
+                    [&](size_t index) { inst.words[index] = resolve(inst.words[index]); },
+                    literal_words);
+            }
+        }
+        for (const auto& [id, value] : replacements) {
+            removed_ids.insert(id);
+        }
+        return true;
+    }
+
+    bool MatchPredecessors(IR::Inst& phi, std::span<const u32> preds) {
+        bool changed = false;
+        std::vector<u32> operands;
+        std::unordered_set<u32> seen;
+        for (size_t index = 3; index + 1 < phi.words.size(); index += 2) {
+            const u32 parent = phi.words[index + 1];
+            if (std::ranges::find(preds, parent) == preds.end() || !seen.insert(parent).second) {
+                changed = true;
+                continue;
+            }
+            u32 value = phi.words[index];
+            if (removed_ids.contains(value)) {
+                value = Undef(phi.words[1]);
+                changed = true;
+            }
+            operands.push_back(value);
+            operands.push_back(parent);
+        }
+        for (const u32 pred : preds) {
+            if (!seen.contains(pred)) {
+                operands.push_back(Undef(phi.words[1]));
+                operands.push_back(pred);
+                changed = true;
+            }
+        }
+        if (changed) {
+            phi.words.resize(3);
+            phi.words.insert(phi.words.end(), operands.begin(), operands.end());
+            phi.UpdateWordCount();
+        }
+        return changed;
+    }
+
+    void RemoveDefinitions(const std::vector<IR::Inst>& insts) {
+        for (const IR::Inst& inst : insts) {
+            if (const u32 result = inst.Result(); result != 0) {
+                removed_ids.insert(result);
+            }
+        }
+    }
+
+    u32 Undef(u32 type) {
+        const auto it = std::ranges::find(undefs, type, &std::pair<u32, u32>::first);
+        if (it != undefs.end()) {
+            return it->second;
+        }
+        return undefs.emplace_back(type, ++bound).second;
+    }
+
+    IR::Function& function;
+    const IR::DeclarationTable& table;
+    u32& bound;
+    std::unordered_set<u32>& removed_ids;
+    std::vector<std::pair<u32, u32>> undefs;
+};
+
+} // Anonymous namespace
+
+void Module::FoldConstantBranches() {
+    SIRIT_TRACE_SCOPE("Module::FoldConstantBranches");
+    std::vector<IR::Function> functions = IR::ParseFunctions(code->Words());
+    const IR::DeclarationTable table{declarations->Words()};
+    std::unordered_set<u32> removed_ids;
+    bool changed = false;
+    for (IR::Function& function : functions) {
+        if (!function.blocks.empty()) {
+            changed |= BranchFolder{function, table, bound, removed_ids}.Run();
+        }
+    }
+    if (!changed) {
+        return;
+    }
+    code->Assign(IR::Serialize(functions));
+    debug->Assign(IR::RemoveTargets(debug->Words(), removed_ids));
+    annotations->Assign(IR::RemoveTargets(annotations->Words(), removed_ids));
+    deferred_phi_nodes.clear();
+}
+
+} // namespace Sirit
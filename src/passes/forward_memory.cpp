@@ -0,0 +1,476 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "ir.h"
+#include "stream.h"
+#include "tracing.h"
+
+namespace Sirit {
+
+namespace {
+
+struct Pointer {
+    u32 root{};
+    u32 canonical{};
+    std::vector<u32> path;
+    /// True when the root is a variable, pointers to different variables never alias.
+    bool is_variable = false;
+    /// True when values loaded or stored through this pointer can be tracked.
+    bool forwardable = false;
+};
+
+struct HashVector {
+    size_t operator()(const std::vector<u32>& vector) const noexcept {
+        size_t hash = vector.size();
+        for (const u32 value : vector) {
+            hash = hash * 31 + value;
+        }
+        return hash;
+    }
+};
+
+bool IsForwardableStorage(spv::StorageClass storage_class) {
+    switch (storage_class) {
+    case spv::StorageClass::Function:
+    case spv::StorageClass::Private:
+    case spv::StorageClass::Input:
+    case spv::StorageClass::Output:
+    case spv::StorageClass::UniformConstant:
+    case spv::StorageClass::PushConstant:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool HasPlainMemoryAccess(const IR::Inst& inst, size_t mask_index) {
+    if (inst.words.size() <= mask_index) {
+        return true;
+    }
+    const u32 allowed = static_cast<u32>(spv::MemoryAccessMask::Aligned) |
+                        static_cast<u32>(spv::MemoryAccessMask::Nontemporal);
+    return (inst.words[mask_index] & ~allowed) == 0;
+}
+
+/// Value of a constant integer index, zero and sign extended from the width of its type.
+struct IndexValue {
+    u64 zero_extended{};
+    u64 sign_extended{};
+};
+
+std::optional<IndexValue> ResolveIndex(const IR::DeclarationTable& table, u32 id) {
+    const std::span<const u32> def = table.Find(id);
+    if (def.size() < 4 || IR::Opcode(def[0]) != spv::Op::OpConstant) {
+        return std::nullopt;
+    }
+    const std::span<const u32> type = table.Find(def[1]);
+    if (type.size() < 3 || IR::Opcode(type[0]) != spv::Op::OpTypeInt) {
+        return std::nullopt;
+    }
+    const u32 width = type[2];
+    if (width == 64 && def.size() == 5) {
+        const u64 value = def[3] | static_cast<u64>(def[4]) << 32;
+        return IndexValue{value, value};
+    }
+    if (width == 0 || width > 32 || def.size() != 4) {
+        return std::nullopt;
+    }
+    const u32 shift = 64 - width;
+    const u64 shifted = static_cast<u64>(def[3]) << shift;
+    return IndexValue{shifted >> shift, static_cast<u64>(static_cast<s64>(shifted) >> shift)};
+}
+
+bool ClobbersMemory(spv::Op op) {
+    switch (op) {
+    case spv::Op::OpFunctionCall:
+    case spv::Op::OpControlBarrier:
+    case spv::Op::OpMemoryBarrier:
+    case spv::Op::OpEmitVertex:
+    case spv::Op::OpEndPrimitive:
+    case spv::Op::OpEmitStreamVertex:
+    case spv::Op::OpEndStreamPrimitive:
+    case spv::Op::OpAtomicLoad:
+    case spv::Op::OpAtomicStore:
+    case spv::Op::OpAtomicExchange:
+    case spv::Op::OpAtomicCompareExchange:
+    case spv::Op::OpAtomicCompareExchangeWeak:
+    case spv::Op::OpAtomicIIncrement:
+    case spv::Op::OpAtomicIDecrement:
+    case spv::Op::OpAtomicIAdd:
+    case spv::Op::OpAtomicISub:
+    case spv::Op::OpAtomicSMin:
+    case spv::Op::OpAtomicUMin:
+    case spv::Op::OpAtomicSMax:
+    case spv::Op::OpAtomicUMax:
+    case spv::Op::OpAtomicAnd:
+    case spv::Op::OpAtomicOr:
+    case spv::Op::OpAtomicXor:
+    case spv::Op::OpAtomicFlagTestAndSet:
+    case spv::Op::OpAtomicFlagClear:
+        return true;
+    default:
+        return false;
+    }
+}
+
+class Forwarder {
+public:
+    explicit Forwarder(IR::Function& function_, const IR::DeclarationTable& table_,
+                       const std::unordered_map<u32, spv::StorageClass>& globals_,
+                       const std::unordered_set<u32>& volatile_ids_,
+                       std::unordered_set<u32>& removed_ids_)
+        : function{function_}, table{table_}, globals{globals_}, volatile_ids{volatile_ids_},
+          removed_ids{removed_ids_} {}
+
+    bool Run() {
+        AnalyzePointers();
+        if (pointers.empty()) {
+            return false;
+        }
+        AnalyzeEscapes();
+        for (IR::Block& block : function.blocks) {
+            ForwardBlock(block);
+        }
+        RemoveWriteOnlyStores();
+        Substitute();
+        return changed;
+    }
+
+private:
+    void AddVariable(u32 id, spv::StorageClass storage_class) {
+        Pointer pointer{id, id, {}, true, false};
+        pointer.forwardable = IsForwardableStorage(storage_class) && !volatile_ids.contains(id);
+        if (storage_class == spv::StorageClass::Function) {
+            locals.insert(id);
+        }
+        pointers.emplace(id, std::move(pointer));
+    }
+
+    void AnalyzePointers() {
+        for (const IR::Inst& inst : function.blocks.front().insts) {
+            if (inst.Op() != spv::Op::OpVariable) {
+                break;
+            }
+            AddVariable(inst.words[2], static_cast<spv::StorageClass>(inst.words[3]));
+        }
+        for (const IR::Block& block : function.blocks) {
+            for (const IR::Inst& inst : block.insts) {
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words, [&](size_t index) { FindPointer(inst.words[index]); },
+                    literal_words);
+            }
+        }
+        std::unordered_map<std::vector<u32>, u32, HashVector> canonical_chains;
+        for (const IR::Block& block : function.blocks) {
+            for (const IR::Inst& inst : block.insts) {
+                const spv::Op op = inst.Op();
+                if (op != spv::Op::OpAccessChain && op != spv::Op::OpInBoundsAccessChain) {
+                    continue;
+                }
+                const Pointer* const base = FindPointer(inst.words[3]);
+                if (!base) {
+                    continue;
+                }
+                Pointer chain{*base};
+                chain.path.insert(chain.path.end(), inst.words.begin() + 4, inst.words.end());
+
+                std::vector<u32> key{chain.root};
+                key.insert(key.end(), chain.path.begin(), chain.path.end());
+                chain.canonical = canonical_chains.emplace(std::move(key), inst.words[2])
+                                      .first->second;
+                pointers.emplace(inst.words[2], std::move(chain));
+            }
+        }
+    }
+
+    const Pointer* FindPointer(u32 id) {
+        if (const auto it = pointers.find(id); it != pointers.end()) {
+            return &it->second;
+        }
+        if (const auto it = globals.find(id); it != globals.end()) {
+            AddVariable(id, it->second);
+            return &pointers.at(id);
+        }
+        return nullptr;
+    }
+
+    /// Finds Function variables whose address is used by anything but loads, stores and access
+    /// chains, these may be accessed through other pointers.
+    void AnalyzeEscapes() {
+        for (const IR::Block& block : function.blocks) {
+            for (const IR::Inst& inst : block.insts) {
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words,
+                    [&](size_t index) {
+                        const auto it = pointers.find(inst.words[index]);
+                        if (it == pointers.end() || !locals.contains(it->second.root)) {
+                            return;
+                        }
+                        const spv::Op op = inst.Op();
+                        const bool is_address = (op == spv::Op::OpLoad && index == 3) ||
+                                                (op == spv::Op::OpStore && index == 1) ||
+                                                ((op == spv::Op::OpAccessChain ||
+                                                  op == spv::Op::OpInBoundsAccessChain) &&
+                                                 index == 3);
+                        if (!is_address) {
+                            escaped.insert(it->second.root);
+                        }
+                    },
+                    literal_words);
+            }
+        }
+    }
+
+    bool IsPrivateLocal(u32 root) const {
+        return locals.contains(root) && !escaped.contains(root);
+    }
+
+    bool MayAlias(const Pointer& a, const Pointer& b) const {
+        if (a.root != b.root) {
+            if (a.is_variable && b.is_variable) {
+                return false;
+            }
+            // Unknown pointers can't reach Function variables that never escaped
+            return !IsPrivateLocal(a.root) && !IsPrivateLocal(b.root);
+        }
+        const size_t common = std::min(a.path.size(), b.path.size());
+        for (size_t index = 0; index < common; ++index) {
+            if (a.path[index] == b.path[index]) {
+                continue;
+            }
+            // Indices of different widths or signedness can select the same element
+            const std::optional<IndexValue> lhs = ResolveIndex(table, a.path[index]);
+            const std::optional<IndexValue> rhs = ResolveIndex(table, b.path[index]);
+            if (!lhs || !rhs) {
+                continue;
+            }
+            if (lhs->zero_extended != rhs->zero_extended &&
+                lhs->sign_extended != rhs->sign_extended) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Map>
+    void EraseAliasing(Map& map, const Pointer& pointer) {
+        std::erase_if(map, [&](const auto& entry) {
+            return MayAlias(pointers.at(entry.first), pointer);
+        });
+    }
+
+    template <typename Map>
+    void EraseShared(Map& map) {
+        std::erase_if(map, [&](const auto& entry) {
+            return !IsPrivateLocal(pointers.at(entry.first).root);
+        });
+    }
+
+    /// Forgets everything that may be accessed through an untracked pointer.
+    void EraseUnknown() {
+        Pointer unknown{};
+        EraseAliasing(values, unknown);
+        EraseAliasing(pending_stores, unknown);
+    }
+
+    void ForwardBlock(IR::Block& block) {
+        values.clear();
+        pending_stores.clear();
+        std::vector<bool> dead(block.insts.size());
+        for (size_t index = 0; index < block.insts.size(); ++index) {
+            IR::Inst& inst = block.insts[index];
+            const spv::Op op = inst.Op();
+            if (op == spv::Op::OpLoad) {
+                const auto it = pointers.find(inst.words[3]);
+                if (it == pointers.end()) {
+                    EraseUnknown();
+                    continue;
+                }
+                const Pointer& pointer = it->second;
+                if (!pointer.forwardable || !HasPlainMemoryAccess(inst, 4)) {
+                    EraseAliasing(values, pointer);
+                    EraseAliasing(pending_stores, pointer);
+                    continue;
+                }
+                if (const auto value = values.find(pointer.canonical); value != values.end()) {
+                    replacements.emplace(inst.words[2], value->second);
+                    removed_ids.insert(inst.words[2]);
+                    dead[index] = true;
+                    continue;
+                }
+                EraseAliasing(pending_stores, pointer);
+                values.emplace(pointer.canonical, inst.words[2]);
+            } else if (op == spv::Op::OpStore) {
+                const auto it = pointers.find(inst.words[1]);
+                if (it == pointers.end()) {
+                    EraseUnknown();
+                    continue;
+                }
+                const Pointer& pointer = it->second;
+                const bool is_plain = pointer.forwardable && HasPlainMemoryAccess(inst, 3);
+                if (const auto store = pending_stores.find(pointer.canonical);
+                    is_plain && store != pending_stores.end()) {
+                    dead[store->second] = true;
+                    pending_stores.erase(store);
+                }
+                EraseAliasing(values, pointer);
+                if (!is_plain) {
+                    EraseAliasing(pending_stores, pointer);
+                    continue;
+                }
+                values.emplace(pointer.canonical, Resolve(inst.words[2]));
+                if (IsPrivateLocal(pointer.root)) {
+                    pending_stores.emplace(pointer.canonical, index);
+                }
+            } else if (ClobbersMemory(op)) {
+                EraseShared(values);
+                EraseShared(pending_stores);
+            } else if (op != spv::Op::OpAccessChain && op != spv::Op::OpInBoundsAccessChain) {
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words,
+                    [&](size_t operand) {
+                        const auto it = pointers.find(inst.words[operand]);
+                        if (it != pointers.end()) {
+                            EraseAliasing(values, it->second);
+                            EraseAliasing(pending_stores, it->second);
+                        }
+                    },
+                    literal_words);
+            }
+        }
+        if (std::ranges::find(dead, true) == dead.end()) {
+            return;
+        }
+        changed = true;
+        size_t index = 0;
+        std::erase_if(block.insts, [&](const IR::Inst&) { return dead[index++]; });
+    }
+
+    /// Removes stores to Function variables that are never read.
+    void RemoveWriteOnlyStores() {
+        std::unordered_set<u32> read_roots;
+        for (const IR::Block& block : function.blocks) {
+            for (const IR::Inst& inst : block.insts) {
+                if (inst.Op() != spv::Op::OpLoad) {
+                    continue;
+                }
+                if (const auto it = pointers.find(inst.words[3]); it != pointers.end()) {
+                    read_roots.insert(it->second.root);
+                }
+            }
+        }
+        for (IR::Block& block : function.blocks) {
+            std::erase_if(block.insts, [&](const IR::Inst& inst) {
+                if (inst.Op() != spv::Op::OpStore || !HasPlainMemoryAccess(inst, 3)) {
+                    return false;
+                }
+                const auto it = pointers.find(inst.words[1]);
+                if (it == pointers.end()) {
+                    return false;
+                }
+                const u32 root = it->second.root;
+                if (!IsPrivateLocal(root) || read_roots.contains(root)) {
+                    return false;
+                }
+                changed = true;
+                return true;
+            });
+        }
+    }
+
+    void Substitute() {
+        if (replacements.empty()) {
+            return;
+        }
+        for (IR::Block& block : function.blocks) {
+            for (IR::Inst& inst : block.insts) {
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words,
+                    [&](size_t index) { inst.words[index] = Resolve(inst.words[index]); },
+                    literal_words);
+            }
+        }
+    }
+
+    u32 Resolve(u32 id) const {
+        for (auto it = replacements.find(id); it != replacements.end();
+             it = replacements.find(id)) {
+            id = it->second;
+        }
+        return id;
+    }
+
+    IR::Function& function;
+    const IR::DeclarationTable& table;
+    const std::unordered_map<u32, spv::StorageClass>& globals;
+    const std::unordered_set<u32>& volatile_ids;
+    std::unordered_set<u32>& removed_ids;
+
+    std::unordered_map<u32, Pointer> pointers;
+    std::unordered_set<u32> locals;
+    std::unordered_set<u32> escaped;
+    std::unordered_map<u32, u32> replacements;
+    bool changed = false;
+
+    /// Known value of each canonical pointer in the current block.
+    std::unordered_map<u32, u32> values;
+    /// Stores to private Function variables that have not been read in the current block.
+    std::unordered_map<u32, size_t> pending_stores;
+};
+
+} // Anonymous namespace
+
+void Module::ForwardLocalMemory() {
+    SIRIT_TRACE_SCOPE("Module::ForwardLocalMemory");
+    std::vector<IR::Function> functions = IR::ParseFunctions(code->Words());
+    const IR::DeclarationTable table{declarations->Words()};
+
+    std::unordered_map<u32, spv::StorageClass> globals;
+    IR::ForEachInstruction(global_variables->Words(), [&](std::span<const u32> inst) {
+        if (IR::Opcode(inst[0]) == spv::Op::OpVariable) {
+            globals.emplace(inst[2], static_cast<spv::StorageClass>(inst[3]));
+        }
+    });
+    std::unordered_set<u32> volatile_ids;
+    IR::ForEachInstruction(annotations->Words(), [&](std::span<const u32> inst) {
+        if (IR::Opcode(inst[0]) != spv::Op::OpDecorate) {
+            return;
+        }
+        const auto decoration = static_cast<spv::Decoration>(inst[2]);
+        if (decoration == spv::Decoration::Volatile || decoration == spv::Decoration::Coherent) {
+            volatile_ids.insert(inst[1]);
+        }
+    });
+
+    std::unordered_set<u32> removed_ids;
+    bool changed = false;
+    for (IR::Function& function : functions) {
+        if (!function.blocks.empty()) {
+            changed |= Forwarder{function, table, globals, volatile_ids, removed_ids}.Run();
+        }
+    }
+    if (!changed) {
+        return;
+    }
+    code->Assign(IR::Serialize(functions));
+    debug->Assign(IR::RemoveTargets(debug->Words(), removed_ids));
+    annotations->Assign(IR::RemoveTargets(annotations->Words(), removed_ids));
+    deferred_phi_nodes.clear();
+}
+
+} // namespace Sirit
@@ -0,0 +1,433 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "ir.h"
+#include "stream.h"
+#include "tracing.h"
+
+namespace Sirit {
+
+namespace {
+
+struct Variable {
+    u32 id{};
+    u32 type{};
+    u32 initializer{};
+    bool promotable = true;
+    std::vector<size_t> def_blocks;
+};
+
+struct InsertedPhi {
+    size_t variable{};
+    u32 id{};
+    std::vector<u32> operands;
+};
+
+bool IsVolatile(const IR::Inst& inst, size_t mask_index) {
+    return inst.words.size() > mask_index &&
+           (inst.words[mask_index] & static_cast<u32>(spv::MemoryAccessMask::Volatile)) != 0;
+}
+
+bool IsPromotableType(const IR::DeclarationTable& table, u32 type) {
+    switch (table.OpOf(type)) {
+    case spv::Op::OpTypeBool:
+    case spv::Op::OpTypeInt:
+    case spv::Op::OpTypeFloat:
+    case spv::Op::OpTypeVector:
+        return true;
+    default:
+        return false;
+    }
+}
+
+class Promoter {
+public:
+    explicit Promoter(IR::Function& function_, const IR::DeclarationTable& table_, u32& bound_,
+                      std::unordered_set<u32>& removed_ids_)
+        : function{function_}, table{table_}, bound{bound_},
+          removed_ids{removed_ids_}, cfg{function_, table_} {}
+
+    void Run() {
+        CollectVariables();
+        if (variables.empty()) {
+            return;
+        }
+        CollectUses();
+        std::erase_if(variables, [](const Variable& variable) { return !variable.promotable; });
+        if (variables.empty()) {
+            return;
+        }
+        for (size_t index = 0; index < variables.size(); ++index) {
+            variable_index.emplace(variables[index].id, index);
+            removed_ids.insert(variables[index].id);
+        }
+        InsertPhis();
+        Rename();
+        FinalizePhis();
+        Substitute();
+        RemoveDeadPhis();
+        EmitUndefs();
+    }
+
+private:
+    void CollectVariables() {
+        for (const IR::Inst& inst : function.blocks.front().insts) {
+            if (inst.Op() != spv::Op::OpVariable) {
+                break;
+            }
+            if (static_cast<spv::StorageClass>(inst.words[3]) != spv::StorageClass::Function) {
+                continue;
+            }
+            const std::span<const u32> pointer = table.Find(inst.words[1]);
+            if (pointer.empty() || !IsPromotableType(table, pointer[3])) {
+                continue;
+            }
+            const u32 initializer = inst.words.size() > 4 ? inst.words[4] : 0;
+            variable_index.emplace(inst.words[2], variables.size());
+            variables.push_back(Variable{inst.words[2], pointer[3], initializer, true, {}});
+        }
+    }
+
+    void CollectUses() {
+        for (size_t block = 0; block < function.blocks.size(); ++block) {
+            for (const IR::Inst& inst : function.blocks[block].insts) {
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words,
+                    [&](size_t index) {
+                        const auto it = variable_index.find(inst.words[index]);
+                        if (it == variable_index.end()) {
+                            return;
+                        }
+                        Variable& variable = variables[it->second];
+                        const spv::Op op = inst.Op();
+                        const bool is_load =
+                            op == spv::Op::OpLoad && index == 3 && !IsVolatile(inst, 4);
+                        const bool is_store =
+                            op == spv::Op::OpStore && index == 1 && !IsVolatile(inst, 3);
+                        if (!cfg.Reachable(block) || !(is_load || is_store)) {
+                            variable.promotable = false;
+                            return;
+                        }
+                        if (is_store) {
+                            variable.def_blocks.push_back(block);
+                        }
+                    },
+                    literal_words);
+            }
+        }
+        variable_index.clear();
+    }
+
+    void InsertPhis() {
+        const size_t num_blocks = function.blocks.size();
+        std::vector<std::vector<size_t>> frontiers(num_blocks);
+        for (const size_t block : cfg.rpo) {
+            if (cfg.preds[block].size() < 2) {
+                continue;
+            }
+            for (size_t runner : cfg.preds[block]) {
+                if (!cfg.Reachable(runner)) {
+                    continue;
+                }
+                while (runner != cfg.idom[block]) {
+                    auto& frontier = frontiers[runner];
+                    if (std::ranges::find(frontier, block) == frontier.end()) {
+                        frontier.push_back(block);
+                    }
+                    runner = cfg.idom[runner];
+                }
+            }
+        }
+        phis.resize(num_blocks);
+        std::vector<size_t> has_phi(num_blocks, ~size_t{0});
+        std::vector<size_t> worklist;
+        for (size_t index = 0; index < variables.size(); ++index) {
+            worklist = variables[index].def_blocks;
+            while (!worklist.empty()) {
+                const size_t block = worklist.back();
+                worklist.pop_back();
+                for (const size_t frontier : frontiers[block]) {
+                    if (has_phi[frontier] == index) {
+                        continue;
+                    }
+                    has_phi[frontier] = index;
+                    phis[frontier].push_back(InsertedPhi{index, ++bound, {}});
+                    worklist.push_back(frontier);
+                }
+            }
+        }
+    }
+
+    void Rename() {
+        const size_t num_blocks = function.blocks.size();
+        std::vector<std::vector<size_t>> children(num_blocks);
+        for (const size_t block : std::span(cfg.rpo).subspan(1)) {
+            children[cfg.idom[block]].push_back(block);
+        }
+        std::vector<std::vector<u32>> stacks(variables.size());
+        for (size_t index = 0; index < variables.size(); ++index) {
+            const Variable& variable = variables[index];
+            const u32 initial = variable.initializer;
+            stacks[index].push_back(initial != 0 ? initial : Undef(variable.type));
+        }
+
+        struct Frame {
+            size_t block;
+            size_t next_child;
+            std::vector<size_t> pushed;
+        };
+        std::vector<Frame> frames;
+        frames.push_back(Frame{0, 0, EnterBlock(0, stacks)});
+        while (!frames.empty()) {
+            Frame& frame = frames.back();
+            if (frame.next_child < children[frame.block].size()) {
+                const size_t child = children[frame.block][frame.next_child++];
+                frames.push_back(Frame{child, 0, EnterBlock(child, stacks)});
+                continue;
+            }
+            for (const size_t variable : frame.pushed) {
+                stacks[variable].pop_back();
+            }
+            frames.pop_back();
+        }
+
+        // Phis must have an incoming value for every parent, including unreachable ones
+        for (size_t block = 0; block < num_blocks; ++block) {
+            if (cfg.Reachable(block)) {
+                continue;
+            }
+            for (const size_t succ : cfg.succs[block]) {
+                for (InsertedPhi& phi : phis[succ]) {
+                    phi.operands.push_back(Undef(variables[phi.variable].type));
+                    phi.operands.push_back(function.blocks[block].label);
+                }
+            }
+        }
+    }
+
+    std::vector<size_t> EnterBlock(size_t block, std::vector<std::vector<u32>>& stacks) {
+        std::vector<size_t> pushed;
+        for (const InsertedPhi& phi : phis[block]) {
+            stacks[phi.variable].push_back(phi.id);
+            pushed.push_back(phi.variable);
+        }
+        auto& insts = function.blocks[block].insts;
+        std::erase_if(insts, [&](const IR::Inst& inst) {
+            switch (inst.Op()) {
+            case spv::Op::OpVariable:
+                return variable_index.contains(inst.words[2]);
+            case spv::Op::OpLoad: {
+                const auto it = variable_index.find(inst.words[3]);
+                if (it == variable_index.end()) {
+                    return false;
+                }
+                replacements.emplace(inst.words[2], stacks[it->second].back());
+                removed_ids.insert(inst.words[2]);
+                return true;
+            }
+            case spv::Op::OpStore: {
+                const auto it = variable_index.find(inst.words[1]);
+                if (it == variable_index.end()) {
+                    return false;
+                }
+                stacks[it->second].push_back(Resolve(inst.words[2]));
+                pushed.push_back(it->second);
+                return true;
+            }
+            default:
+                return false;
+            }
+        });
+        const u32 label = function.blocks[block].label;
+        for (const size_t succ : cfg.succs[block]) {
+            for (InsertedPhi& phi : phis[succ]) {
+                phi.operands.push_back(stacks[phi.variable].back());
+                phi.operands.push_back(label);
+            }
+        }
+        return pushed;
+    }
+
+    /// Replaces phis with a single incoming value, ignoring self references.
+    void FinalizePhis() {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto& block_phis : phis) {
+                std::erase_if(block_phis, [&](const InsertedPhi& phi) {
+                    u32 unique = 0;
+                    for (size_t index = 0; index < phi.operands.size(); index += 2) {
+                        const u32 value = Resolve(phi.operands[index]);
+                        if (value == phi.id || value == unique) {
+                            continue;
+                        }
+                        if (unique != 0) {
+                            return false;
+                        }
+                        unique = value;
+                    }
+                    if (unique == 0) {
+                        unique = Undef(variables[phi.variable].type);
+                    }
+                    replacements.emplace(phi.id, unique);
+                    changed = true;
+                    return true;
+                });
+            }
+        }
+        for (size_t block = 0; block < phis.size(); ++block) {
+            auto& insts = function.blocks[block].insts;
+            std::vector<IR::Inst> new_phis;
+            for (const InsertedPhi& phi : phis[block]) {
+                IR::Inst inst;
+                inst.words.reserve(3 + phi.operands.size());
+                inst.words.push_back(IR::MakeWord0(spv::Op::OpPhi, 3 + phi.operands.size()));
+                inst.words.push_back(variables[phi.variable].type);
+                inst.words.push_back(phi.id);
+                inst.words.insert(inst.words.end(), phi.operands.begin(), phi.operands.end());
+                new_phis.push_back(std::move(inst));
+            }
+            insts.insert(insts.begin(), std::make_move_iterator(new_phis.begin()),
+                         std::make_move_iterator(new_phis.end()));
+        }
+    }
+
+    void Substitute() {
+        if (replacements.empty()) {
+            return;
+        }
+        for (IR::Block& block : function.blocks) {
+            for (IR::Inst& inst : block.insts) {
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words,
+                    [&](size_t index) { inst.words[index] = Resolve(inst.words[index]); },
+                    literal_words);
+            }
+        }
+    }
+
+    void RemoveDeadPhis() {
+        std::unordered_map<u32, const IR::Inst*> inserted;
+        for (size_t block = 0; block < phis.size(); ++block) {
+            for (size_t index = 0; index < phis[block].size(); ++index) {
+                const IR::Inst& inst = function.blocks[block].insts[index];
+                inserted.emplace(inst.words[2], &inst);
+            }
+        }
+        std::unordered_set<u32> live;
+        std::vector<const IR::Inst*> worklist;
+        const auto mark = [&](u32 id) {
+            const auto it = inserted.find(id);
+            if (it != inserted.end() && live.insert(id).second) {
+                worklist.push_back(it->second);
+            }
+        };
+        for (const IR::Block& block : function.blocks) {
+            for (const IR::Inst& inst : block.insts) {
+                if (inserted.contains(inst.Result())) {
+                    continue;
+                }
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words, [&](size_t index) { mark(inst.words[index]); }, literal_words);
+            }
+        }
+        while (!worklist.empty()) {
+            const IR::Inst* const phi = worklist.back();
+            worklist.pop_back();
+            for (size_t index = 3; index < phi->words.size(); index += 2) {
+                mark(phi->words[index]);
+            }
+        }
+        for (IR::Block& block : function.blocks) {
+            std::erase_if(block.insts, [&](const IR::Inst& inst) {
+                const u32 result = inst.Result();
+                return inserted.contains(result) && !live.contains(result);
+            });
+        }
+    }
+
+    void EmitUndefs() {
+        std::unordered_set<u32> used;
+        for (const IR::Block& block : function.blocks) {
+            for (const IR::Inst& inst : block.insts) {
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words, [&](size_t index) { used.insert(inst.words[index]); },
+                    literal_words);
+            }
+        }
+        std::vector<IR::Inst> new_undefs;
+        for (const auto& [type, id] : undefs) {
+            if (used.contains(id)) {
+                new_undefs.push_back(IR::Inst{{IR::MakeWord0(spv::Op::OpUndef, 3), type, id}});
+            }
+        }
+        auto& insts = function.blocks.front().insts;
+        insts.insert(function.FirstNonVariable(), std::make_move_iterator(new_undefs.begin()),
+                     std::make_move_iterator(new_undefs.end()));
+    }
+
+    u32 Undef(u32 type) {
+        const auto it = std::ranges::find(undefs, type, &std::pair<u32, u32>::first);
+        if (it != undefs.end()) {
+            return it->second;
+        }
+        return undefs.emplace_back(type, ++bound).second;
+    }
+
+    u32 Resolve(u32 id) const {
+        for (auto it = replacements.find(id); it != replacements.end();
+             it = replacements.find(id)) {
+            id = it->second;
+        }
+        return id;
+    }
+
+    IR::Function& function;
+    const IR::DeclarationTable& table;
+    u32& bound;
+    std::unordered_set<u32>& removed_ids;
+    IR::CFG cfg;
+
+    std::vector<Variable> variables;
+    std::unordered_map<u32, size_t> variable_index;
+    std::vector<std::vector<InsertedPhi>> phis;
+    std::unordered_map<u32, u32> replacements;
+    std::vector<std::pair<u32, u32>> undefs;
+};
+
+} // Anonymous namespace
+
+void Module::PromoteLocalVariables() {
+    SIRIT_TRACE_SCOPE("Module::PromoteLocalVariables");
+    std::vector<IR::Function> functions = IR::ParseFunctions(code->Words());
+    const IR::DeclarationTable table{declarations->Words()};
+    std::unordered_set<u32> removed_ids;
+    for (IR::Function& function : functions) {
+        if (!function.blocks.empty()) {
+            Promoter{function, table, bound, removed_ids}.Run();
+        }
+    }
+    if (removed_ids.empty()) {
+        return;
+    }
+    code->Assign(IR::Serialize(functions));
+    debug->Assign(IR::RemoveTargets(debug->Words(), removed_ids));
+    annotations->Assign(IR::RemoveTargets(annotations->Words(), removed_ids));
+    deferred_phi_nodes.clear();
+}
+
+} // namespace Sirit
@@ -0,0 +1,434 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <bit>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "ir.h"
+#include "stream.h"
+#include "tracing.h"
+
+namespace Sirit {
+
+namespace {
+
+/// Scalar integer or boolean type that can be evaluated at compile time.
+struct ScalarType {
+    u32 width;
+    bool is_signed;
+    bool is_bool;
+};
+
+u64 Truncate(u64 value, u32 width) {
+    return width >= 64 ? value : value & ((u64{1} << width) - 1);
+}
+
+s64 SignExtend(u64 value, u32 width) {
+    if (width >= 64) {
+        return static_cast<s64>(value);
+    }
+    const u64 sign = u64{1} << (width - 1);
+    return static_cast<s64>((Truncate(value, width) ^ sign) - sign);
+}
+
+class Specializer {
+public:
+    explicit Specializer(std::span<const u32> words_,
+                         const std::unordered_map<u32, u32>& spec_ids_,
+                         const std::unordered_map<u32, Literal>& values_)
+        : words{words_}, table{words_}, spec_ids{spec_ids_}, values{values_} {}
+
+    /// Returns the declarations with frozen specialization constants, in their original order.
+    std::vector<std::vector<u32>> Run() {
+        IR::ForEachInstruction(words, [&](std::span<const u32> inst) {
+            std::vector<u32> copy(inst.begin(), inst.end());
+            switch (IR::Opcode(inst[0])) {
+            case spv::Op::OpSpecConstantTrue:
+            case spv::Op::OpSpecConstantFalse:
+                FreezeBool(copy);
+                break;
+            case spv::Op::OpSpecConstant:
+                FreezeScalar(copy);
+                break;
+            case spv::Op::OpSpecConstantComposite:
+                if (std::ranges::all_of(std::span(copy).subspan(3), [&](u32 id) {
+                        return !IsSpecConstant(Definition(id));
+                    })) {
+                    copy[0] = IR::MakeWord0(spv::Op::OpConstantComposite, copy.size());
+                }
+                break;
+            case spv::Op::OpSpecConstantOp:
+                if (std::optional<std::vector<u32>> folded = Fold(copy)) {
+                    copy = std::move(*folded);
+                }
+                break;
+            default:
+                break;
+            }
+            definitions.emplace(copy[IR::ResultIndex(IR::Opcode(copy[0]))], result.size());
+            result.push_back(std::move(copy));
+        });
+        return std::move(result);
+    }
+
+    /// Ids of the scalar specialization constants that were frozen.
+    const std::unordered_set<u32>& Frozen() const noexcept {
+        return frozen;
+    }
+
+private:
+    static bool IsSpecConstant(std::span<const u32> def) {
+        if (def.empty()) {
+            return false;
+        }
+        const u32 op = static_cast<u32>(IR::Opcode(def[0]));
+        return op >= static_cast<u32>(spv::Op::OpSpecConstantTrue) &&
+               op <= static_cast<u32>(spv::Op::OpSpecConstantOp);
+    }
+
+    const Literal* Override(u32 id) const {
+        const auto spec_id = spec_ids.find(id);
+        if (spec_id == spec_ids.end()) {
+            return nullptr;
+        }
+        const auto value = values.find(spec_id->second);
+        return value != values.end() ? &value->second : nullptr;
+    }
+
+    void FreezeBool(std::vector<u32>& inst) {
+        bool value = IR::Opcode(inst[0]) == spv::Op::OpSpecConstantTrue;
+        if (const Literal* const literal = Override(inst[2])) {
+            value = std::visit([](auto x) { return x != 0; }, *literal);
+        }
+        inst[0] = IR::MakeWord0(value ? spv::Op::OpConstantTrue : spv::Op::OpConstantFalse, 3);
+        frozen.insert(inst[2]);
+    }
+
+    void FreezeScalar(std::vector<u32>& inst) {
+        if (const Literal* const literal = Override(inst[2])) {
+            const std::vector<u32> encoded = Encode(inst[1], *literal);
+            if (!encoded.empty()) {
+                inst.resize(3);
+                inst.insert(inst.end(), encoded.begin(), encoded.end());
+            }
+        }
+        inst[0] = IR::MakeWord0(spv::Op::OpConstant, inst.size());
+        frozen.insert(inst[2]);
+    }
+
+    /// Encodes a literal with the layout of a scalar type, empty if the type is not supported.
+    std::vector<u32> Encode(u32 type, const Literal& literal) const {
+        const std::span<const u32> def = table.Find(type);
+        if (def.size() < 3) {
+            return {};
+        }
+        const u32 width = def[2];
+        if (IR::Opcode(def[0]) == spv::Op::OpTypeFloat) {
+            const double value =
+                std::visit([](auto x) { return static_cast<double>(x); }, literal);
+            if (width == 32) {
+                return {std::bit_cast<u32>(static_cast<float>(value))};
+            }
+            if (width == 64) {
+                const u64 bits = std::bit_cast<u64>(value);
+                return {static_cast<u32>(bits), static_cast<u32>(bits >> 32)};
+            }
+            return {};
+        }
+        if (IR::Opcode(def[0]) != spv::Op::OpTypeInt || def.size() < 4) {
+            return {};
+        }
+        const u64 bits = std::visit(
+            [](auto x) {
+                if constexpr (std::is_floating_point_v<decltype(x)>) {
+                    return static_cast<u64>(static_cast<s64>(x));
+                } else if constexpr (std::is_signed_v<decltype(x)>) {
+                    return static_cast<u64>(static_cast<s64>(x));
+                } else {
+                    return static_cast<u64>(x);
+                }
+            },
+            literal);
+        if (width > 32) {
+            return {static_cast<u32>(bits), static_cast<u32>(bits >> 32)};
+        }
+        // Literals narrower than a word are sign extended for signed types
+        const u64 word = def[3] != 0 ? static_cast<u64>(SignExtend(bits, width))
+                                     : Truncate(bits, width);
+        return {static_cast<u32>(word)};
+    }
+
+    std::span<const u32> Definition(u32 id) const {
+        const auto it = definitions.find(id);
+        return it != definitions.end() ? std::span<const u32>(result[it->second])
+                                       : std::span<const u32>{};
+    }
+
+    std::optional<ScalarType> TypeOf(u32 type) const {
+        const std::span<const u32> def = table.Find(type);
+        if (def.empty()) {
+            return std::nullopt;
+        }
+        switch (IR::Opcode(def[0])) {
+        case spv::Op::OpTypeBool:
+            return ScalarType{1, false, true};
+        case spv::Op::OpTypeInt:
+            if (def[2] > 64) {
+                return std::nullopt;
+            }
+            return ScalarType{def[2], def[3] != 0, false};
+        default:
+            return std::nullopt;
+        }
+    }
+
+    std::optional<u64> ValueOf(u32 id) const {
+        const std::span<const u32> def = Definition(id);
+        if (def.empty()) {
+            return std::nullopt;
+        }
+        switch (IR::Opcode(def[0])) {
+        case spv::Op::OpConstantTrue:
+            return 1;
+        case spv::Op::OpConstantFalse:
+        case spv::Op::OpConstantNull:
+            return 0;
+        case spv::Op::OpConstant:
+            return def.size() > 4 ? def[3] | u64{def[4]} << 32 : u64{def[3]};
+        default:
+            return std::nullopt;
+        }
+    }
+
+    /// Returns a copy of the definition of id with a new result id.
+    std::optional<std::vector<u32>> Copy(u32 id, u32 result_id) const {
+        const std::span<const u32> def = Definition(id);
+        if (def.size() < 3) {
+            return std::nullopt;
+        }
+        std::vector<u32> copy(def.begin(), def.end());
+        copy[2] = result_id;
+        return copy;
+    }
+
+    std::vector<u32> MakeScalar(u32 type, u32 result_id, const ScalarType& scalar,
+                                u64 value) const {
+        if (scalar.is_bool) {
+            const spv::Op op = value != 0 ? spv::Op::OpConstantTrue : spv::Op::OpConstantFalse;
+            return {IR::MakeWord0(op, 3), type, result_id};
+        }
+        std::vector<u32> inst{0, type, result_id, static_cast<u32>(value)};
+        if (scalar.width > 32) {
+            inst.push_back(static_cast<u32>(value >> 32));
+        } else if (scalar.is_signed) {
+            inst.back() = static_cast<u32>(SignExtend(value, scalar.width));
+        }
+        inst[0] = IR::MakeWord0(spv::Op::OpConstant, inst.size());
+        return inst;
+    }
+
+    std::optional<std::vector<u32>> Fold(std::span<const u32> inst) const {
+        if (inst.size() < 5) {
+            return std::nullopt;
+        }
+        const u32 type = inst[1];
+        const u32 result_id = inst[2];
+        const auto op = static_cast<spv::Op>(inst[3]);
+        const std::span<const u32> operands = inst.subspan(4);
+        if (op == spv::Op::OpCompositeExtract) {
+            u32 id = operands[0];
+            for (const u32 index : operands.subspan(1)) {
+                const std::span<const u32> def = Definition(id);
+                if (def.empty() || IR::Opcode(def[0]) != spv::Op::OpConstantComposite ||
+                    3 + index >= def.size()) {
+                    return std::nullopt;
+                }
+                id = def[3 + index];
+            }
+            return Copy(id, result_id);
+        }
+        if (op == spv::Op::OpSelect) {
+            const std::optional<u64> condition = ValueOf(operands[0]);
+            if (!condition || operands.size() < 3) {
+                return std::nullopt;
+            }
+            return Copy(*condition != 0 ? operands[1] : operands[2], result_id);
+        }
+
+        const std::optional<ScalarType> result_type = TypeOf(type);
+        if (!result_type) {
+            return std::nullopt;
+        }
+        std::vector<u64> args;
+        std::vector<ScalarType> arg_types;
+        for (const u32 operand : operands) {
+            const std::span<const u32> def = Definition(operand);
+            const std::optional<u64> value = ValueOf(operand);
+            const std::optional<ScalarType> arg_type = def.size() > 1 ? TypeOf(def[1])
+                                                                      : std::nullopt;
+            if (!value || !arg_type) {
+                return std::nullopt;
+            }
+            args.push_back(Truncate(*value, arg_type->width));
+            arg_types.push_back(*arg_type);
+        }
+        const std::optional<u64> value = Evaluate(op, args, arg_types);
+        if (!value) {
+            return std::nullopt;
+        }
+        return MakeScalar(type, result_id, *result_type, Truncate(*value, result_type->width));
+    }
+
+    static std::optional<u64> Evaluate(spv::Op op, std::span<const u64> args,
+                                       std::span<const ScalarType> types) {
+        if (args.empty()) {
+            return std::nullopt;
+        }
+        const u32 width = types[0].width;
+        const auto u = [&](size_t index) { return args[index]; };
+        const auto s = [&](size_t index) { return SignExtend(args[index], types[index].width); };
+        switch (op) {
+        case spv::Op::OpSConvert:
+            return static_cast<u64>(s(0));
+        case spv::Op::OpUConvert:
+            return u(0);
+        case spv::Op::OpSNegate:
+            return u64{0} - u(0);
+        case spv::Op::OpNot:
+            return ~u(0);
+        case spv::Op::OpLogicalNot:
+            return u(0) == 0 ? 1 : 0;
+        default:
+            break;
+        }
+        if (args.size() < 2) {
+            return std::nullopt;
+        }
+        switch (op) {
+        case spv::Op::OpIAdd:
+            return u(0) + u(1);
+        case spv::Op::OpISub:
+            return u(0) - u(1);
+        case spv::Op::OpIMul:
+            return u(0) * u(1);
+        case spv::Op::OpUDiv:
+            return u(1) != 0 ? std::optional<u64>{u(0) / u(1)} : std::nullopt;
+        case spv::Op::OpUMod:
+            return u(1) != 0 ? std::optional<u64>{u(0) % u(1)} : std::nullopt;
+        case spv::Op::OpSDiv:
+            if (s(1) == 0) {
+                return std::nullopt;
+            }
+            return s(1) == -1 ? u64{0} - u(0) : static_cast<u64>(s(0) / s(1));
+        case spv::Op::OpSRem:
+            if (s(1) == 0) {
+                return std::nullopt;
+            }
+            return s(1) == -1 ? 0 : static_cast<u64>(s(0) % s(1));
+        case spv::Op::OpSMod: {
+            if (s(1) == 0) {
+                return std::nullopt;
+            }
+            if (s(1) == -1) {
+                return 0;
+            }
+            s64 remainder = s(0) % s(1);
+            if (remainder != 0 && (remainder < 0) != (s(1) < 0)) {
+                remainder += s(1);
+            }
+            return static_cast<u64>(remainder);
+        }
+        case spv::Op::OpShiftLeftLogical:
+            return u(1) < width ? std::optional<u64>{u(0) << u(1)} : std::nullopt;
+        case spv::Op::OpShiftRightLogical:
+            return u(1) < width ? std::optional<u64>{u(0) >> u(1)} : std::nullopt;
+        case spv::Op::OpShiftRightArithmetic:
+            return u(1) < width ? std::optional<u64>{static_cast<u64>(s(0) >> u(1))}
+                                : std::nullopt;
+        case spv::Op::OpBitwiseOr:
+        case spv::Op::OpLogicalOr:
+            return u(0) | u(1);
+        case spv::Op::OpBitwiseXor:
+            return u(0) ^ u(1);
+        case spv::Op::OpLogicalNotEqual:
+        case spv::Op::OpINotEqual:
+            return u64{u(0) != u(1)};
+        case spv::Op::OpBitwiseAnd:
+        case spv::Op::OpLogicalAnd:
+            return u(0) & u(1);
+        case spv::Op::OpLogicalEqual:
+        case spv::Op::OpIEqual:
+            return u64{u(0) == u(1)};
+        case spv::Op::OpULessThan:
+            return u64{u(0) < u(1)};
+        case spv::Op::OpULessThanEqual:
+            return u64{u(0) <= u(1)};
+        case spv::Op::OpUGreaterThan:
+            return u64{u(0) > u(1)};
+        case spv::Op::OpUGreaterThanEqual:
+            return u64{u(0) >= u(1)};
+        case spv::Op::OpSLessThan:
+            return u64{s(0) < s(1)};
+        case spv::Op::OpSLessThanEqual:
+            return u64{s(0) <= s(1)};
+        case spv::Op::OpSGreaterThan:
+            return u64{s(0) > s(1)};
+        case spv::Op::OpSGreaterThanEqual:
+            return u64{s(0) >= s(1)};
+        default:
+            return std::nullopt;
+        }
+    }
+
+    std::span<const u32> words;
+    IR::DeclarationTable table;
+    const std::unordered_map<u32, u32>& spec_ids;
+    const std::unordered_map<u32, Literal>& values;
+
+    std::vector<std::vector<u32>> result;
+    std::unordered_map<u32, size_t> definitions;
+    std::unordered_set<u32> frozen;
+};
+
+} // Anonymous namespace
+
+void Module::Specialize(const std::unordered_map<std::uint32_t, Literal>& values) {
+    SIRIT_TRACE_SCOPE("Module::Specialize");
+    std::unordered_map<u32, u32> spec_ids;
+    IR::ForEachInstruction(annotations->Words(), [&](std::span<const u32> inst) {
+        if (IR::Opcode(inst[0]) == spv::Op::OpDecorate && inst.size() == 4 &&
+            static_cast<spv::Decoration>(inst[2]) == spv::Decoration::SpecId) {
+            spec_ids.emplace(inst[1], inst[3]);
+        }
+    });
+    Specializer specializer{declarations->Words(), spec_ids, values};
+    const std::vector<std::vector<u32>> frozen_declarations = specializer.Run();
+    const std::unordered_set<u32>& frozen = specializer.Frozen();
+
+    // Rebuild the lookup table so frozen constants are found by later emissions
+    declarations->Clear();
+    for (const std::vector<u32>& inst : frozen_declarations) {
+        declarations->Restore(inst, IR::ResultIndex(IR::Opcode(inst[0])));
+    }
+
+    std::vector<u32> new_annotations;
+    IR::ForEachInstruction(annotations->Words(), [&](std::span<const u32> inst) {
+        if (IR::Opcode(inst[0]) == spv::Op::OpDecorate && frozen.contains(inst[1]) &&
+            static_cast<spv::Decoration>(inst[2]) == spv::Decoration::SpecId) {
+            return;
+        }
+        new_annotations.insert(new_annotations.end(), inst.begin(), inst.end());
+    });
+    annotations->Assign(std::move(new_annotations));
+}
+
+} // namespace Sirit
@@ -0,0 +1,474 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "common_types.h"
+#include "ir.h"
+#include "stream.h"
+#include "tracing.h"
+
+namespace Sirit {
+
+namespace {
+
+/// Upper bound of instructions emitted when unrolling a single loop.
+constexpr size_t MAX_UNROLLED_INSTRUCTIONS = 0x4000;
+
+/// Header phi carrying a value across iterations.
+struct HeaderPhi {
+    u32 id;
+    u32 initial;
+    u32 next;
+};
+
+/// Structured loop with a single exit through its merge block.
+struct Loop {
+    size_t header;
+    size_t exit;
+    size_t latch;
+    size_t preheader;
+    u32 merge_label;
+    u32 body_label;
+    std::vector<size_t> blocks;
+    std::vector<HeaderPhi> phis;
+    size_t trip_count;
+};
+
+bool EvaluateCompare(spv::Op op, u32 a, u32 b) {
+    const s32 signed_a = static_cast<s32>(a);
+    const s32 signed_b = static_cast<s32>(b);
+    switch (op) {
+    case spv::Op::OpIEqual:
+        return a == b;
+    case spv::Op::OpINotEqual:
+        return a != b;
+    case spv::Op::OpULessThan:
+        return a < b;
+    case spv::Op::OpULessThanEqual:
+        return a <= b;
+    case spv::Op::OpUGreaterThan:
+        return a > b;
+    case spv::Op::OpUGreaterThanEqual:
+        return a >= b;
+    case spv::Op::OpSLessThan:
+        return signed_a < signed_b;
+    case spv::Op::OpSLessThanEqual:
+        return signed_a <= signed_b;
+    case spv::Op::OpSGreaterThan:
+        return signed_a > signed_b;
+    case spv::Op::OpSGreaterThanEqual:
+        return signed_a >= signed_b;
+    default:
+        return false;
+    }
+}
+
+class Unroller {
+public:
+    explicit Unroller(IR::Function& function_, const IR::DeclarationTable& table_, u32& bound_,
+                      std::unordered_map<u32, std::vector<u32>>& clones_,
+                      std::unordered_map<u32, u32>& origins_, u32 max_trip_count_,
+                      bool unroll_unmarked_)
+        : function{function_}, table{table_}, bound{bound_}, clones{clones_}, origins{origins_},
+          max_trip_count{max_trip_count_}, unroll_unmarked{unroll_unmarked_} {}
+
+    bool Run() {
+        bool changed = false;
+        while (UnrollOne()) {
+            changed = true;
+        }
+        return changed;
+    }
+
+private:
+    bool UnrollOne() {
+        const IR::CFG cfg{function, table};
+        for (const size_t index : cfg.rpo) {
+            const IR::Inst* const merge = function.blocks[index].Merge();
+            if (!merge || merge->Op() != spv::Op::OpLoopMerge) {
+                continue;
+            }
+            if (std::optional<Loop> loop = Analyze(cfg, index)) {
+                Unroll(*loop);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::optional<Loop> Analyze(const IR::CFG& cfg, size_t header) {
+        const IR::Block& header_block = function.blocks[header];
+        const IR::Inst& loop_merge = *header_block.Merge();
+        const u32 control = loop_merge.words[3];
+        if ((control & static_cast<u32>(spv::LoopControlMask::DontUnroll)) != 0) {
+            return std::nullopt;
+        }
+        if (!unroll_unmarked && (control & static_cast<u32>(spv::LoopControlMask::Unroll)) == 0) {
+            return std::nullopt;
+        }
+        Loop loop{};
+        loop.header = header;
+        loop.merge_label = loop_merge.words[1];
+        const size_t merge = cfg.block_index.at(loop.merge_label);
+        loop.latch = cfg.block_index.at(loop_merge.words[2]);
+        if (!cfg.Reachable(merge) || !cfg.Reachable(loop.latch)) {
+            return std::nullopt;
+        }
+        std::vector<bool> in_loop(function.blocks.size());
+        for (size_t index = 0; index < function.blocks.size(); ++index) {
+            if (cfg.Reachable(index) && cfg.Dominates(header, index) &&
+                !cfg.Dominates(merge, index)) {
+                in_loop[index] = true;
+                loop.blocks.push_back(index);
+            }
+        }
+        const IR::Inst& latch_terminator = function.blocks[loop.latch].Terminator();
+        if (!in_loop[loop.latch] || latch_terminator.Op() != spv::Op::OpBranch ||
+            cfg.preds[header].size() != 2) {
+            return std::nullopt;
+        }
+        const auto& header_preds = cfg.preds[header];
+        loop.preheader = header_preds[0] == loop.latch ? header_preds[1] : header_preds[0];
+        if (in_loop[loop.preheader]) {
+            return std::nullopt;
+        }
+
+        // The exit test is either in the header or in a block branched to by the header
+        loop.exit = header;
+        if (header_block.Terminator().Op() == spv::Op::OpBranch) {
+            loop.exit = cfg.block_index.at(header_block.Terminator().words[1]);
+            if (!in_loop[loop.exit] || cfg.preds[loop.exit].size() != 1 ||
+                function.blocks[loop.exit].Merge()) {
+                return std::nullopt;
+            }
+        }
+        const IR::Inst& exit_terminator = function.blocks[loop.exit].Terminator();
+        if (exit_terminator.Op() != spv::Op::OpBranchConditional) {
+            return std::nullopt;
+        }
+        bool continue_on_true;
+        if (exit_terminator.words[3] == loop.merge_label) {
+            continue_on_true = true;
+            loop.body_label = exit_terminator.words[2];
+        } else if (exit_terminator.words[2] == loop.merge_label) {
+            continue_on_true = false;
+            loop.body_label = exit_terminator.words[3];
+        } else {
+            return std::nullopt;
+        }
+
+        // Only the exit test may leave the loop and only the latch may branch back
+        for (const size_t index : loop.blocks) {
+            for (const size_t succ : cfg.succs[index]) {
+                if (succ == header ? index != loop.latch
+                                   : succ == merge ? index != loop.exit : !in_loop[succ]) {
+                    return std::nullopt;
+                }
+            }
+            const IR::Inst* const inner_merge = function.blocks[index].Merge();
+            if (index == header || !inner_merge) {
+                continue;
+            }
+            const size_t targets = inner_merge->Op() == spv::Op::OpLoopMerge ? 2 : 1;
+            for (size_t operand = 1; operand <= targets; ++operand) {
+                if (!in_loop[cfg.block_index.at(inner_merge->words[operand])]) {
+                    return std::nullopt;
+                }
+            }
+        }
+
+        const u32 preheader_label = function.blocks[loop.preheader].label;
+        const u32 latch_label = function.blocks[loop.latch].label;
+        for (const IR::Inst& inst : header_block.insts) {
+            if (inst.Op() != spv::Op::OpPhi) {
+                break;
+            }
+            if (inst.words.size() != 7) {
+                return std::nullopt;
+            }
+            HeaderPhi phi{inst.words[2], 0, 0};
+            for (size_t operand = 3; operand < 7; operand += 2) {
+                const u32 parent = inst.words[operand + 1];
+                (parent == preheader_label ? phi.initial : phi.next) = inst.words[operand];
+                if (parent != preheader_label && parent != latch_label) {
+                    return std::nullopt;
+                }
+            }
+            if (phi.initial == 0 || phi.next == 0) {
+                return std::nullopt;
+            }
+            loop.phis.push_back(phi);
+        }
+
+        const std::optional<size_t> trip_count =
+            TripCount(loop, exit_terminator.words[1], continue_on_true);
+        if (!trip_count) {
+            return std::nullopt;
+        }
+        loop.trip_count = *trip_count;
+        size_t loop_size = 0;
+        for (const size_t index : loop.blocks) {
+            loop_size += function.blocks[index].insts.size() + 1;
+        }
+        if (loop_size * (loop.trip_count + 1) > MAX_UNROLLED_INSTRUCTIONS) {
+            return std::nullopt;
+        }
+        return loop;
+    }
+
+    /// Returns the constant value of a 32-bit integer id.
+    std::optional<u32> Constant(u32 id) const {
+        const std::span<const u32> def = table.Find(id);
+        if (def.size() != 4 || IR::Opcode(def[0]) != spv::Op::OpConstant) {
+            return std::nullopt;
+        }
+        // Narrower integers wrap at their own width, which the simulation doesn't model
+        const std::span<const u32> type = table.Find(def[1]);
+        if (type.size() < 3 || IR::Opcode(type[0]) != spv::Op::OpTypeInt || type[2] != 32) {
+            return std::nullopt;
+        }
+        return def[3];
+    }
+
+    const IR::Inst* FindDefinition(const Loop& loop, u32 id) const {
+        for (const size_t index : loop.blocks) {
+            for (const IR::Inst& inst : function.blocks[index].insts) {
+                if (inst.Result() == id) {
+                    return &inst;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Computes the number of iterations of a loop whose exit condition compares an induction
+     * variable stepped by a constant against a constant. The loop is simulated up to the
+     * maximum trip count, honoring 32-bit wrapping semantics.
+     */
+    std::optional<size_t> TripCount(const Loop& loop, u32 condition, bool continue_on_true) const {
+        const IR::Inst* const compare = FindDefinition(loop, condition);
+        if (!compare || compare->words.size() != 5) {
+            return std::nullopt;
+        }
+        const spv::Op compare_op = compare->Op();
+        const auto find_phi = [&](u32 id) {
+            return std::ranges::find(loop.phis, id, &HeaderPhi::id);
+        };
+        auto phi = find_phi(compare->words[3]);
+        std::optional<u32> limit = Constant(compare->words[4]);
+        bool swapped = false;
+        if (phi == loop.phis.end()) {
+            phi = find_phi(compare->words[4]);
+            limit = Constant(compare->words[3]);
+            swapped = true;
+        }
+        if (phi == loop.phis.end() || !limit) {
+            return std::nullopt;
+        }
+        const IR::Inst* const step = FindDefinition(loop, phi->next);
+        const std::optional<u32> initial = Constant(phi->initial);
+        if (!step || step->words.size() != 5 || !initial) {
+            return std::nullopt;
+        }
+        const bool is_add = step->Op() == spv::Op::OpIAdd;
+        if (!is_add && step->Op() != spv::Op::OpISub) {
+            return std::nullopt;
+        }
+        std::optional<u32> increment;
+        if (step->words[3] == phi->id) {
+            increment = Constant(step->words[4]);
+        } else if (is_add && step->words[4] == phi->id) {
+            increment = Constant(step->words[3]);
+        }
+        if (!increment) {
+            return std::nullopt;
+        }
+        u32 value = *initial;
+        for (size_t iteration = 0; iteration <= max_trip_count; ++iteration) {
+            const bool result = swapped ? EvaluateCompare(compare_op, *limit, value)
+                                        : EvaluateCompare(compare_op, value, *limit);
+            if (result != continue_on_true) {
+                return iteration;
+            }
+            value = is_add ? value + *increment : value - *increment;
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Replaces the loop with one copy of its blocks per iteration followed by a final copy of
+     * the header and the exit test that branches to the merge block.
+     */
+    void Unroll(const Loop& loop) {
+        const IR::Block& header_block = function.blocks[loop.header];
+        const u32 header_label = header_block.label;
+        std::vector<u32> header_labels(loop.trip_count + 1);
+        for (u32& label : header_labels) {
+            label = ++bound;
+        }
+        for (const HeaderPhi& phi : loop.phis) {
+            Remove(phi.id);
+        }
+        std::vector<IR::Block> unrolled;
+        std::unordered_map<u32, u32> map;
+        const auto resolve = [](const std::unordered_map<u32, u32>& ids, u32 id) {
+            const auto it = ids.find(id);
+            return it != ids.end() ? it->second : id;
+        };
+        for (size_t iteration = 0; iteration <= loop.trip_count; ++iteration) {
+            const bool is_last = iteration == loop.trip_count;
+            std::vector<size_t> blocks;
+            if (is_last) {
+                blocks.push_back(loop.header);
+                if (loop.exit != loop.header) {
+                    blocks.push_back(loop.exit);
+                }
+            } else {
+                blocks = loop.blocks;
+            }
+            std::unordered_map<u32, u32> next_map;
+            for (const HeaderPhi& phi : loop.phis) {
+                next_map[phi.id] = iteration == 0 ? phi.initial : resolve(map, phi.next);
+            }
+            for (const size_t index : blocks) {
+                const IR::Block& block = function.blocks[index];
+                const u32 label = index == loop.header ? header_labels[iteration] : ++bound;
+                next_map[block.label] = label;
+                AddClone(block.label, label);
+                for (const IR::Inst& inst : block.insts) {
+                    const u32 result = inst.Result();
+                    if (result != 0 && !next_map.contains(result)) {
+                        next_map[result] = ++bound;
+                        AddClone(result, next_map[result]);
+                    }
+                }
+            }
+            map = std::move(next_map);
+            for (const size_t index : blocks) {
+                const IR::Block& block = function.blocks[index];
+                IR::Block& clone = unrolled.emplace_back();
+                clone.label = map.at(block.label);
+                for (const IR::Inst& inst : block.insts) {
+                    const spv::Op op = inst.Op();
+                    if (index == loop.header && (op == spv::Op::OpPhi || &inst == block.Merge())) {
+                        continue;
+                    }
+                    if (index == loop.exit && &inst == &block.Terminator()) {
+                        const u32 target = is_last ? loop.merge_label : map.at(loop.body_label);
+                        clone.insts.push_back(Branch(target));
+                        continue;
+                    }
+                    if (index == loop.latch && &inst == &block.Terminator()) {
+                        clone.insts.push_back(Branch(header_labels[iteration + 1]));
+                        continue;
+                    }
+                    IR::Inst& copy = clone.insts.emplace_back(inst);
+                    const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                    IR::ForEachId(
+                        copy.words,
+                        [&](size_t word) { copy.words[word] = resolve(map, copy.words[word]); },
+                        literal_words);
+                }
+            }
+        }
+
+        // Uses after the loop observe the values of the final exit test, and phi nodes in the
+        // merge block come from its copy of the header. Only the preheader enters the first copy.
+        map[header_label] = header_labels.back();
+        std::vector<IR::Block> blocks;
+        blocks.reserve(function.blocks.size() + unrolled.size());
+        for (size_t index = 0; index < function.blocks.size(); ++index) {
+            if (index == loop.header) {
+                std::ranges::move(unrolled, std::back_inserter(blocks));
+                continue;
+            }
+            if (std::ranges::find(loop.blocks, index) != loop.blocks.end()) {
+                continue;
+            }
+            IR::Block& block = blocks.emplace_back(std::move(function.blocks[index]));
+            for (IR::Inst& inst : block.insts) {
+                const bool is_entry = index == loop.preheader && &inst == &block.insts.back();
+                const size_t literal_words = IR::SwitchLiteralWords(function, inst, table);
+                IR::ForEachIdOperand(
+                    inst.words,
+                    [&](size_t word) {
+                        u32& id = inst.words[word];
+                        id = is_entry && id == header_label ? header_labels.front()
+                                                            : resolve(map, id);
+                    },
+                    literal_words);
+            }
+        }
+        function.blocks = std::move(blocks);
+    }
+
+    static IR::Inst Branch(u32 target) {
+        return IR::Inst{{IR::MakeWord0(spv::Op::OpBranch, 2), target}};
+    }
+
+    /// Records a copy of an id, ids cloned from earlier copies are tracked by their original id.
+    void AddClone(u32 id, u32 clone) {
+        const auto it = origins.find(id);
+        const u32 origin = it != origins.end() ? it->second : id;
+        std::vector<u32>& list = clones[origin];
+        std::erase(list, id);
+        list.push_back(clone);
+        origins.emplace(clone, origin);
+    }
+
+    /// Records an id that no longer exists after unrolling.
+    void Remove(u32 id) {
+        const auto it = origins.find(id);
+        if (it == origins.end()) {
+            clones[id];
+        } else {
+            std::erase(clones[it->second], id);
+        }
+    }
+
+    IR::Function& function;
+    const IR::DeclarationTable& table;
+    u32& bound;
+    std::unordered_map<u32, std::vector<u32>>& clones;
+    std::unordered_map<u32, u32>& origins;
+    u32 max_trip_count;
+    bool unroll_unmarked;
+};
+
+} // Anonymous namespace
+
+void Module::UnrollLoops(std::uint32_t max_trip_count, bool unroll_unmarked) {
+    SIRIT_TRACE_SCOPE("Module::UnrollLoops");
+    std::vector<IR::Function> functions = IR::ParseFunctions(code->Words());
+    const IR::DeclarationTable table{declarations->Words()};
+    std::unordered_map<u32, std::vector<u32>> clones;
+    std::unordered_map<u32, u32> origins;
+    bool changed = false;
+    for (IR::Function& function : functions) {
+        if (!function.blocks.empty()) {
+            Unroller unroller{function,       table,          bound, clones, origins,
+                              max_trip_count, unroll_unmarked};
+            changed |= unroller.Run();
+        }
+    }
+    if (!changed) {
+        return;
+    }
+    code->Assign(IR::Serialize(functions));
+    debug->Assign(IR::DuplicateTargets(debug->Words(), clones));
+    annotations->Assign(IR::DuplicateTargets(annotations->Words(), clones));
+    deferred_phi_nodes.clear();
+}
+
+} // namespace Sirit
@@ -0,0 +1,88 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <array>
+
+#include "common_types.h"
+
+/**
+ * Pair of polynomial hashes of a sequence of words modulo the Mersenne prime 2^61-1, computed
+ * with two independent bases. The hash of words w_0...w_n-1 for a base is the sum of
+ * (w_i + 1) * base^i, so words can be appended, replaced or removed at any position without
+ * rehashing the rest of the sequence. Two distinct sequences of n words collide with a
+ * probability of about (n / 2^61)^2 when they don't depend on the bases. The bases are fixed,
+ * so sequences can be crafted to collide.
+ */
+namespace Sirit::PolynomialHash {
+
+constexpr u64 MODULUS = (u64{1} << 61) - 1;
+
+/// Hash of a sequence, one value per base.
+using Value = std::array<u64, 2>;
+
+constexpr Value BASES{0x1d8e4e27c47d124fULL % MODULUS, 0x2f6b5c9e83a7d153ULL % MODULUS};
+constexpr Value ONE{1, 1};
+
+constexpr u64 Reduce(u64 value) noexcept {
+    value = (value & MODULUS) + (value >> 61);
+    return value >= MODULUS ? value - MODULUS : value;
+}
+
+constexpr u64 AddMod(u64 lhs, u64 rhs) noexcept {
+    return Reduce(lhs + rhs);
+}
+
+constexpr u64 SubMod(u64 lhs, u64 rhs) noexcept {
+    return Reduce(lhs + MODULUS - rhs);
+}
+
+/// Multiplies two reduced values without 128-bit integers.
+constexpr u64 MulMod(u64 lhs, u64 rhs) noexcept {
+    const u64 lhs_lo = lhs & 0xffffffff;
+    const u64 lhs_hi = lhs >> 32;
+    const u64 rhs_lo = rhs & 0xffffffff;
+    const u64 rhs_hi = rhs >> 32;
+    const u64 lo = lhs_lo * rhs_lo;
+    const u64 mid = lhs_lo * rhs_hi + lhs_hi * rhs_lo;
+    const u64 hi = lhs_hi * rhs_hi;
+    // 2^64 = 8 and 2^61 = 1 modulo 2^61-1
+    const u64 sum = (lo & MODULUS) + (lo >> 61) + (hi << 3) + (mid >> 29) + (mid << 35 >> 3);
+    return Reduce(Reduce(sum));
+}
+
+constexpr Value Add(const Value& lhs, const Value& rhs) noexcept {
+    return {AddMod(lhs[0], rhs[0]), AddMod(lhs[1], rhs[1])};
+}
+
+constexpr Value Sub(const Value& lhs, const Value& rhs) noexcept {
+    return {SubMod(lhs[0], rhs[0]), SubMod(lhs[1], rhs[1])};
+}
+
+constexpr Value Mul(const Value& lhs, const Value& rhs) noexcept {
+    return {MulMod(lhs[0], rhs[0]), MulMod(lhs[1], rhs[1])};
+}
+
+/// Returns the bases raised to exponent.
+constexpr Value Power(u64 exponent) noexcept {
+    Value result = ONE;
+    Value base = BASES;
+    for (; exponent != 0; exponent >>= 1) {
+        if ((exponent & 1) != 0) {
+            result = Mul(result, base);
+        }
+        base = Mul(base, base);
+    }
+    return result;
+}
+
+/// Returns the contribution of a word at the position with the given powers of the bases.
+constexpr Value Term(u32 word, const Value& power) noexcept {
+    return {MulMod(u64{word} + 1, power[0]), MulMod(u64{word} + 1, power[1])};
+}
+
+} // namespace Sirit::PolynomialHash
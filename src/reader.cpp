@@ -0,0 +1,110 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "common_types.h"
+#include "ir.h"
+#include "stream.h"
+
+namespace Sirit {
+
+std::unique_ptr<Module> Module::FromBinary(std::span<const std::uint32_t> binary) {
+    if (binary.size() < 5 || binary[0] != spv::MagicNumber || binary[3] == 0) {
+        return nullptr;
+    }
+    auto module = std::make_unique<Module>(binary[1]);
+    module->bound = binary[3] - 1;
+
+    bool in_functions = false;
+    // Line instructions aren't allowed in the debug section, the ones applying to global
+    // variables are kept in front of them and the ones applying to declarations are dropped
+    std::vector<u32> pending_line;
+    bool in_line = false;
+    for (const Instruction inst : Instructions(binary)) {
+        const spv::Op op = inst.opcode;
+        const std::span<const u32> words = inst.words;
+        if (op == spv::Op::OpFunction) {
+            in_functions = true;
+        }
+        if (in_functions) {
+            module->code->Append(words);
+            continue;
+        }
+        if (IR::IsDeclaration(op)) {
+            module->declarations->Restore(words, IR::ResultIndex(op));
+            continue;
+        }
+        switch (op) {
+        case spv::Op::OpCapability:
+            module->AddCapability(static_cast<spv::Capability>(words[1]));
+            break;
+        case spv::Op::OpExtension:
+            module->AddExtension(IR::LiteralString(words, 1));
+            break;
+        case spv::Op::OpExtInstImport:
+            if (IR::LiteralString(words, 2) == "GLSL.std.450") {
+                module->glsl_std_450 = Id{words[1]};
+            }
+            module->ext_inst_imports->Append(words);
+            break;
+        case spv::Op::OpMemoryModel:
+            module->addressing_model = static_cast<spv::AddressingModel>(words[1]);
+            module->memory_model = static_cast<spv::MemoryModel>(words[2]);
+            break;
+        case spv::Op::OpEntryPoint:
+            module->entry_points->Append(words);
+            break;
+        case spv::Op::OpExecutionMode:
+        case spv::Op::OpExecutionModeId:
+            module->execution_modes->Append(words);
+            break;
+        case spv::Op::OpString:
+        case spv::Op::OpSourceExtension:
+        case spv::Op::OpSource:
+        case spv::Op::OpSourceContinued:
+        case spv::Op::OpName:
+        case spv::Op::OpMemberName:
+        case spv::Op::OpModuleProcessed:
+            module->debug->Append(words);
+            break;
+        case spv::Op::OpLine:
+            pending_line.assign(words.begin(), words.end());
+            break;
+        case spv::Op::OpNoLine:
+            if (in_line) {
+                module->global_variables->Append(words);
+                in_line = false;
+            }
+            pending_line.clear();
+            break;
+        case spv::Op::OpDecorate:
+        case spv::Op::OpMemberDecorate:
+        case spv::Op::OpDecorationGroup:
+        case spv::Op::OpGroupDecorate:
+        case spv::Op::OpGroupMemberDecorate:
+        case spv::Op::OpDecorateId:
+        case spv::Op::OpDecorateString:
+        case spv::Op::OpMemberDecorateString:
+            module->annotations->Append(words);
+            break;
+        default:
+            if (!pending_line.empty()) {
+                module->global_variables->Append(pending_line);
+                pending_line.clear();
+                in_line = true;
+            }
+            module->global_variables->Append(words);
+            break;
+        }
+    }
+    return module;
+}
+
+} // namespace Sirit
@@ -0,0 +1,246 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sirit/sirit.h"
+
+#include "common_types.h"
+#include "ir.h"
+#include "recorder.h"
+#include "stream.h"
+
+namespace Sirit {
+
+void Module::StartRecording() {
+    recorder = std::make_unique<Recorder>(&bound, version);
+
+    // Snapshot the module so the trace doesn't depend on what was emitted before
+    for (const spv::Capability capability : capabilities) {
+        recorder->Values(TraceEvent::Capability, TraceSection::Module,
+                         {static_cast<u32>(capability)});
+    }
+    for (const std::string& extension : extensions) {
+        recorder->String(TraceEvent::Extension, extension);
+    }
+    recorder->Values(TraceEvent::MemoryModel, TraceSection::Module,
+                     {static_cast<u32>(addressing_model), static_cast<u32>(memory_model)});
+    const std::array<std::pair<Stream*, TraceSection>, 7> streams{{
+        {ext_inst_imports.get(), TraceSection::ExtInstImports},
+        {entry_points.get(), TraceSection::EntryPoints},
+        {execution_modes.get(), TraceSection::ExecutionModes},
+        {debug.get(), TraceSection::Debug},
+        {annotations.get(), TraceSection::Annotations},
+        {global_variables.get(), TraceSection::GlobalVariables},
+        {code.get(), TraceSection::Code},
+    }};
+    for (const auto& [stream, section] : streams) {
+        if (!stream->Words().empty()) {
+            recorder->Words(TraceEvent::Assign, section, stream->Words());
+        }
+        stream->SetRecorder(recorder.get(), section);
+    }
+    IR::ForEachInstruction(declarations->Words(), [this](std::span<const u32> inst) {
+        recorder->Words(TraceEvent::Restore, TraceSection::Declarations, inst);
+    });
+    declarations->SetRecorder(recorder.get());
+}
+
+std::vector<std::uint8_t> Module::StopRecording() {
+    if (!recorder) {
+        return {};
+    }
+    for (Stream* const stream : {ext_inst_imports.get(), entry_points.get(),
+                                 execution_modes.get(), debug.get(), annotations.get(),
+                                 global_variables.get(), code.get()}) {
+        stream->SetRecorder(nullptr, {});
+    }
+    declarations->SetRecorder(nullptr);
+    std::vector<u8> trace = std::move(*recorder).Finish();
+    recorder.reset();
+    return trace;
+}
+
+bool Module::Replay(std::span<const std::uint8_t> trace) {
+    if (trace.size() < TRACE_MAGIC.size() ||
+        !std::equal(TRACE_MAGIC.begin(), TRACE_MAGIC.end(), trace.begin())) {
+        return false;
+    }
+    VarintReader reader{trace, TRACE_MAGIC.size()};
+    version = static_cast<u32>(reader.Read());
+
+    const auto find_stream = [this](TraceSection section) -> Stream* {
+        switch (section) {
+        case TraceSection::ExtInstImports:
+            return ext_inst_imports.get();
+        case TraceSection::EntryPoints:
+            return entry_points.get();
+        case TraceSection::ExecutionModes:
+            return execution_modes.get();
+        case TraceSection::Debug:
+            return debug.get();
+        case TraceSection::Annotations:
+            return annotations.get();
+        case TraceSection::GlobalVariables:
+            return global_variables.get();
+        case TraceSection::Code:
+            return code.get();
+        default:
+            return nullptr;
+        }
+    };
+    std::vector<u32> words;
+    const auto read_words = [&] {
+        const u64 count = reader.Read();
+        // Each word takes at least one byte
+        if (count > reader.Remaining()) {
+            return false;
+        }
+        words.resize(static_cast<size_t>(count));
+        for (u32& word : words) {
+            word = static_cast<u32>(reader.Read());
+        }
+        return reader.Ok();
+    };
+
+    // Code flushed while recording, kept in front of the later code when there is no sink
+    std::vector<u32> flushed_code;
+    u32 recorded_bound = 0;
+    while (reader.Ok() && !reader.Done()) {
+        const u8 header = reader.ReadBytes(1).front();
+        const auto event = static_cast<TraceEvent>(header >> TRACE_SECTION_BITS);
+        const auto section = static_cast<TraceSection>(header & ((1u << TRACE_SECTION_BITS) - 1));
+        // Deltas are relative to the bound of the previous event, not the bound after it
+        const s64 bound_delta = UnZigZag(reader.Read());
+        recorded_bound = static_cast<u32>(static_cast<s64>(recorded_bound) + bound_delta);
+        bound = recorded_bound;
+
+        if (section == TraceSection::Module) {
+            switch (event) {
+            case TraceEvent::Capability:
+                AddCapability(static_cast<spv::Capability>(reader.Read()));
+                break;
+            case TraceEvent::Extension: {
+                const std::span<const u8> name = reader.ReadBytes(reader.Read());
+                AddExtension(std::string(name.begin(), name.end()));
+                break;
+            }
+            case TraceEvent::MemoryModel: {
+                const auto addressing = static_cast<spv::AddressingModel>(reader.Read());
+                SetMemoryModel(addressing, static_cast<spv::MemoryModel>(reader.Read()));
+                break;
+            }
+            case TraceEvent::Bound:
+                if (!flushed_code.empty()) {
+                    const std::span<const u32> resident = code->Words();
+                    flushed_code.insert(flushed_code.end(), resident.begin(), resident.end());
+                    code->Assign(std::move(flushed_code));
+                }
+                // Later GLSL.std.450 instructions reuse the replayed import
+                IR::ForEachInstruction(ext_inst_imports->Words(), [&](std::span<const u32> inst) {
+                    if (IR::LiteralString(inst, 2) == "GLSL.std.450") {
+                        glsl_std_450 = Id{inst[1]};
+                    }
+                });
+                // Ends the trace, it tells complete traces apart from truncated ones
+                return reader.Ok() && reader.Done();
+            default:
+                return false;
+            }
+            continue;
+        }
+
+        if (section == TraceSection::Declarations) {
+            switch (event) {
+            case TraceEvent::Clear:
+                declarations->Clear();
+                break;
+            case TraceEvent::Instruction:
+            case TraceEvent::Restore: {
+                if (!read_words() || words.empty()) {
+                    return false;
+                }
+                const size_t result_index = IR::ResultIndex(IR::Opcode(words[0]));
+                if (result_index == 0 || result_index >= words.size()) {
+                    return false;
+                }
+                if (event == TraceEvent::Restore) {
+                    declarations->Restore(words, result_index);
+                } else {
+                    declarations->ReplayInstruction(words, result_index);
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+            continue;
+        }
+
+        Stream* const stream = find_stream(section);
+        if (!stream) {
+            return false;
+        }
+        switch (event) {
+        case TraceEvent::Instruction:
+            if (!read_words() || words.empty()) {
+                return false;
+            }
+            stream->ReplayInstruction(words);
+            break;
+        case TraceEvent::SetValue: {
+            const u64 index = reader.Read();
+            const u64 value = reader.Read();
+            if (index >= stream->Words().size()) {
+                return false;
+            }
+            stream->SetValue(static_cast<u32>(index), static_cast<u32>(value));
+            break;
+        }
+        case TraceEvent::Append:
+            if (!read_words()) {
+                return false;
+            }
+            stream->Append(words);
+            break;
+        case TraceEvent::Truncate: {
+            const u64 address = reader.Read();
+            if (address > stream->Words().size()) {
+                return false;
+            }
+            stream->Truncate(static_cast<u32>(address));
+            break;
+        }
+        case TraceEvent::Assign:
+            if (!read_words()) {
+                return false;
+            }
+            stream->Assign(words);
+            break;
+        case TraceEvent::Flush:
+            if (stream != code.get()) {
+                return false;
+            }
+            if (code_sink) {
+                FlushCode();
+            } else {
+                const std::span<const u32> resident = code->Words();
+                flushed_code.insert(flushed_code.end(), resident.begin(), resident.end());
+                code->Truncate(0);
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+} // namespace Sirit
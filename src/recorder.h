@@ -0,0 +1,105 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <array>
+#include <initializer_list>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common_types.h"
+#include "varint.h"
+
+namespace Sirit {
+
+constexpr std::array<u8, 4> TRACE_MAGIC{'S', 'P', 'T', '1'};
+
+/// Sections of a module as numbered in traces.
+enum class TraceSection : u8 {
+    ExtInstImports,
+    EntryPoints,
+    ExecutionModes,
+    Debug,
+    Annotations,
+    Declarations,
+    GlobalVariables,
+    Code,
+    Module,
+};
+
+/// Changes made to a module, each trace event stores one of them.
+enum class TraceEvent : u8 {
+    Instruction, ///< Instruction completed in a section, deduplicated in declarations
+    SetValue,    ///< Word overwritten in place
+    Append,      ///< Raw words appended to a section
+    Truncate,    ///< Words discarded after an address
+    Assign,      ///< Contents of a section replaced
+    Clear,       ///< Declarations emptied before being restored
+    Restore,     ///< Declaration appended keeping its result id
+    Capability,
+    Extension,
+    MemoryModel,
+    Bound, ///< Bound when the recording stopped, ends the trace
+    Flush, ///< Words passed to the code sink, later addresses are relative to the emptied stream
+};
+
+constexpr u32 TRACE_SECTION_BITS = 4;
+
+/**
+ * Writes the changes made to a module as a compact binary trace, replayed with Module::Replay.
+ * Events start with a byte holding their kind and section followed by the change of the bound
+ * since the previous event, their operands are stored as variable length integers.
+ */
+class Recorder {
+public:
+    explicit Recorder(const u32* bound_, u32 version) : bound{bound_} {
+        bytes.assign(TRACE_MAGIC.begin(), TRACE_MAGIC.end());
+        WriteVarint(bytes, version);
+    }
+
+    void Words(TraceEvent event, TraceSection section, std::span<const u32> words) {
+        Begin(event, section);
+        WriteVarint(bytes, words.size());
+        for (const u32 word : words) {
+            WriteVarint(bytes, word);
+        }
+    }
+
+    void Values(TraceEvent event, TraceSection section, std::initializer_list<u64> values) {
+        Begin(event, section);
+        for (const u64 value : values) {
+            WriteVarint(bytes, value);
+        }
+    }
+
+    void String(TraceEvent event, std::string_view string) {
+        Begin(event, TraceSection::Module);
+        WriteVarint(bytes, string.size());
+        bytes.insert(bytes.end(), string.begin(), string.end());
+    }
+
+    std::vector<u8> Finish() && {
+        Begin(TraceEvent::Bound, TraceSection::Module);
+        return std::move(bytes);
+    }
+
+private:
+    void Begin(TraceEvent event, TraceSection section) {
+        bytes.push_back(static_cast<u8>(static_cast<u32>(event) << TRACE_SECTION_BITS |
+                                        static_cast<u32>(section)));
+        WriteVarint(bytes, ZigZag(static_cast<s64>(*bound) - static_cast<s64>(last_bound)));
+        last_bound = *bound;
+    }
+
+    const u32* bound;
+    u32 last_bound = 0;
+    std::vector<u8> bytes;
+};
+
+} // namespace Sirit
@@ -4,12 +4,16 @@
  * 3-Clause BSD License
  */
 
+#include <algorithm>
 #include <cassert>
+#include <unordered_map>
 
 #include "sirit/sirit.h"
 
 #include "common_types.h"
+#include "function_table.h"
 #include "stream.h"
+#include "tracing.h"
 
 namespace Sirit {
 
@@ -17,58 +21,151 @@ constexpr u32 MakeWord0(spv::Op op, size_t word_count) {
     return static_cast<u32>(op) | static_cast<u32>(word_count) << 16;
 }
 
+/// Inserts a value into a sorted vector unless it's already present.
+template <typename T>
+void InsertSorted(std::vector<T>& values, T value) {
+    const auto it = std::ranges::lower_bound(values, value);
+    if (it == values.end() || *it != value) {
+        values.insert(it, std::move(value));
+    }
+}
+
 Module::Module(u32 version_)
     : version{version_}, ext_inst_imports{std::make_unique<Stream>(&bound)},
       entry_points{std::make_unique<Stream>(&bound)},
       execution_modes{std::make_unique<Stream>(&bound)}, debug{std::make_unique<Stream>(&bound)},
       annotations{std::make_unique<Stream>(&bound)}, declarations{std::make_unique<Declarations>(
                                                          &bound)},
-      global_variables{std::make_unique<Stream>(&bound)}, code{std::make_unique<Stream>(&bound)} {}
+      global_variables{std::make_unique<Stream>(&bound)}, code{std::make_unique<Stream>(&bound)} {
+    SIRIT_TRACE_INSTANT("Module::Module");
+}
 
 Module::~Module() = default;
 
 std::vector<u32> Module::Assemble() const {
+    SIRIT_TRACE_SCOPE("Module::Assemble");
     std::vector<u32> words = {spv::MagicNumber, version, GENERATOR_MAGIC_NUMBER, bound + 1, 0};
-    const auto insert = [&words](std::span<const u32> input) {
+    words.reserve(words.size() + capabilities.size() * 2);
+    ForEachSection([&words](std::span<const u32> input) {
         words.insert(words.end(), input.begin(), input.end());
-    };
+    });
+    return words;
+}
 
-    words.reserve(words.size() + capabilities.size() * 2);
+void Module::ForEachSection(const std::function<void(std::span<const u32>)>& func) const {
     for (const spv::Capability capability : capabilities) {
-        insert(std::array{
+        func(std::array{
             MakeWord0(spv::Op::OpCapability, 2),
             static_cast<u32>(capability),
         });
     }
 
+    std::vector<u32> extension_words;
     for (const std::string_view extension_name : extensions) {
-        size_t string_words = WordsInString(extension_name);
-        words.push_back(MakeWord0(spv::Op::OpExtension, string_words + 1));
-        size_t insert_index = words.size();
-        words.resize(words.size() + string_words);
-        InsertStringView(words, insert_index, extension_name);
+        const size_t string_words = WordsInString(extension_name);
+        extension_words.assign(string_words + 1, 0);
+        extension_words[0] = MakeWord0(spv::Op::OpExtension, string_words + 1);
+        size_t insert_index = 1;
+        InsertStringView(extension_words, insert_index, extension_name);
+        func(extension_words);
     }
 
-    insert(ext_inst_imports->Words());
+    func(ext_inst_imports->Words());
 
-    insert(std::array{
+    func(std::array{
         MakeWord0(spv::Op::OpMemoryModel, 3),
         static_cast<u32>(addressing_model),
         static_cast<u32>(memory_model),
     });
 
-    insert(entry_points->Words());
-    insert(execution_modes->Words());
-    insert(debug->Words());
-    insert(annotations->Words());
-    insert(declarations->Words());
-    insert(global_variables->Words());
-    insert(code->Words());
+    func(entry_points->Words());
+    func(execution_modes->Words());
+    func(debug->Words());
+    func(annotations->Words());
+    func(declarations->Words());
+    func(global_variables->Words());
+    func(code->Words());
+}
 
+std::vector<u32> Module::Assemble(PatchTable& patch_table) const {
+    std::vector<u32> words = Assemble();
+    const auto key = [](u32 target, spv::Decoration decoration) {
+        return static_cast<u64>(target) << 32 | static_cast<u32>(decoration);
+    };
+    std::unordered_map<u64, u32> literal_offsets;
+    std::unordered_map<u32, u32> default_offsets;
+    for (const Instruction inst : Instructions(words)) {
+        if (inst.opcode == spv::Op::OpFunction) {
+            break;
+        }
+        if (inst.opcode == spv::Op::OpDecorate && inst.words.size() == 4) {
+            const auto decoration = static_cast<spv::Decoration>(inst.words[2]);
+            const auto offset = static_cast<u32>(&inst.words[3] - words.data());
+            literal_offsets.try_emplace(key(inst.words[1], decoration), offset);
+        }
+        if (inst.opcode == spv::Op::OpSpecConstant && inst.words.size() > 3) {
+            const auto offset = static_cast<u32>(&inst.words[3] - words.data());
+            default_offsets.try_emplace(inst.words[2], offset);
+        }
+    }
+    patch_table.offsets.clear();
+    patch_table.offsets.reserve(patch_points.size());
+    for (const auto& [target, decoration] : patch_points) {
+        u32 offset = PatchTable::INVALID_OFFSET;
+        if (decoration) {
+            const auto it = literal_offsets.find(key(target, *decoration));
+            offset = it != literal_offsets.end() ? it->second : offset;
+        } else {
+            const auto it = default_offsets.find(target);
+            offset = it != default_offsets.end() ? it->second : offset;
+        }
+        patch_table.offsets.push_back(offset);
+    }
     return words;
 }
 
+std::array<std::uint64_t, 2> Module::ContentHash() const {
+    // One chain per base of the section hashes, seeded differently
+    std::array<u64, 2> states{version, ~u64{version}};
+    const auto mix_lanes = [&states](const std::array<u64, 2>& values) {
+        for (size_t index = 0; index < states.size(); ++index) {
+            // SplitMix64 finalizer
+            u64& state = states[index];
+            state ^= values[index];
+            state = (state ^ (state >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            state = (state ^ (state >> 27)) * 0x94d049bb133111ebULL;
+            state ^= state >> 31;
+        }
+    };
+    const auto mix = [&](u64 value) { mix_lanes({value, value}); };
+    const auto mix_hash = [&](size_t num_words, const PolynomialHash::Value& hash) {
+        mix(num_words);
+        mix_lanes(hash);
+    };
+    mix(bound);
+    for (const spv::Capability capability : capabilities) {
+        mix(static_cast<u32>(capability));
+    }
+    for (const std::string& extension_name : extensions) {
+        mix(extension_name.size());
+        for (const char character : extension_name) {
+            mix(static_cast<u8>(character));
+        }
+    }
+    mix(static_cast<u32>(addressing_model));
+    mix(static_cast<u32>(memory_model));
+    for (const Stream* const stream : {ext_inst_imports.get(), entry_points.get(),
+                                       execution_modes.get(), debug.get(), annotations.get()}) {
+        mix_hash(stream->Words().size(), stream->Hash());
+    }
+    mix_hash(declarations->Words().size(), declarations->Hash());
+    mix_hash(global_variables->Words().size(), global_variables->Hash());
+    mix_hash(code->FlushedWords() + code->Words().size(), code->Hash());
+    return states;
+}
+
 void Module::PatchDeferredPhi(const std::function<Id(std::size_t index)>& func) {
+    SIRIT_TRACE_SCOPE("Module::PatchDeferredPhi");
     for (const u32 phi_index : deferred_phi_nodes) {
         const u32 first_word = code->Value(phi_index);
         [[maybe_unused]] const spv::Op op = static_cast<spv::Op>(first_word & 0xffff);
@@ -82,20 +179,49 @@ void Module::PatchDeferredPhi(const std::function<Id(std::size_t index)>& func)
     }
 }
 
+void Module::SetCodeSink(std::function<void(std::span<const u32>)> sink) {
+    code_sink = std::move(sink);
+}
+
+void Module::FlushCode() {
+    assert(code_sink);
+    code->Flush(code_sink);
+    deferred_phi_nodes.clear();
+}
+
 void Module::AddExtension(std::string extension_name) {
-    extensions.insert(std::move(extension_name));
+    if (recorder) {
+        recorder->String(TraceEvent::Extension, extension_name);
+    }
+    InsertSorted(extensions, std::move(extension_name));
 }
 
 void Module::AddCapability(spv::Capability capability) {
-    capabilities.insert(capability);
+    if (recorder) {
+        recorder->Values(TraceEvent::Capability, TraceSection::Module,
+                         {static_cast<u32>(capability)});
+    }
+    InsertSorted(capabilities, capability);
 }
 
 void Module::SetMemoryModel(spv::AddressingModel addressing_model_,
                             spv::MemoryModel memory_model_) {
+    if (recorder) {
+        recorder->Values(TraceEvent::MemoryModel, TraceSection::Module,
+                         {static_cast<u32>(addressing_model_), static_cast<u32>(memory_model_)});
+    }
     addressing_model = addressing_model_;
     memory_model = memory_model_;
 }
 
+void Module::EnableFunctionDeduplication(bool enabled) {
+    if (!enabled) {
+        function_table.reset();
+    } else if (!function_table) {
+        function_table = std::make_unique<FunctionTable>();
+    }
+}
+
 void Module::AddEntryPoint(spv::ExecutionModel execution_model, Id entry_point,
                            std::string_view name, std::span<const Id> interfaces) {
     entry_points->Reserve(4 + WordsInString(name) + interfaces.size());
@@ -112,7 +238,7 @@ void Module::AddExecutionMode(Id entry_point, spv::ExecutionMode mode,
 Id Module::AddLabel(Id label) {
     assert(label.value != 0);
     code->Reserve(2);
-    *code << MakeWord0(spv::Op::OpLabel, 2) << label.value;
+    *code << spv::Op::OpLabel << label.value << EndOp{};
     return label;
 }
 
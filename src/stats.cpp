@@ -0,0 +1,118 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <span>
+
+#include "sirit/sirit.h"
+
+#include "common_types.h"
+#include "ir.h"
+#include "stream.h"
+
+namespace Sirit {
+
+namespace {
+
+SectionStats MakeSectionStats(std::string_view name, const Stream& stream) {
+    return SectionStats{
+        .name = name,
+        .words = stream.Words().size(),
+        .allocated_bytes = stream.AllocatedBytes(),
+        .growth_events = stream.GrowthEvents(),
+    };
+}
+
+} // Anonymous namespace
+
+ModuleStats Module::GetStats() const {
+    ModuleStats stats;
+    stats.bound = bound + 1;
+    ForEachSection([&stats](std::span<const u32> words) {
+        IR::ForEachInstruction(words, [&stats](std::span<const u32> inst) {
+            ++stats.opcode_counts[IR::Opcode(inst[0])];
+        });
+    });
+    stats.sections = {
+        MakeSectionStats("ext_inst_imports", *ext_inst_imports),
+        MakeSectionStats("entry_points", *entry_points),
+        MakeSectionStats("execution_modes", *execution_modes),
+        MakeSectionStats("debug", *debug),
+        MakeSectionStats("annotations", *annotations),
+        MakeSectionStats("declarations", declarations->Storage()),
+        MakeSectionStats("global_variables", *global_variables),
+        MakeSectionStats("code", *code),
+    };
+    stats.declaration_hits = declarations->Hits();
+    stats.declaration_misses = declarations->Misses();
+    stats.dedup_table_bytes = declarations->TableBytes();
+    return stats;
+}
+
+void Module::ShrinkToFit() {
+    for (Stream* const stream : {ext_inst_imports.get(), entry_points.get(),
+                                 execution_modes.get(), debug.get(), annotations.get(),
+                                 global_variables.get(), code.get()}) {
+        stream->ShrinkToFit();
+    }
+    declarations->ShrinkToFit();
+    extensions.shrink_to_fit();
+    capabilities.shrink_to_fit();
+    deferred_phi_nodes.shrink_to_fit();
+    patch_points.shrink_to_fit();
+}
+
+SectionSizes Module::GetSectionSizes() const {
+    return SectionSizes{
+        .ext_inst_imports = ext_inst_imports->HighWaterMark(),
+        .entry_points = entry_points->HighWaterMark(),
+        .execution_modes = execution_modes->HighWaterMark(),
+        .debug = debug->HighWaterMark(),
+        .annotations = annotations->HighWaterMark(),
+        .declarations = declarations->Storage().HighWaterMark(),
+        .global_variables = global_variables->HighWaterMark(),
+        .code = code->HighWaterMark(),
+        .unique_declarations = declarations->Size(),
+    };
+}
+
+void Module::ReserveSections(const SectionSizes& sizes) {
+    ext_inst_imports->ReserveCapacity(sizes.ext_inst_imports);
+    entry_points->ReserveCapacity(sizes.entry_points);
+    execution_modes->ReserveCapacity(sizes.execution_modes);
+    debug->ReserveCapacity(sizes.debug);
+    annotations->ReserveCapacity(sizes.annotations);
+    declarations->ReserveCapacity(sizes.declarations, sizes.unique_declarations);
+    global_variables->ReserveCapacity(sizes.global_variables);
+    code->ReserveCapacity(sizes.code);
+}
+
+void Module::EnableMappedStorage(bool enabled) {
+    for (Stream* const stream : {ext_inst_imports.get(), entry_points.get(),
+                                 execution_modes.get(), debug.get(), annotations.get(),
+                                 global_variables.get(), code.get()}) {
+        stream->EnableMapping(enabled);
+    }
+    declarations->EnableMapping(enabled);
+}
+
+void CapacityProfile::Record(const Module& module) {
+    const SectionSizes recorded = module.GetSectionSizes();
+    const auto record = [](std::size_t& high_water_mark, std::size_t size) {
+        high_water_mark = std::max(high_water_mark, size);
+    };
+    record(sizes.ext_inst_imports, recorded.ext_inst_imports);
+    record(sizes.entry_points, recorded.entry_points);
+    record(sizes.execution_modes, recorded.execution_modes);
+    record(sizes.debug, recorded.debug);
+    record(sizes.annotations, recorded.annotations);
+    record(sizes.declarations, recorded.declarations);
+    record(sizes.global_variables, recorded.global_variables);
+    record(sizes.code, recorded.code);
+    record(sizes.unique_declarations, recorded.unique_declarations);
+}
+
+} // namespace Sirit
@@ -6,11 +6,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <bit>
 #include <cassert>
 #include <concepts>
 #include <cstddef>
 #include <functional>
+#include <span>
 #include <string_view>
 #include <unordered_map>
 #include <variant>
@@ -24,6 +26,10 @@
 #include <spirv/unified1/spirv.hpp>
 
 #include "common_types.h"
+#include "polynomial_hash.h"
+#include "recorder.h"
+#include "word_buffer.h"
+#include "tracing.h"
 
 namespace Sirit {
 
@@ -45,8 +51,8 @@ inline size_t WordsInString(std::string_view string) {
     return string.size() / sizeof(u32) + 1;
 }
 
-inline void InsertStringView(std::vector<u32>& words, size_t& insert_index,
-                             std::string_view string) {
+template <typename Words>
+void InsertStringView(Words& words, size_t& insert_index, std::string_view string) {
     const size_t size = string.size();
     const auto read = [string, size](size_t offset) {
         return offset < size ? static_cast<u32>(string[offset]) : 0u;
@@ -70,25 +76,137 @@ public:
         if (insert_index + num_words <= words.size()) {
             return;
         }
+        const size_t capacity = words.capacity();
         words.resize(insert_index + num_words);
+        if (words.capacity() != capacity) {
+            ++growth_events;
+        }
+    }
+
+    /// Grows the storage to hold num_words in total without reallocating.
+    void ReserveCapacity(size_t num_words) {
+        words.reserve(num_words);
+    }
+
+    /// Moves the words to mapped storage growing in place once the stream is large.
+    void EnableMapping(bool enabled) noexcept {
+        words.EnableMapping(enabled);
+    }
+
+    /// Releases the words reserved past the last instruction.
+    void ShrinkToFit() {
+        words.resize(insert_index);
+        words.shrink_to_fit();
     }
 
     std::span<const u32> Words() const noexcept {
         return std::span(words.data(), insert_index);
     }
 
+    /// Returns the words used by instructions and reservations since the last shrink.
+    size_t HighWaterMark() const noexcept {
+        return words.size();
+    }
+
+    size_t AllocatedBytes() const noexcept {
+        return words.capacity() * sizeof(u32);
+    }
+
+    size_t GrowthEvents() const noexcept {
+        return growth_events;
+    }
+
     u32 LocalAddress() const noexcept {
-        return static_cast<u32>(words.size());
+        return static_cast<u32>(insert_index);
     }
 
     u32 Value(u32 index) const noexcept {
         return words[index];
     }
 
-    void SetValue(u32 index, u32 value) noexcept {
+    /// Records the changes made to the stream as the given section, or stops when null.
+    void SetRecorder(Recorder* recorder_, TraceSection section_) noexcept {
+        recorder = recorder_;
+        section = section_;
+    }
+
+    void SetValue(u32 index, u32 value) {
+        if (recorder) {
+            recorder->Values(TraceEvent::SetValue, section, {index, value});
+        }
+        if (index < hashed_index) {
+            const PolynomialHash::Value power = PolynomialHash::Power(index);
+            hash = PolynomialHash::Sub(hash, PolynomialHash::Term(words[index], power));
+            hash = PolynomialHash::Add(hash, PolynomialHash::Term(value, power));
+        }
         words[index] = value;
     }
 
+    /// Returns the hash of the words in the stream, updated as instructions are completed.
+    /// Flushed words are included as if they were still in the stream.
+    PolynomialHash::Value Hash() const noexcept {
+        UpdateHash();
+        if (flushed_words == 0) {
+            return hash;
+        }
+        const PolynomialHash::Value power = PolynomialHash::Power(flushed_words);
+        return PolynomialHash::Add(flushed_hash, PolynomialHash::Mul(power, hash));
+    }
+
+    /// Passes the words written so far to sink and empties the stream, keeping its storage.
+    void Flush(const std::function<void(std::span<const u32>)>& sink) {
+        if (recorder) {
+            recorder->Values(TraceEvent::Flush, section, {});
+        }
+        sink(Words());
+        flushed_hash = Hash();
+        flushed_words += insert_index;
+        insert_index = 0;
+        op_index = 0;
+        hash = {};
+        hash_power = PolynomialHash::ONE;
+        hashed_index = 0;
+    }
+
+    /// Returns the number of words passed to sinks.
+    size_t FlushedWords() const noexcept {
+        return flushed_words;
+    }
+
+    /// Appends raw words, returning them to allow patching in place.
+    std::span<u32> Append(std::span<const u32> new_words) {
+        if (recorder) {
+            recorder->Words(TraceEvent::Append, section, new_words);
+        }
+        Reserve(new_words.size());
+        const size_t offset = insert_index;
+        std::ranges::copy(new_words, words.begin() + static_cast<std::ptrdiff_t>(offset));
+        insert_index += new_words.size();
+        return std::span(words.data() + offset, new_words.size());
+    }
+
+    /// Discards the words written after address.
+    void Truncate(u32 address) {
+        if (recorder) {
+            recorder->Values(TraceEvent::Truncate, section, {address});
+        }
+        Rewind(address);
+        op_index = address;
+    }
+
+    /// Replaces the contents of the stream, used by passes rewriting a whole section.
+    void Assign(std::vector<u32> new_words) {
+        if (recorder) {
+            recorder->Words(TraceEvent::Assign, section, new_words);
+        }
+        words = std::move(new_words);
+        insert_index = words.size();
+        op_index = 0;
+        hash = {};
+        hash_power = PolynomialHash::ONE;
+        hashed_index = 0;
+    }
+
     Stream& operator<<(spv::Op op) {
         op_index = insert_index;
         words[insert_index++] = static_cast<u32>(op);
@@ -108,9 +226,23 @@ public:
     Id operator<<(EndOp) {
         const size_t num_words = insert_index - op_index;
         words[op_index] |= static_cast<u32>(num_words) << 16;
+        UpdateHash();
+        if (recorder) {
+            recorder->Words(TraceEvent::Instruction, section,
+                            std::span(words.data() + op_index, num_words));
+        }
         return Id{*bound};
     }
 
+    /// Completes a recorded instruction as if it had been written operand by operand.
+    Id ReplayInstruction(std::span<const u32> instruction) {
+        Reserve(instruction.size());
+        op_index = insert_index;
+        std::ranges::copy(instruction, words.begin() + static_cast<std::ptrdiff_t>(insert_index));
+        insert_index += instruction.size();
+        return *this << EndOp{};
+    }
+
     Stream& operator<<(u32 value) {
         words[insert_index++] = value;
         return *this;
@@ -196,10 +328,44 @@ public:
     }
 
 private:
+    /// Hashes the words written since the last update.
+    void UpdateHash() const noexcept {
+        for (; hashed_index < insert_index; ++hashed_index) {
+            hash = PolynomialHash::Add(hash, PolynomialHash::Term(words[hashed_index], hash_power));
+            hash_power = PolynomialHash::Mul(hash_power, PolynomialHash::BASES);
+        }
+    }
+
+    /// Moves the insertion point back to address, removing the discarded words from the hash.
+    void Rewind(size_t address) noexcept {
+        if (address < hashed_index) {
+            PolynomialHash::Value power = PolynomialHash::Power(address);
+            hash_power = power;
+            for (size_t index = address; index < hashed_index; ++index) {
+                hash = PolynomialHash::Sub(hash, PolynomialHash::Term(words[index], power));
+                power = PolynomialHash::Mul(power, PolynomialHash::BASES);
+            }
+            hashed_index = address;
+        }
+        insert_index = address;
+    }
+
     u32* bound = nullptr;
-    std::vector<u32> words;
+    WordBuffer words;
     size_t insert_index = 0;
     size_t op_index = 0;
+    size_t flushed_words = 0;
+    PolynomialHash::Value flushed_hash{};
+
+    Recorder* recorder = nullptr;
+    TraceSection section{};
+
+    size_t growth_events = 0;
+
+    // Words before hashed_index are included in hash, hash_power is BASES^hashed_index
+    mutable PolynomialHash::Value hash{};
+    mutable PolynomialHash::Value hash_power = PolynomialHash::ONE;
+    mutable size_t hashed_index = 0;
 };
 
 class Declarations {
@@ -214,6 +380,50 @@ public:
         return stream.Words();
     }
 
+    PolynomialHash::Value Hash() const noexcept {
+        return stream.Hash();
+    }
+
+    const Stream& Storage() const noexcept {
+        return stream;
+    }
+
+    size_t Hits() const noexcept {
+        return hits;
+    }
+
+    size_t Misses() const noexcept {
+        return misses;
+    }
+
+    /// Estimates the bytes allocated by the lookup table, its buckets, nodes and keys.
+    size_t TableBytes() const noexcept {
+        using Node = std::pair<const std::vector<u32>, u32>;
+        size_t bytes = existing_declarations.bucket_count() * sizeof(void*);
+        for (const auto& [key, id] : existing_declarations) {
+            bytes += sizeof(Node) + sizeof(void*) + key.capacity() * sizeof(u32);
+        }
+        return bytes;
+    }
+
+    void ShrinkToFit() {
+        stream.ShrinkToFit();
+        existing_declarations.rehash(0);
+    }
+
+    size_t Size() const noexcept {
+        return existing_declarations.size();
+    }
+
+    void EnableMapping(bool enabled) noexcept {
+        stream.EnableMapping(enabled);
+    }
+
+    void ReserveCapacity(size_t num_words, size_t num_declarations) {
+        stream.ReserveCapacity(num_words);
+        existing_declarations.reserve(num_declarations);
+    }
+
     template <typename T>
     Declarations& operator<<(const T& value) {
         stream << value;
@@ -223,14 +433,62 @@ public:
     // Declarations without an id don't exist
     Declarations& operator<<(spv::Op) = delete;
 
+    /// Records the changes made to the declarations, or stops when null.
+    void SetRecorder(Recorder* recorder_) noexcept {
+        recorder = recorder_;
+    }
+
+    /// Removes every declaration, used by passes restoring a rewritten set of declarations.
+    void Clear() {
+        if (recorder) {
+            recorder->Values(TraceEvent::Clear, TraceSection::Declarations, {});
+        }
+        stream.Assign({});
+        existing_declarations.clear();
+    }
+
+    /// Appends an assembled declaration keeping its result id, registering it for lookups.
+    void Restore(std::span<const u32> declaration, size_t result_index) {
+        if (recorder) {
+            recorder->Words(TraceEvent::Restore, TraceSection::Declarations, declaration);
+        }
+        const std::span<u32> words = stream.Append(declaration);
+        if (IsSpecConstant(static_cast<spv::Op>(words[0] & 0xffff))) {
+            return;
+        }
+        std::vector<u32> key(words.begin(), words.end());
+        // Lookup keys are built before the word count is written
+        key[0] &= 0xffff;
+        const u32 id = std::exchange(key[result_index], 0);
+        existing_declarations.emplace(std::move(key), id);
+    }
+
     Declarations& operator<<(OpId op) {
         id_index = op.result_type.value != 0 ? 2 : 1;
         stream << op;
         return *this;
     }
 
+    /// Completes a recorded declaration as if it had been written operand by operand.
+    Id ReplayInstruction(std::span<const u32> declaration, size_t result_index) {
+        stream.Reserve(declaration.size());
+        stream.op_index = stream.insert_index;
+        std::ranges::copy(declaration, stream.words.begin() +
+                                           static_cast<std::ptrdiff_t>(stream.insert_index));
+        stream.insert_index += declaration.size();
+        id_index = result_index;
+        return *this << EndOp{};
+    }
+
     Id operator<<(EndOp) {
         const auto begin = stream.words.data();
+        if (recorder) {
+            recorder->Words(TraceEvent::Instruction, TraceSection::Declarations,
+                            std::span(begin + stream.op_index, begin + stream.insert_index));
+        }
+        if (IsSpecConstant(static_cast<spv::Op>(begin[stream.op_index] & 0xffff))) {
+            return stream << EndOp{};
+        }
         std::vector<u32> declarations(begin + stream.op_index, begin + stream.insert_index);
 
         // Normalize result id for lookups
@@ -238,16 +496,33 @@ public:
 
         const auto [entry, inserted] = existing_declarations.emplace(declarations, id);
         if (inserted) {
+            ++misses;
+            SIRIT_TRACE_INSTANT("Declarations::Insert");
             return stream << EndOp{};
         }
+        ++hits;
         // If the declaration already exists, undo the operation
-        stream.insert_index = stream.op_index;
+        stream.Rewind(stream.op_index);
         --*stream.bound;
 
         return Id{entry->second};
     }
 
 private:
+    /// Specialization constants are distinct even with identical operands, they are never merged.
+    static bool IsSpecConstant(spv::Op op) noexcept {
+        switch (op) {
+        case spv::Op::OpSpecConstantTrue:
+        case spv::Op::OpSpecConstantFalse:
+        case spv::Op::OpSpecConstant:
+        case spv::Op::OpSpecConstantComposite:
+        case spv::Op::OpSpecConstantOp:
+            return true;
+        default:
+            return false;
+        }
+    }
+
     struct HashVector {
         size_t operator()(const std::vector<u32>& vector) const noexcept {
             size_t hash = std::hash<size_t>{}(vector.size());
@@ -261,6 +536,9 @@ private:
     Stream stream;
     std::unordered_map<std::vector<u32>, u32, HashVector> existing_declarations;
     size_t id_index = 0;
+    Recorder* recorder = nullptr;
+    size_t hits = 0;
+    size_t misses = 0;
 };
 
 } // namespace Sirit
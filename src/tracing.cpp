@@ -0,0 +1,25 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include "tracing.h"
+
+#ifdef SIRIT_TRACING
+
+namespace Sirit {
+
+namespace Tracing {
+
+std::atomic<TracingHooks*> hooks{nullptr};
+
+} // namespace Tracing
+
+void SetTracingHooks(TracingHooks* new_hooks) noexcept {
+    Tracing::hooks.store(new_hooks, std::memory_order_release);
+}
+
+} // namespace Sirit
+
+#endif
@@ -0,0 +1,69 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#ifdef SIRIT_TRACING
+
+#include <atomic>
+#include <chrono>
+
+#include "sirit/sirit.h"
+
+#include "common_types.h"
+
+namespace Sirit::Tracing {
+
+extern std::atomic<TracingHooks*> hooks;
+
+inline u64 Now() noexcept {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+inline void Instant(const char* name) {
+    if (TracingHooks* const current = hooks.load(std::memory_order_acquire)) {
+        current->Instant(name, Now());
+    }
+}
+
+/// Reports a phase lasting for the lifetime of the object.
+class Scope {
+public:
+    explicit Scope(const char* name_)
+        : name{name_}, scope_hooks{hooks.load(std::memory_order_acquire)} {
+        if (scope_hooks) {
+            scope_hooks->Begin(name, Now());
+        }
+    }
+
+    ~Scope() {
+        if (scope_hooks) {
+            scope_hooks->End(name, Now());
+        }
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* name;
+    // Ends are sent to the hooks that saw the beginning, even if they were replaced meanwhile
+    TracingHooks* scope_hooks;
+};
+
+} // namespace Sirit::Tracing
+
+#define SIRIT_TRACE_SCOPE(name) const ::Sirit::Tracing::Scope sirit_trace_scope(name)
+#define SIRIT_TRACE_INSTANT(name) ::Sirit::Tracing::Instant(name)
+
+#else
+
+// Tracing is compiled out
+#define SIRIT_TRACE_SCOPE(name) static_cast<void>(0)
+#define SIRIT_TRACE_INSTANT(name) static_cast<void>(0)
+
+#endif
@@ -0,0 +1,87 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "common_types.h"
+
+namespace Sirit {
+
+/// Maps signed values to unsigned ones so values close to zero take few bytes.
+inline u64 ZigZag(s64 value) {
+    return (static_cast<u64>(value) << 1) ^ static_cast<u64>(value >> 63);
+}
+
+/// Inverse of ZigZag.
+inline s64 UnZigZag(u64 value) {
+    return static_cast<s64>(value >> 1) ^ -static_cast<s64>(value & 1);
+}
+
+/// Appends value using seven bits per byte, least significant bits first.
+inline void WriteVarint(std::vector<u8>& bytes, u64 value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<u8>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<u8>(value));
+}
+
+/// Reads integers written with WriteVarint, remembering whether the input was malformed.
+class VarintReader {
+public:
+    explicit VarintReader(std::span<const u8> bytes_, size_t offset_ = 0)
+        : bytes{bytes_}, offset{offset_} {}
+
+    u64 Read() {
+        u64 value = 0;
+        for (u32 shift = 0; shift < 64; shift += 7) {
+            if (offset >= bytes.size()) {
+                ok = false;
+                return 0;
+            }
+            const u8 byte = bytes[offset++];
+            value |= u64{byte & 0x7fu} << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    /// Reads count raw bytes, or an empty span when the input is too short.
+    std::span<const u8> ReadBytes(size_t count) {
+        if (count > Remaining()) {
+            ok = false;
+            return {};
+        }
+        const std::span<const u8> result = bytes.subspan(offset, count);
+        offset += count;
+        return result;
+    }
+
+    size_t Remaining() const noexcept {
+        return bytes.size() - offset;
+    }
+
+    bool Done() const noexcept {
+        return offset >= bytes.size();
+    }
+
+    bool Ok() const noexcept {
+        return ok;
+    }
+
+private:
+    std::span<const u8> bytes;
+    size_t offset;
+    bool ok = true;
+};
+
+} // namespace Sirit
@@ -0,0 +1,150 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "word_buffer.h"
+
+namespace Sirit {
+
+namespace {
+
+/// Mappings are sized in multiples of a huge page.
+constexpr size_t HUGE_PAGE_WORDS = (size_t{2} << 20) / sizeof(u32);
+
+/// Address space reserved by a new mapping, pages are only committed once written.
+constexpr size_t INITIAL_MAPPING_WORDS = (size_t{64} << 20) / sizeof(u32);
+
+constexpr size_t RoundToHugePage(size_t num_words) {
+    return (num_words + HUGE_PAGE_WORDS - 1) / HUGE_PAGE_WORDS * HUGE_PAGE_WORDS;
+}
+
+} // Anonymous namespace
+
+WordBuffer::~WordBuffer() {
+    Unmap();
+}
+
+WordBuffer& WordBuffer::operator=(std::vector<u32>&& new_words) {
+    Unmap();
+    heap = std::move(new_words);
+    SyncHeap();
+    return *this;
+}
+
+void WordBuffer::resize(size_t new_size) {
+    if (!UseMapping(new_size)) {
+        heap.resize(new_size);
+        SyncHeap();
+        return;
+    }
+    if (new_size > words_capacity) {
+        Remap(new_size);
+    }
+    if (new_size > words_size) {
+        std::fill(words_data + words_size, words_data + new_size, 0u);
+    }
+    words_size = new_size;
+}
+
+void WordBuffer::reserve(size_t new_capacity) {
+    if (!UseMapping(new_capacity)) {
+        heap.reserve(new_capacity);
+        SyncHeap();
+        return;
+    }
+    if (new_capacity > words_capacity) {
+        Remap(new_capacity);
+    }
+}
+
+void WordBuffer::shrink_to_fit() {
+    if (!mapped) {
+        heap.shrink_to_fit();
+        SyncHeap();
+        return;
+    }
+#ifdef __linux__
+    const size_t new_capacity = RoundToHugePage(std::max<size_t>(words_size, 1));
+    if (new_capacity < words_capacity) {
+        // Shrinking never moves the mapping
+        mremap(mapped, words_capacity * sizeof(u32), new_capacity * sizeof(u32), 0);
+        words_capacity = new_capacity;
+    }
+#endif
+}
+
+void WordBuffer::EnableMapping(bool enabled) noexcept {
+#ifdef __linux__
+    mapping_enabled = enabled;
+#else
+    static_cast<void>(enabled);
+#endif
+}
+
+bool WordBuffer::UseMapping(size_t num_words) {
+    return mapped || (mapping_enabled && num_words >= MAPPED_THRESHOLD && Map(num_words));
+}
+
+bool WordBuffer::Map([[maybe_unused]] size_t num_words) {
+#ifdef __linux__
+    const size_t new_capacity = RoundToHugePage(std::max(num_words * 2, INITIAL_MAPPING_WORDS));
+    void* const pointer = mmap(nullptr, new_capacity * sizeof(u32), PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pointer == MAP_FAILED) {
+        // Keep growing on the heap
+        return false;
+    }
+    madvise(pointer, new_capacity * sizeof(u32), MADV_HUGEPAGE);
+    mapped = static_cast<u32*>(pointer);
+    if (!heap.empty()) {
+        std::memcpy(mapped, heap.data(), heap.size() * sizeof(u32));
+    }
+    words_data = mapped;
+    words_size = heap.size();
+    words_capacity = new_capacity;
+    std::vector<u32>{}.swap(heap);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void WordBuffer::Remap([[maybe_unused]] size_t num_words) {
+#ifdef __linux__
+    const size_t new_capacity = RoundToHugePage(std::max(num_words, words_capacity * 2));
+    // The kernel moves the page tables instead of the words when the range can't grow in place
+    void* const pointer = mremap(mapped, words_capacity * sizeof(u32),
+                                 new_capacity * sizeof(u32), MREMAP_MAYMOVE);
+    if (pointer == MAP_FAILED) {
+        throw std::bad_alloc{};
+    }
+    madvise(pointer, new_capacity * sizeof(u32), MADV_HUGEPAGE);
+    mapped = static_cast<u32*>(pointer);
+    words_data = mapped;
+    words_capacity = new_capacity;
+#endif
+}
+
+void WordBuffer::Unmap() noexcept {
+    if (!mapped) {
+        return;
+    }
+#ifdef __linux__
+    munmap(mapped, words_capacity * sizeof(u32));
+#endif
+    mapped = nullptr;
+    SyncHeap();
+}
+
+} // namespace Sirit
@@ -0,0 +1,106 @@
+/* This file is part of the sirit project.
+ * Copyright (c) 2019 sirit
+ * This software may be used and distributed according to the terms of the
+ * 3-Clause BSD License
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "common_types.h"
+
+namespace Sirit {
+
+/**
+ * Storage of the words of a stream, mirroring the subset of std::vector used by Stream.
+ * Words are kept on the heap until mapping is enabled and the buffer grows past
+ * MAPPED_THRESHOLD. They are then moved once to a large anonymous mapping that is committed
+ * lazily, uses transparent huge pages when available and grows without copying the words.
+ * Mapping is only available on Linux; elsewhere the buffer always stays on the heap.
+ */
+class WordBuffer {
+public:
+    /// Size in words from which mapped storage is used.
+    static constexpr size_t MAPPED_THRESHOLD = size_t{1} << 18;
+
+    WordBuffer() = default;
+    ~WordBuffer();
+
+    WordBuffer(const WordBuffer&) = delete;
+    WordBuffer& operator=(const WordBuffer&) = delete;
+
+    /// Replaces the words, moving back to the heap.
+    WordBuffer& operator=(std::vector<u32>&& new_words);
+
+    u32& operator[](size_t index) noexcept {
+        return words_data[index];
+    }
+
+    const u32& operator[](size_t index) const noexcept {
+        return words_data[index];
+    }
+
+    u32* data() noexcept {
+        return words_data;
+    }
+
+    const u32* data() const noexcept {
+        return words_data;
+    }
+
+    u32* begin() noexcept {
+        return words_data;
+    }
+
+    u32* end() noexcept {
+        return words_data + words_size;
+    }
+
+    size_t size() const noexcept {
+        return words_size;
+    }
+
+    size_t capacity() const noexcept {
+        return words_capacity;
+    }
+
+    void resize(size_t new_size);
+
+    void reserve(size_t new_capacity);
+
+    void shrink_to_fit();
+
+    /// Allows moving large buffers to mapped storage.
+    void EnableMapping(bool enabled) noexcept;
+
+private:
+    /// Returns true when the buffer is mapped, mapping it first if it's going to be large.
+    bool UseMapping(size_t num_words);
+
+    /// Moves the heap words to a new mapping holding at least num_words.
+    bool Map(size_t num_words);
+
+    /// Grows the mapping to hold at least num_words, possibly moving its pages.
+    void Remap(size_t num_words);
+
+    void Unmap() noexcept;
+
+    /// Points to the heap words after they change.
+    void SyncHeap() noexcept {
+        words_data = heap.data();
+        words_size = heap.size();
+        words_capacity = heap.capacity();
+    }
+
+    std::vector<u32> heap;
+    u32* mapped = nullptr;
+
+    u32* words_data = nullptr;
+    size_t words_size = 0;
+    size_t words_capacity = 0;
+    bool mapping_enabled = false;
+};
+
+} // namespace Sirit
@@ -4,12 +4,18 @@
  * 3-Clause BSD License
  */
 
+#include <algorithm>
+#include <array>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include <sirit/emission_driver.h>
 #include <sirit/sirit.h>
 
 namespace {
@@ -325,6 +331,1447 @@ void test_compute_shader_execution_mode() {
     CHECK(found_entry_point);
 }
 
+int CountOpcode(const std::vector<std::uint32_t>& code, spv::Op opcode) {
+    int count = 0;
+    for (const auto& inst : ParseInstructions(code)) {
+        count += inst.opcode == opcode ? 1 : 0;
+    }
+    return count;
+}
+
+void test_promote_local_variables() {
+    Sirit::Module m{0x00010300};
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_void = m.TypeVoid();
+    const auto t_bool = m.TypeBool();
+    const auto t_u32 = m.TypeInt(32, false);
+    const auto t_ptr = m.TypePointer(spv::StorageClass::Function, t_u32);
+    const auto zero = m.Constant(t_u32, 0u);
+    const auto one = m.Constant(t_u32, 1u);
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void, t_bool));
+    const auto condition = m.OpFunctionParameter(t_bool);
+    m.AddLabel();
+    const auto var = m.Name(m.AddLocalVariable(t_ptr, spv::StorageClass::Function), "var");
+    m.OpStore(var, zero);
+    const auto true_label = m.OpLabel();
+    const auto merge_label = m.OpLabel();
+    m.OpSelectionMerge(merge_label, spv::SelectionControlMask::MaskNone);
+    m.OpBranchConditional(condition, true_label, merge_label);
+    m.AddLabel(true_label);
+    m.OpStore(var, one);
+    m.OpBranch(merge_label);
+    m.AddLabel(merge_label);
+    const auto sum = m.OpIAdd(t_u32, m.OpLoad(t_u32, var), one);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.PromoteLocalVariables();
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpVariable) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpLoad) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpStore) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpName) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpPhi) == 1);
+
+    std::uint32_t phi = 0;
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpPhi) {
+            CHECK(inst.word_count == 7);
+            CHECK(inst.words[3] == zero.value || inst.words[5] == zero.value);
+            CHECK(inst.words[3] == one.value || inst.words[5] == one.value);
+            phi = inst.words[2];
+        }
+        if (inst.opcode == spv::Op::OpIAdd) {
+            CHECK(inst.words[2] == sum.value);
+            CHECK(inst.words[3] == phi);
+        }
+    }
+}
+
+void test_promote_local_variables_address_taken() {
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_u32 = m.TypeInt(32, false);
+    const auto t_ptr = m.TypePointer(spv::StorageClass::Function, t_u32);
+    const auto t_func = m.TypeFunction(t_void, t_ptr);
+
+    const auto callee = m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, t_func);
+    m.OpFunctionParameter(t_ptr);
+    m.AddLabel();
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const auto var = m.AddLocalVariable(t_ptr, spv::StorageClass::Function);
+    m.OpStore(var, m.Constant(t_u32, 7u));
+    m.OpFunctionCall(t_void, callee, var);
+    m.OpLoad(t_u32, var);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    const auto before = m.Assemble();
+    m.PromoteLocalVariables();
+    CHECK(m.Assemble() == before);
+}
+
+void test_forward_local_memory() {
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_u32 = m.TypeInt(32, false);
+    const auto t_func_ptr = m.TypePointer(spv::StorageClass::Function, t_u32);
+    const auto t_out_ptr = m.TypePointer(spv::StorageClass::Output, t_u32);
+    const auto out = m.AddGlobalVariable(t_out_ptr, spv::StorageClass::Output);
+    const auto one = m.Constant(t_u32, 1u);
+    const auto two = m.Constant(t_u32, 2u);
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const auto var = m.AddLocalVariable(t_func_ptr, spv::StorageClass::Function);
+    m.OpStore(var, one);
+    const auto a = m.OpLoad(t_u32, var);
+    m.OpStore(var, two);
+    const auto b = m.OpLoad(t_u32, var);
+    const auto c = m.OpLoad(t_u32, var);
+    m.OpStore(out, m.OpIAdd(t_u32, m.OpIAdd(t_u32, a, b), c));
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.ForwardLocalMemory();
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpLoad) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpStore) == 1);
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpIAdd && inst.words[3] == one.value) {
+            CHECK(inst.words[4] == two.value);
+        }
+    }
+}
+
+void test_forward_local_memory_barrier() {
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_u32 = m.TypeInt(32, false);
+    const auto t_ptr = m.TypePointer(spv::StorageClass::Private, t_u32);
+    const auto var = m.AddGlobalVariable(t_ptr, spv::StorageClass::Private);
+    const auto scope = m.Constant(t_u32, 2u);
+    const auto semantics = m.Constant(t_u32, 0x108u);
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    m.OpStore(var, m.Constant(t_u32, 3u));
+    m.OpControlBarrier(scope, scope, semantics);
+    m.OpLoad(t_u32, var);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.ForwardLocalMemory();
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpLoad) == 1);
+    CHECK(CountOpcode(code, spv::Op::OpStore) == 1);
+}
+
+void test_forward_local_memory_index_width() {
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_u32 = m.TypeInt(32, false);
+    const auto t_u64 = m.TypeInt(64, false);
+    const auto t_array = m.TypeArray(t_u32, m.Constant(t_u32, 4u));
+    const auto t_array_ptr = m.TypePointer(spv::StorageClass::Function, t_array);
+    const auto t_element_ptr = m.TypePointer(spv::StorageClass::Function, t_u32);
+    const auto t_out_ptr = m.TypePointer(spv::StorageClass::Output, t_u32);
+    const auto out = m.AddGlobalVariable(t_out_ptr, spv::StorageClass::Output);
+    const auto one = m.Constant(t_u32, 1u);
+    const auto two = m.Constant(t_u32, 2u);
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const auto var = m.AddLocalVariable(t_array_ptr, spv::StorageClass::Function);
+    const auto narrow = m.OpAccessChain(t_element_ptr, var, one);
+    const auto wide = m.OpAccessChain(t_element_ptr, var, m.Constant(t_u64, std::uint64_t{1}));
+    m.OpStore(narrow, one);
+    m.OpStore(wide, two);
+    m.OpStore(out, m.OpLoad(t_u32, narrow));
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.ForwardLocalMemory();
+    const auto code = m.Assemble();
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpStore && inst.words[1] == out.value) {
+            CHECK(inst.words[2] != one.value);
+        }
+    }
+}
+
+void test_fold_constant_branches() {
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_bool = m.TypeBool();
+    const auto t_u32 = m.TypeInt(32, false);
+    const auto one = m.Constant(t_u32, 1u);
+    const auto two = m.Constant(t_u32, 2u);
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const auto true_label = m.OpLabel();
+    const auto false_label = m.OpLabel();
+    const auto merge_label = m.OpLabel();
+    m.OpSelectionMerge(merge_label, spv::SelectionControlMask::MaskNone);
+    m.OpBranchConditional(m.ConstantFalse(t_bool), true_label, false_label);
+    m.AddLabel(true_label);
+    const auto dead_value = m.Name(m.OpIAdd(t_u32, one, one), "dead");
+    m.OpBranch(merge_label);
+    m.AddLabel(false_label);
+    m.OpBranch(merge_label);
+    m.AddLabel(merge_label);
+    const auto phi = m.OpPhi(t_u32, std::array{dead_value, true_label, two, false_label});
+    const auto sum = m.OpIAdd(t_u32, phi, one);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.FoldConstantBranches();
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpSelectionMerge) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpBranchConditional) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpPhi) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpName) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpLabel) == 3);
+    CHECK(CountOpcode(code, spv::Op::OpIAdd) == 1);
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpIAdd) {
+            CHECK(inst.words[2] == sum.value);
+            CHECK(inst.words[3] == two.value);
+        }
+    }
+}
+
+void test_fold_constant_switch_nested_break() {
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_bool = m.TypeBool();
+    const auto t_u32 = m.TypeInt(32, false);
+    const auto t_ptr = m.TypePointer(spv::StorageClass::Private, t_bool);
+    const auto var = m.AddGlobalVariable(t_ptr, spv::StorageClass::Private);
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const auto case_label = m.OpLabel();
+    const auto default_label = m.OpLabel();
+    const auto inner_merge = m.OpLabel();
+    const auto merge_label = m.OpLabel();
+    m.OpSelectionMerge(merge_label, spv::SelectionControlMask::MaskNone);
+    const std::array<Sirit::Literal, 1> literals{1u};
+    const std::array labels{case_label};
+    m.OpSwitch(m.Constant(t_u32, 1u), default_label, literals, labels);
+    m.AddLabel(case_label);
+    const auto condition = m.OpLoad(t_bool, var);
+    m.OpSelectionMerge(inner_merge, spv::SelectionControlMask::MaskNone);
+    m.OpBranchConditional(condition, merge_label, inner_merge);
+    m.AddLabel(inner_merge);
+    m.OpBranch(merge_label);
+    m.AddLabel(default_label);
+    m.OpBranch(merge_label);
+    m.AddLabel(merge_label);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.FoldConstantBranches();
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpSelectionMerge) == 2);
+    CHECK(CountOpcode(code, spv::Op::OpLabel) == 4);
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpSwitch) {
+            CHECK(inst.word_count == 3);
+            CHECK(inst.words[2] == case_label.value);
+        }
+    }
+
+    // Folding again leaves the selection as it is
+    m.FoldConstantBranches();
+    CHECK(m.Assemble() == code);
+}
+
+void test_fold_constant_branches_loop() {
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_bool = m.TypeBool();
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const auto header = m.OpLabel();
+    const auto body = m.OpLabel();
+    const auto continue_label = m.OpLabel();
+    const auto merge_label = m.OpLabel();
+    m.OpBranch(header);
+    m.AddLabel(header);
+    m.OpLoopMerge(merge_label, continue_label, spv::LoopControlMask::MaskNone);
+    m.OpBranchConditional(m.ConstantTrue(t_bool), body, merge_label);
+    m.AddLabel(body);
+    m.OpReturn();
+    m.AddLabel(continue_label);
+    m.OpBranch(header);
+    m.AddLabel(merge_label);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    m.FoldConstantBranches();
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpLoopMerge) == 1);
+    CHECK(CountOpcode(code, spv::Op::OpLabel) == 5);
+    CHECK(CountOpcode(code, spv::Op::OpUnreachable) == 1);
+    CHECK(CountOpcode(code, spv::Op::OpBranchConditional) == 0);
+}
+
+// Emits a function summing the integers below limit in a loop.
+void EmitCountedLoop(Sirit::Module& m, spv::LoopControlMask control, std::uint32_t limit,
+                     bool merge_phi = false) {
+    const auto t_int = m.TypeInt(32, true);
+    const auto t_bool = m.TypeBool();
+
+    m.OpFunction(t_int, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_int));
+    const auto entry = m.AddLabel();
+    const auto header = m.OpLabel();
+    const auto body = m.OpLabel();
+    const auto continue_label = m.OpLabel();
+    const auto merge_label = m.OpLabel();
+    m.OpBranch(header);
+    m.AddLabel(header);
+    const std::array blocks{entry, continue_label};
+    const auto i = m.DeferredOpPhi(t_int, blocks);
+    const auto sum = m.DeferredOpPhi(t_int, blocks);
+    const auto condition = m.OpSLessThan(t_bool, i, m.Constant(t_int, limit));
+    m.OpLoopMerge(merge_label, continue_label, control);
+    m.OpBranchConditional(condition, body, merge_label);
+    m.AddLabel(body);
+    const auto next_sum = m.OpIAdd(t_int, sum, i);
+    m.OpBranch(continue_label);
+    m.AddLabel(continue_label);
+    const auto next_i = m.OpIAdd(t_int, i, m.Constant(t_int, 1));
+    m.OpBranch(header);
+    m.AddLabel(merge_label);
+    m.OpReturnValue(merge_phi ? m.OpPhi(t_int, std::array{sum, header}) : sum);
+    m.OpFunctionEnd();
+
+    const auto zero = m.Constant(t_int, 0);
+    const std::array<Sirit::Id, 4> values{zero, next_i, zero, next_sum};
+    m.PatchDeferredPhi([&](std::size_t index) { return values[index]; });
+}
+
+void test_unroll_loops() {
+    Sirit::Module m{0x00010300};
+    EmitCountedLoop(m, spv::LoopControlMask::Unroll, 4);
+
+    m.UnrollLoops(8);
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpLoopMerge) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpPhi) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpBranchConditional) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpSLessThan) == 5);
+    CHECK(CountOpcode(code, spv::Op::OpIAdd) == 8);
+}
+
+void test_unroll_loops_merge_phi() {
+    Sirit::Module m{0x00010300};
+    EmitCountedLoop(m, spv::LoopControlMask::Unroll, 4, true);
+    m.UnrollLoops(8);
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpLoopMerge) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpPhi) == 1);
+
+    // The phi's parent is the final copy of the exit test, the block branching to the merge
+    std::unordered_map<std::uint32_t, std::uint32_t> predecessor;
+    std::uint32_t block = 0;
+    std::uint32_t phi_block = 0;
+    std::uint32_t phi_parent = 0;
+    for (const Sirit::Instruction& inst : Sirit::Module::Instructions(code)) {
+        if (inst.opcode == spv::Op::OpLabel) {
+            block = inst.words[1];
+        } else if (inst.opcode == spv::Op::OpBranch) {
+            predecessor[inst.words[1]] = block;
+        } else if (inst.opcode == spv::Op::OpPhi) {
+            phi_block = block;
+            phi_parent = inst.words[4];
+        }
+    }
+    CHECK(predecessor.contains(phi_block));
+    CHECK(predecessor[phi_block] == phi_parent);
+}
+
+void test_unroll_loops_limits() {
+    Sirit::Module dont_unroll{0x00010300};
+    EmitCountedLoop(dont_unroll, spv::LoopControlMask::DontUnroll, 4);
+    const auto dont_unroll_code = dont_unroll.Assemble();
+    dont_unroll.UnrollLoops(8);
+    CHECK(dont_unroll.Assemble() == dont_unroll_code);
+
+    Sirit::Module too_long{0x00010300};
+    EmitCountedLoop(too_long, spv::LoopControlMask::Unroll, 16);
+    const auto too_long_code = too_long.Assemble();
+    too_long.UnrollLoops(8);
+    CHECK(too_long.Assemble() == too_long_code);
+
+    Sirit::Module unmarked{0x00010300};
+    EmitCountedLoop(unmarked, spv::LoopControlMask::MaskNone, 4);
+    const auto unmarked_code = unmarked.Assemble();
+    unmarked.UnrollLoops(8, false);
+    CHECK(unmarked.Assemble() == unmarked_code);
+    unmarked.UnrollLoops(8);
+    CHECK(CountOpcode(unmarked.Assemble(), spv::Op::OpLoopMerge) == 0);
+}
+
+void test_unroll_loops_narrow_induction() {
+    // The 16-bit induction variable wraps before exceeding the limit, the loop never ends
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_short = m.TypeInt(16, true);
+    const auto t_bool = m.TypeBool();
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    const auto entry = m.AddLabel();
+    const auto header = m.OpLabel();
+    const auto body = m.OpLabel();
+    const auto continue_label = m.OpLabel();
+    const auto merge_label = m.OpLabel();
+    m.OpBranch(header);
+    m.AddLabel(header);
+    const auto i = m.DeferredOpPhi(t_short, std::array{entry, continue_label});
+    const auto condition = m.OpSLessThanEqual(t_bool, i, m.Constant(t_short, 32767));
+    m.OpLoopMerge(merge_label, continue_label, spv::LoopControlMask::Unroll);
+    m.OpBranchConditional(condition, body, merge_label);
+    m.AddLabel(body);
+    m.OpBranch(continue_label);
+    m.AddLabel(continue_label);
+    const auto next_i = m.OpIAdd(t_short, i, m.Constant(t_short, 1));
+    m.OpBranch(header);
+    m.AddLabel(merge_label);
+    m.OpReturn();
+    m.OpFunctionEnd();
+    const std::array values{m.Constant(t_short, 32765), next_i};
+    m.PatchDeferredPhi([&](std::size_t index) { return values[index]; });
+
+    const auto code = m.Assemble();
+    m.UnrollLoops(8);
+    CHECK(m.Assemble() == code);
+}
+
+void test_combine_composite_operations() {
+    Sirit::Module m{0x00010300};
+    const auto t_float = m.TypeFloat(32);
+    const auto t_vec4 = m.TypeVector(t_float, 4);
+    const auto scalar = m.Constant(t_float, 2.0f);
+
+    m.OpFunction(t_vec4, spv::FunctionControlMask::MaskNone,
+                 m.TypeFunction(t_vec4, t_vec4, t_vec4));
+    const auto v = m.OpFunctionParameter(t_vec4);
+    const auto u = m.OpFunctionParameter(t_vec4);
+    m.AddLabel();
+    const auto copy = m.OpCompositeConstruct(
+        t_vec4, m.OpCompositeExtract(t_float, v, 0u), m.OpCompositeExtract(t_float, v, 1u),
+        m.OpCompositeExtract(t_float, v, 2u), m.OpCompositeExtract(t_float, v, 3u));
+    const auto swizzle = m.OpCompositeConstruct(
+        t_vec4, m.OpCompositeExtract(t_float, v, 2u), m.OpCompositeExtract(t_float, u, 1u),
+        m.OpCompositeExtract(t_float, v, 0u), m.OpCompositeExtract(t_float, u, 3u));
+    const auto inserted = m.OpCompositeInsert(t_vec4, scalar, v, 1u);
+    const auto forwarded = m.OpCompositeExtract(t_float, inserted, 1u);
+    const auto result = m.OpCompositeInsert(t_vec4, forwarded, swizzle, 0u);
+    m.OpReturnValue(m.OpFAdd(t_vec4, copy, result));
+    m.OpFunctionEnd();
+
+    m.CombineCompositeOperations();
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpCompositeExtract) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpCompositeConstruct) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpCompositeInsert) == 1);
+    CHECK(CountOpcode(code, spv::Op::OpVectorShuffle) == 1);
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpVectorShuffle) {
+            const std::vector<std::uint32_t> expected{t_vec4.value, swizzle.value, v.value,
+                                                      u.value,      2,             5,
+                                                      0,            7};
+            CHECK(std::vector<std::uint32_t>(inst.words + 1, inst.words + inst.word_count) ==
+                  expected);
+        }
+        if (inst.opcode == spv::Op::OpCompositeInsert) {
+            CHECK(inst.words[3] == scalar.value);
+            CHECK(inst.words[4] == swizzle.value);
+        }
+        if (inst.opcode == spv::Op::OpFAdd) {
+            CHECK(inst.words[3] == v.value);
+        }
+    }
+}
+
+void test_combine_composite_shuffles() {
+    Sirit::Module m{0x00010300};
+    const auto t_float = m.TypeFloat(32);
+    const auto t_vec2 = m.TypeVector(t_float, 2);
+    const auto t_vec4 = m.TypeVector(t_float, 4);
+
+    m.OpFunction(t_vec4, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_vec4, t_vec4));
+    const auto v = m.OpFunctionParameter(t_vec4);
+    m.AddLabel();
+    const auto reversed = m.OpVectorShuffle(t_vec4, v, v, 3u, 2u, 1u, 0u);
+    const auto low = m.OpVectorShuffle(t_vec2, reversed, reversed, 3u, 2u);
+    const auto high = m.OpVectorShuffle(t_vec2, reversed, reversed, 1u, 0u);
+    m.OpReturnValue(m.OpCompositeConstruct(t_vec4, low, high));
+    m.OpFunctionEnd();
+
+    m.CombineCompositeOperations();
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpVectorShuffle) == 0);
+    CHECK(CountOpcode(code, spv::Op::OpCompositeConstruct) == 0);
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpReturnValue) {
+            CHECK(inst.words[1] == v.value);
+        }
+    }
+}
+
+// Emits a helper function scaling its parameter by a constant.
+Sirit::Id EmitScaleHelper(Sirit::Module& m, float scale) {
+    const auto t_float = m.TypeFloat(32);
+    m.OpFunction(t_float, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_float, t_float));
+    const auto value = m.OpFunctionParameter(t_float);
+    m.Name(value, "value");
+    m.AddLabel();
+    m.OpReturnValue(m.OpFMul(t_float, value, m.Constant(t_float, scale)));
+    return m.OpFunctionEnd();
+}
+
+void test_function_deduplication() {
+    Sirit::Module m{0x00010300};
+    m.EnableFunctionDeduplication();
+    const auto first = EmitScaleHelper(m, 2.0f);
+    const auto second = EmitScaleHelper(m, 2.0f);
+    const auto third = EmitScaleHelper(m, 3.0f);
+    CHECK(first.value == second.value);
+    CHECK(first.value != third.value);
+
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpFunction) == 2);
+    CHECK(CountOpcode(code, spv::Op::OpName) == 2);
+
+    Sirit::Module disabled{0x00010300};
+    const auto a = EmitScaleHelper(disabled, 2.0f);
+    const auto b = EmitScaleHelper(disabled, 2.0f);
+    CHECK(a.value != b.value);
+    CHECK(CountOpcode(disabled.Assemble(), spv::Op::OpFunction) == 2);
+}
+
+void EmitDeferredPhiHelper(Sirit::Module& m) {
+    const auto t_void = m.TypeVoid();
+    const auto t_float = m.TypeFloat(32);
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    const auto entry = m.AddLabel();
+    const auto body = m.OpLabel();
+    m.OpBranch(body);
+    m.AddLabel(body);
+    m.DeferredOpPhi(t_float, std::array{entry});
+    m.OpReturn();
+    m.OpFunctionEnd();
+    m.PatchDeferredPhi([&](std::size_t) { return m.Constant(t_float, 1.0f); });
+}
+
+void test_code_sink() {
+    Sirit::Module resident{0x00010300};
+    Sirit::Module streamed{0x00010300};
+    std::vector<std::uint32_t> streamed_code;
+    streamed.SetCodeSink([&streamed_code](std::span<const std::uint32_t> words) {
+        streamed_code.insert(streamed_code.end(), words.begin(), words.end());
+    });
+    for (Sirit::Module* const m : {&resident, &streamed}) {
+        for (int i = 0; i < 16; ++i) {
+            EmitScaleHelper(*m, static_cast<float>(i));
+        }
+    }
+    CHECK(!streamed_code.empty());
+    const auto code_bytes = [](const Sirit::Module& m) {
+        return m.GetStats().sections.back().allocated_bytes;
+    };
+    // Only the function being built is held by the module
+    CHECK(code_bytes(streamed) < code_bytes(resident));
+    CHECK(streamed.ContentHash() == resident.ContentHash());
+
+    // Functions with deferred phi nodes wait for an explicit flush
+    const std::size_t num_streamed = streamed_code.size();
+    EmitDeferredPhiHelper(resident);
+    EmitDeferredPhiHelper(streamed);
+    CHECK(streamed_code.size() == num_streamed);
+    streamed.FlushCode();
+    CHECK(streamed_code.size() > num_streamed);
+
+    std::vector<std::uint32_t> words = streamed.Assemble();
+    words.insert(words.end(), streamed_code.begin(), streamed_code.end());
+    CHECK(words == resident.Assemble());
+    CHECK(streamed.ContentHash() == resident.ContentHash());
+}
+
+void test_link_library() {
+    Sirit::Module library_module{0x00010300};
+    const auto scale = EmitScaleHelper(library_module, 2.0f);
+    library_module.Name(scale, "Scale");
+    const auto unused = EmitScaleHelper(library_module, 4.0f);
+    library_module.Name(unused, "Unused");
+    const auto library = library_module.Assemble();
+
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_float = m.TypeFloat(32);
+    const auto two = m.Constant(t_float, 2.0f);
+    const std::array<std::string_view, 2> imports{"Scale", "Missing"};
+    const auto linked = m.Link(library, imports);
+    CHECK(linked.size() == 2);
+    CHECK(Sirit::ValidId(linked[0]));
+    CHECK(!Sirit::ValidId(linked[1]));
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    m.OpFunctionCall(t_float, linked[0], two);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpTypeFloat) == 1);
+    CHECK(CountOpcode(code, spv::Op::OpConstant) == 1);
+    CHECK(CountOpcode(code, spv::Op::OpFunction) == 2);
+    CHECK(CountOpcode(code, spv::Op::OpName) == 2);
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpFunction && inst.words[2] == linked[0].value) {
+            CHECK(inst.words[1] == t_float.value);
+        }
+        if (inst.opcode == spv::Op::OpFMul) {
+            CHECK(inst.words[1] == t_float.value);
+            CHECK(inst.words[4] == two.value);
+        }
+    }
+}
+
+void test_link_string_decoration() {
+    Sirit::Module library_module{0x00010300};
+    const auto scale = EmitScaleHelper(library_module, 2.0f);
+    library_module.Name(scale, "Scale");
+    std::vector<std::uint32_t> library = library_module.Assemble();
+
+    // Annotate the function with a string, annotations come right before the first type
+    const std::array<std::uint32_t, 4> semantic{
+        4u << 16 | static_cast<std::uint32_t>(spv::Op::OpDecorateString), scale.value,
+        static_cast<std::uint32_t>(spv::Decoration::UserSemantic), 'a' | 'b' << 8 | 'c' << 16};
+    std::size_t offset = 5;
+    while (static_cast<spv::Op>(library[offset] & 0xffff) != spv::Op::OpTypeFloat) {
+        offset += library[offset] >> 16;
+    }
+    library.insert(library.begin() + static_cast<std::ptrdiff_t>(offset), semantic.begin(),
+                   semantic.end());
+
+    Sirit::Module m{0x00010300};
+    m.TypeVoid();
+    const std::array<std::string_view, 1> imports{"Scale"};
+    const auto linked = m.Link(library, imports);
+    CHECK(Sirit::ValidId(linked[0]));
+    std::size_t num_semantics = 0;
+    for (const Sirit::Instruction& inst : Sirit::Module::Instructions(m.Assemble())) {
+        if (inst.opcode == spv::Op::OpDecorateString) {
+            ++num_semantics;
+            CHECK(inst.words[1] == linked[0].value);
+            CHECK(std::ranges::equal(inst.words.subspan(2), std::span(semantic).subspan(2)));
+        }
+    }
+    CHECK(num_semantics == 1);
+}
+
+void test_fragment_instantiation() {
+    Sirit::Module m{0x00010300};
+    const auto t_void = m.TypeVoid();
+    const auto t_float = m.TypeFloat(32);
+
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const std::array input_types{t_float, t_float};
+    const auto fragment = m.CaptureFragment(input_types, [&](std::span<const Sirit::Id> inputs) {
+        const auto sum = m.Name(m.OpFAdd(t_float, inputs[0], inputs[1]), "sum");
+        const auto scaled = m.OpFMul(t_float, sum, m.Constant(t_float, 0.5f));
+        m.Decorate(scaled, spv::Decoration::RelaxedPrecision);
+        m.Name(t_float, "float");
+        return std::vector<Sirit::Id>{scaled};
+    });
+    // Names and decorations of the captured results go away with them
+    const auto captured = m.Assemble();
+    CHECK(CountOpcode(captured, spv::Op::OpFAdd) == 0);
+    CHECK(CountOpcode(captured, spv::Op::OpName) == 1);
+    CHECK(CountOpcode(captured, spv::Op::OpDecorate) == 0);
+    CHECK(fragment.id_count == 2);
+    CHECK(fragment.hole_offsets.size() == 2);
+
+    const auto a = m.Constant(t_float, 1.0f);
+    const auto b = m.Constant(t_float, 2.0f);
+    const std::array first_inputs{a, b};
+    const std::array second_inputs{b, b};
+    const auto first = m.InstantiateFragment(fragment, first_inputs);
+    const auto second = m.InstantiateFragment(fragment, second_inputs);
+    m.OpReturn();
+    m.OpFunctionEnd();
+
+    CHECK(first.size() == 1 && second.size() == 1);
+    CHECK(first[0].value != second[0].value);
+    const auto code = m.Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpFAdd) == 2);
+    CHECK(CountOpcode(code, spv::Op::OpFMul) == 2);
+    std::vector<std::uint32_t> results;
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpFAdd) {
+            results.push_back(inst.words[2]);
+            CHECK(inst.words[4] == b.value);
+        }
+        if (inst.opcode == spv::Op::OpFMul) {
+            CHECK(inst.words[3] == results.back());
+            CHECK(inst.words[2] == (results.size() == 1 ? first : second)[0].value);
+            CHECK(inst.words[2] < code[3]);
+        }
+    }
+}
+
+void test_from_binary() {
+    VertexModule source;
+    source.Generate();
+    const auto binary = source.Assemble();
+
+    const auto loaded = Sirit::Module::FromBinary(binary);
+    CHECK(loaded != nullptr);
+    if (!loaded) {
+        return;
+    }
+    CHECK(loaded->Assemble() == binary);
+    CHECK(Sirit::Module::FromBinary(std::span(binary).subspan(1)) == nullptr);
+
+    std::size_t num_instructions = 0;
+    for (const Sirit::Instruction inst : Sirit::Module::Instructions(binary)) {
+        CHECK(inst.words.size() == inst.words[0] >> 16);
+        ++num_instructions;
+    }
+    CHECK(num_instructions == ParseInstructions(binary).size());
+
+    // Declarations are deduplicated against the loaded ones and new ids extend the bound
+    const auto t_float = loaded->TypeFloat(32);
+    CHECK(t_float.value < binary[3]);
+    const auto t_void = loaded->TypeVoid();
+    loaded->OpFunction(t_void, spv::FunctionControlMask::MaskNone, loaded->TypeFunction(t_void));
+    loaded->AddLabel();
+    const auto value = loaded->OpFAbs(t_float, loaded->Constant(t_float, -1.0f));
+    CHECK(value.value >= binary[3]);
+    loaded->OpReturn();
+    loaded->OpFunctionEnd();
+
+    const auto code = loaded->Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpTypeFloat) == CountOpcode(binary, spv::Op::OpTypeFloat));
+    CHECK(CountOpcode(code, spv::Op::OpExtInstImport) == 1);
+    CHECK(CountOpcode(code, spv::Op::OpFunction) == CountOpcode(binary, spv::Op::OpFunction) + 1);
+}
+
+void test_from_binary_lines() {
+    VertexModule source;
+    source.Generate();
+    std::vector<std::uint32_t> binary = source.Assemble();
+    const auto find = [&binary](spv::Op op) {
+        std::size_t offset = 5;
+        while (static_cast<spv::Op>(binary[offset] & 0xffff) != op) {
+            offset += binary[offset] >> 16;
+        }
+        return static_cast<std::ptrdiff_t>(offset);
+    };
+    const std::array<std::uint32_t, 4> line{
+        4u << 16 | static_cast<std::uint32_t>(spv::Op::OpLine), 1u, 10u, 0u};
+    const std::uint32_t no_line = 1u << 16 | static_cast<std::uint32_t>(spv::Op::OpNoLine);
+
+    // One line applies to the first variable, the other one to the first type
+    const std::ptrdiff_t variable = find(spv::Op::OpVariable);
+    binary.insert(binary.begin() + variable + (binary[variable] >> 16), no_line);
+    binary.insert(binary.begin() + variable, line.begin(), line.end());
+    binary.insert(binary.begin() + find(spv::Op::OpTypeFloat), line.begin(), line.end());
+
+    const auto loaded = Sirit::Module::FromBinary(binary);
+    CHECK(loaded != nullptr);
+    if (!loaded) {
+        return;
+    }
+    const auto code = loaded->Assemble();
+    CHECK(CountOpcode(code, spv::Op::OpLine) == 1);
+    CHECK(CountOpcode(code, spv::Op::OpNoLine) == 1);
+    const auto insts = ParseInstructions(code);
+    for (std::size_t index = 0; index < insts.size(); ++index) {
+        if (insts[index].opcode == spv::Op::OpLine) {
+            CHECK(index + 2 < insts.size() && insts[index + 1].opcode == spv::Op::OpVariable);
+            CHECK(index + 2 < insts.size() && insts[index + 2].opcode == spv::Op::OpNoLine);
+        }
+    }
+}
+
+void test_patch_table() {
+    Sirit::Module m;
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_float = m.TypeFloat(32);
+    const auto t_ptr = m.TypePointer(spv::StorageClass::Uniform, t_float);
+    const auto buffer = m.AddGlobalVariable(t_ptr, spv::StorageClass::Uniform);
+    const auto set = m.DecoratePatchable(buffer, spv::Decoration::DescriptorSet, 0);
+    const auto binding = m.DecoratePatchable(buffer, spv::Decoration::Binding, 3);
+
+    // Decorations removed by passes leave their patch points unresolved
+    const auto t_void = m.TypeVoid();
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    m.AddLabel();
+    const auto local = m.AddLocalVariable(m.TypePointer(spv::StorageClass::Function, t_float),
+                                          spv::StorageClass::Function);
+    const auto missing = m.DecoratePatchable(local, spv::Decoration::Location, 1);
+    m.OpStore(local, m.Constant(t_float, 1.0f));
+    m.OpReturn();
+    m.OpFunctionEnd();
+    m.PromoteLocalVariables();
+
+    Sirit::PatchTable table;
+    auto code = m.Assemble(table);
+    CHECK(code == m.Assemble());
+    CHECK(table.offsets.size() == 3);
+    CHECK(table.offsets[binding] < code.size() && code[table.offsets[binding]] == 3);
+    CHECK(table.offsets[missing] == Sirit::PatchTable::INVALID_OFFSET);
+    CHECK(!table.Patch(code, missing, 2));
+
+    CHECK(table.Patch(code, set, 2));
+    CHECK(table.Patch(code, binding, 7));
+    std::vector<std::uint32_t> literals;
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpDecorate && inst.words[1] == buffer.value) {
+            literals.push_back(inst.words[3]);
+        }
+    }
+    CHECK((literals == std::vector<std::uint32_t>{2, 7}));
+}
+
+void test_patch_table_spec_constant() {
+    Sirit::Module m;
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_uint = m.TypeInt(32, false);
+    const auto workgroup_size = m.SpecConstant(t_uint, 64u);
+    const auto size_default = m.AddSpecConstantPatchPoint(workgroup_size);
+    const auto size_id = m.DecoratePatchable(workgroup_size, spv::Decoration::SpecId, 0);
+    const auto tile_size = m.SpecConstant(t_uint, 1u);
+    const auto tile_default = m.AddSpecConstantPatchPoint(tile_size);
+    m.Canonicalize();
+
+    Sirit::PatchTable table;
+    auto code = m.Assemble(table);
+    CHECK(table.offsets.size() == 3);
+    CHECK(table.offsets[size_default] < code.size() && code[table.offsets[size_default]] == 64);
+    CHECK(table.offsets[size_id] < code.size() && code[table.offsets[size_id]] == 0);
+    CHECK(table.offsets[tile_default] < code.size());
+
+    CHECK(table.Patch(code, size_default, 256));
+    std::vector<std::uint32_t> defaults;
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpSpecConstant) {
+            defaults.push_back(inst.words[3]);
+        }
+    }
+    CHECK(std::ranges::find(defaults, 256u) != defaults.end());
+    CHECK(std::ranges::find(defaults, 1u) != defaults.end());
+}
+
+void test_specialize() {
+    Sirit::Module m;
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_bool = m.TypeBool();
+    const auto t_uint = m.TypeInt(32, false);
+    const auto t_uvec2 = m.TypeVector(t_uint, 2);
+    const auto width = m.SpecConstant(t_uint, 4u);
+    const auto height = m.SpecConstant(t_uint, 4u);
+    const auto flag = m.SpecConstantTrue(t_bool);
+    CHECK(width.value != height.value);
+    CHECK(m.Constant(t_uint, 4u).value != width.value);
+    m.Decorate(width, spv::Decoration::SpecId, 0);
+    m.Decorate(height, spv::Decoration::SpecId, 1);
+    m.Decorate(flag, spv::Decoration::SpecId, 2);
+
+    const auto area = m.SpecConstantOp(t_uint, spv::Op::OpIMul, width, height);
+    const auto limit = m.Constant(t_uint, 16u);
+    const auto small = m.SpecConstantOp(t_bool, spv::Op::OpULessThan, area, limit);
+    const auto size = m.SpecConstantComposite(t_uvec2, width, height);
+    const std::array<Sirit::Id, 1> size_operand{size};
+    const std::array<std::uint32_t, 1> index{1};
+    const auto second = m.SpecConstantOp(t_uint, spv::Op::OpCompositeExtract, size_operand, index);
+
+    m.Specialize({{0, 3u}, {2, 0u}, {7, 1u}});
+    const auto code = m.Assemble();
+    std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> defs;
+    for (const auto& inst : ParseInstructions(code)) {
+        const auto op = static_cast<std::uint32_t>(inst.opcode);
+        CHECK(op < static_cast<std::uint32_t>(spv::Op::OpSpecConstantTrue) ||
+              op > static_cast<std::uint32_t>(spv::Op::OpSpecConstantOp));
+        CHECK(inst.opcode != spv::Op::OpDecorate || inst.words[2] != 1); // SpecId
+        if (inst.word_count > 2) {
+            defs[inst.words[2]].assign(inst.words, inst.words + inst.word_count);
+        }
+    }
+    const auto literal = [&](Sirit::Id id) { return defs[id.value].back(); };
+    CHECK(literal(width) == 3 && literal(height) == 4);
+    CHECK(literal(area) == 12 && literal(second) == 4);
+    CHECK(defs[small.value][0] == (3u << 16 | static_cast<std::uint32_t>(spv::Op::OpConstantTrue)));
+    CHECK(defs[flag.value][0] == (3u << 16 | static_cast<std::uint32_t>(spv::Op::OpConstantFalse)));
+    CHECK(static_cast<spv::Op>(defs[size.value][0] & 0xffff) == spv::Op::OpConstantComposite);
+
+    // Frozen constants take part in deduplication of later declarations
+    CHECK(m.Constant(t_uint, 12u).value == area.value);
+}
+
+void test_canonical_capability_order() {
+    const auto build = [](std::span<const spv::Capability> caps,
+                          std::span<const char* const> exts) {
+        Sirit::Module m;
+        for (const spv::Capability capability : caps) {
+            m.AddCapability(capability);
+        }
+        for (const char* const extension : exts) {
+            m.AddExtension(extension);
+        }
+        m.TypeVoid();
+        return m.Assemble();
+    };
+    const std::array caps{spv::Capability::Shader, spv::Capability::Int64,
+                          spv::Capability::Float16, spv::Capability::ImageQuery};
+    const std::array reversed_caps{spv::Capability::ImageQuery, spv::Capability::Float16,
+                                   spv::Capability::Shader, spv::Capability::Int64,
+                                   spv::Capability::Shader};
+    const std::array exts{"SPV_KHR_shader_draw_parameters", "SPV_EXT_demote_to_helper_invocation",
+                          "SPV_KHR_16bit_storage"};
+    const std::array reversed_exts{"SPV_KHR_16bit_storage", "SPV_KHR_shader_draw_parameters",
+                                   "SPV_EXT_demote_to_helper_invocation"};
+    const auto code = build(caps, exts);
+    CHECK(code == build(reversed_caps, reversed_exts));
+    CHECK(CountOpcode(code, spv::Op::OpCapability) == static_cast<int>(caps.size()));
+
+    std::vector<std::uint32_t> emitted;
+    for (const auto& inst : ParseInstructions(code)) {
+        if (inst.opcode == spv::Op::OpCapability) {
+            emitted.push_back(inst.words[1]);
+        }
+    }
+    CHECK(std::ranges::is_sorted(emitted));
+}
+
+std::vector<std::uint32_t> EmitFragmentShader(bool reversed, bool canonicalize) {
+    Sirit::Module m;
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_void = m.TypeVoid();
+    Sirit::Id t_float;
+    Sirit::Id one;
+    Sirit::Id two;
+    if (reversed) {
+        t_float = m.TypeFloat(32);
+        two = m.Constant(t_float, 2.0f);
+        one = m.Constant(t_float, 1.0f);
+    } else {
+        m.TypeInt(32, false);
+        t_float = m.TypeFloat(32);
+        one = m.Constant(t_float, 1.0f);
+        two = m.Constant(t_float, 2.0f);
+    }
+    const auto output = m.AddGlobalVariable(m.TypePointer(spv::StorageClass::Output, t_float),
+                                            spv::StorageClass::Output);
+    if (reversed) {
+        m.Decorate(output, spv::Decoration::Index, 0);
+        m.Decorate(output, spv::Decoration::Location, 0);
+        m.Name(output, "color");
+        m.Name(t_float, "float");
+        m.TypeInt(32, false);
+    } else {
+        m.Name(t_float, "float");
+        m.Name(output, "color");
+        m.Decorate(output, spv::Decoration::Location, 0);
+        m.Decorate(output, spv::Decoration::Index, 0);
+    }
+    const auto main = m.OpFunction(t_void, spv::FunctionControlMask::MaskNone,
+                                   m.TypeFunction(t_void));
+    m.AddLabel();
+    m.OpStore(output, m.OpFAdd(t_float, one, two));
+    m.OpReturn();
+    m.OpFunctionEnd();
+    m.AddEntryPoint(spv::ExecutionModel::Fragment, main, "main", output);
+    if (canonicalize) {
+        m.Canonicalize();
+    }
+    return m.Assemble();
+}
+
+void test_canonicalize() {
+    CHECK(EmitFragmentShader(false, false) != EmitFragmentShader(true, false));
+    const auto code = EmitFragmentShader(false, true);
+    CHECK(code == EmitFragmentShader(true, true));
+    CHECK(code.size() == EmitFragmentShader(false, false).size());
+    CHECK(code[3] == EmitFragmentShader(false, false)[3]);
+
+    // Canonical forms are stable and the module keeps deduplicating declarations
+    Sirit::Module m;
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_float = m.TypeFloat(32);
+    m.Constant(t_float, 1.0f);
+    m.TypeVoid();
+    m.Canonicalize();
+    const auto canonical = m.Assemble();
+    m.Canonicalize();
+    CHECK(m.Assemble() == canonical);
+    const auto t_void = m.TypeVoid();
+    CHECK(t_void.value == 1);
+    CHECK(m.Assemble() == canonical);
+}
+
+/// Emits integer and float constants and their nulls, declaring the types in either order.
+std::vector<std::uint32_t> EmitCanonicalConstants(bool reversed) {
+    Sirit::Module m;
+    m.AddCapability(spv::Capability::Shader);
+    Sirit::Id t_int;
+    Sirit::Id t_float;
+    if (reversed) {
+        t_float = m.TypeFloat(32);
+        t_int = m.TypeInt(32, true);
+    } else {
+        t_int = m.TypeInt(32, true);
+        t_float = m.TypeFloat(32);
+    }
+    const auto int2 = m.TypeVector(t_int, 2);
+    m.Constant(t_int, 7);
+    m.Constant(t_float, 7.0f);
+    m.ConstantNull(t_int);
+    m.ConstantNull(int2);
+    m.Canonicalize();
+    return m.Assemble();
+}
+
+void test_canonicalize_result_types() {
+    const auto code = EmitCanonicalConstants(false);
+    CHECK(code == EmitCanonicalConstants(true));
+
+    // Result types are declared before the constants using them
+    std::vector<std::uint32_t> defined;
+    for (const Sirit::Instruction& inst : Sirit::Module::Instructions(code)) {
+        if (inst.opcode == spv::Op::OpConstant || inst.opcode == spv::Op::OpConstantNull) {
+            CHECK(std::ranges::find(defined, inst.words[1]) != defined.end());
+            defined.push_back(inst.words[2]);
+        } else if (inst.opcode == spv::Op::OpTypeInt || inst.opcode == spv::Op::OpTypeFloat ||
+                   inst.opcode == spv::Op::OpTypeVector) {
+            defined.push_back(inst.words[1]);
+        }
+    }
+    CHECK(CountOpcode(code, spv::Op::OpConstantNull) == 2);
+}
+
+/// Emits a function merging a constant with a phi, optionally deferring the phi operands.
+std::array<std::uint64_t, 2> EmitPhiModuleHash(bool deferred) {
+    Sirit::Module m;
+    m.AddCapability(spv::Capability::Shader);
+    const auto t_void = m.TypeVoid();
+    const auto t_float = m.TypeFloat(32);
+    const auto value = m.Constant(t_float, 1.0f);
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    const auto entry = m.AddLabel();
+    const auto merge = m.OpLabel();
+    m.OpBranch(merge);
+    m.AddLabel(merge);
+    if (deferred) {
+        m.DeferredOpPhi(t_float, std::array{entry});
+    } else {
+        m.OpPhi(t_float, std::array{value, entry});
+    }
+    m.OpReturn();
+    m.OpFunctionEnd();
+    if (deferred) {
+        m.PatchDeferredPhi([&](std::size_t) { return value; });
+    }
+    return m.ContentHash();
+}
+
+void test_content_hash() {
+    VertexModule first;
+    first.Generate();
+    VertexModule second;
+    second.Generate();
+    CHECK(first.ContentHash() == second.ContentHash());
+
+    // Deduplicated declarations are rolled back from the hash
+    const auto hash = first.ContentHash();
+    first.TypeFloat(32);
+    first.Constant(first.TypeFloat(32), 1.0f);
+    CHECK(first.ContentHash() == hash);
+    first.Constant(first.TypeFloat(32), 3.0f);
+    CHECK(first.ContentHash() != hash);
+
+    // Words patched in place and loaded modules are hashed like emitted ones
+    CHECK(EmitPhiModuleHash(true) == EmitPhiModuleHash(false));
+    const auto loaded = Sirit::Module::FromBinary(second.Assemble());
+    CHECK(loaded != nullptr && loaded->ContentHash() == second.ContentHash());
+}
+
+void test_compression() {
+    VertexModule vertex;
+    vertex.Generate();
+    Sirit::Module loop;
+    loop.AddCapability(spv::Capability::Shader);
+    EmitCountedLoop(loop, spv::LoopControlMask::MaskNone, 8);
+
+    // 64-bit switch literals take two words
+    Sirit::Module wide;
+    wide.AddCapability(spv::Capability::Int64);
+    const auto t_void = wide.TypeVoid();
+    const auto t_long = wide.TypeInt(64, false);
+    wide.OpFunction(t_void, spv::FunctionControlMask::MaskNone, wide.TypeFunction(t_void));
+    wide.AddLabel();
+    const auto case_label = wide.OpLabel();
+    const auto merge = wide.OpLabel();
+    const std::array<Sirit::Literal, 1> literals{std::uint64_t{0x123456789}};
+    const std::array labels{case_label};
+    wide.OpSelectionMerge(merge, spv::SelectionControlMask::MaskNone);
+    wide.OpSwitch(wide.Constant(t_long, std::uint64_t{5}), merge, literals, labels);
+    wide.AddLabel(case_label);
+    wide.OpBranch(merge);
+    wide.AddLabel(merge);
+    wide.OpReturn();
+    wide.OpFunctionEnd();
+
+    for (const Sirit::Module* const m : {static_cast<Sirit::Module*>(&vertex), &loop, &wide}) {
+        const auto code = m->Assemble();
+        const auto compressed = m->AssembleCompressed();
+        CHECK(Sirit::Decompress(compressed) == code);
+        CHECK(compressed.size() * 2 < code.size() * sizeof(std::uint32_t));
+    }
+
+    // Malformed streams are rejected without reading out of bounds
+    const auto compressed = vertex.AssembleCompressed();
+    bool rejected_truncations = true;
+    for (std::size_t size = 0; size < compressed.size(); ++size) {
+        const auto code = Sirit::Decompress(std::span(compressed).first(size));
+        rejected_truncations &= code.empty() || code != vertex.Assemble();
+    }
+    CHECK(rejected_truncations);
+    auto corrupted = compressed;
+    corrupted[0] ^= 1;
+    CHECK(Sirit::Decompress(corrupted).empty());
+}
+
+void test_trace_replay() {
+    // Deferred phis are patched in place and passes rewrite whole sections
+    Sirit::Module recorded{0x00010300};
+    recorded.StartRecording();
+    recorded.AddCapability(spv::Capability::Shader);
+    recorded.AddExtension("SPV_KHR_storage_buffer_storage_class");
+    EmitCountedLoop(recorded, spv::LoopControlMask::Unroll, 4);
+    recorded.UnrollLoops(8);
+    recorded.Canonicalize();
+    const auto t_int = recorded.TypeInt(32, true);
+    recorded.Constant(t_int, 42);
+    const auto trace = recorded.StopRecording();
+    CHECK(recorded.StopRecording().empty());
+
+    Sirit::Module replayed;
+    CHECK(replayed.Replay(trace));
+    CHECK(replayed.Assemble() == recorded.Assemble());
+    // Declarations are registered again for deduplication
+    CHECK(replayed.TypeInt(32, true).value == t_int.value);
+    CHECK(replayed.Constant(t_int, 42).value == recorded.Constant(t_int, 42).value);
+
+    // Recordings started on a module with contents begin with a snapshot of it
+    VertexModule vertex;
+    vertex.Generate();
+    vertex.StartRecording();
+    vertex.Name(vertex.TypeFloat(32), "float");
+    const auto vertex_trace = vertex.StopRecording();
+    Sirit::Module vertex_replayed;
+    CHECK(vertex_replayed.Replay(vertex_trace));
+    CHECK(vertex_replayed.Assemble() == vertex.Assemble());
+
+    // Replayed extended instruction imports are reused
+    Sirit::Module glsl{0x00010300};
+    glsl.StartRecording();
+    const auto t_float = glsl.TypeFloat(32);
+    glsl.OpFAbs(t_float, glsl.Constant(t_float, -1.0f));
+    Sirit::Module glsl_replayed;
+    CHECK(glsl_replayed.Replay(glsl.StopRecording()));
+    glsl_replayed.OpFAbs(t_float, glsl_replayed.Constant(t_float, -2.0f));
+    CHECK(CountOpcode(glsl_replayed.Assemble(), spv::Op::OpExtInstImport) == 1);
+
+    bool rejected_truncations = true;
+    for (std::size_t size = 0; size < trace.size(); ++size) {
+        Sirit::Module truncated;
+        rejected_truncations &= !truncated.Replay(std::span(trace).first(size)) ||
+                                truncated.Assemble() != recorded.Assemble();
+    }
+    CHECK(rejected_truncations);
+    auto corrupted = trace;
+    corrupted[0] ^= 1;
+    Sirit::Module rejected;
+    CHECK(!rejected.Replay(corrupted));
+}
+
+void test_trace_replay_code_sink() {
+    std::vector<std::uint32_t> streamed_code;
+    const auto collect = [](std::vector<std::uint32_t>& out) {
+        return [&out](std::span<const std::uint32_t> words) {
+            out.insert(out.end(), words.begin(), words.end());
+        };
+    };
+    Sirit::Module recorded{0x00010300};
+    recorded.EnableFunctionDeduplication();
+    recorded.SetCodeSink(collect(streamed_code));
+    recorded.StartRecording();
+    EmitScaleHelper(recorded, 2.0f);
+    EmitScaleHelper(recorded, 2.0f);
+    EmitScaleHelper(recorded, 3.0f);
+    const std::vector<std::uint8_t> trace = recorded.StopRecording();
+    std::vector<std::uint32_t> expected = recorded.Assemble();
+    expected.insert(expected.end(), streamed_code.begin(), streamed_code.end());
+    CHECK(CountOpcode(expected, spv::Op::OpFunction) == 2);
+
+    // Without a sink the streamed code is kept in the module
+    Sirit::Module resident;
+    CHECK(resident.Replay(trace));
+    CHECK(resident.Assemble() == expected);
+    CHECK(resident.ContentHash() == recorded.ContentHash());
+
+    std::vector<std::uint32_t> replayed_code;
+    Sirit::Module streamed;
+    streamed.SetCodeSink(collect(replayed_code));
+    CHECK(streamed.Replay(trace));
+    CHECK(replayed_code == streamed_code);
+    std::vector<std::uint32_t> words = streamed.Assemble();
+    words.insert(words.end(), replayed_code.begin(), replayed_code.end());
+    CHECK(words == expected);
+}
+
+void test_module_stats() {
+    VertexModule m;
+    m.Generate();
+    const auto t_float = m.TypeFloat(32);
+    const Sirit::ModuleStats before = m.GetStats();
+    m.TypeFloat(32);
+    m.Constant(t_float, 123.0f);
+    const Sirit::ModuleStats stats = m.GetStats();
+
+    const auto code = m.Assemble();
+    CHECK(stats.bound == code[3]);
+    std::size_t num_instructions = 0;
+    for (const Sirit::Instruction& inst : Sirit::Module::Instructions(code)) {
+        num_instructions += inst.opcode == spv::Op::OpTypeFloat ? 0 : 1;
+    }
+    CHECK(stats.opcode_counts.at(spv::Op::OpTypeFloat) == 1);
+    CHECK(stats.opcode_counts.at(spv::Op::OpCapability) == 1);
+    std::size_t counted = 0;
+    for (const auto& [opcode, count] : stats.opcode_counts) {
+        counted += opcode == spv::Op::OpTypeFloat ? 0 : count;
+    }
+    CHECK(counted == num_instructions);
+
+    std::size_t section_words = 0;
+    for (const Sirit::SectionStats& section : stats.sections) {
+        section_words += section.words;
+        CHECK(section.allocated_bytes >= section.words * sizeof(std::uint32_t));
+    }
+    // The header, the capability and the memory model aren't stored in sections
+    CHECK(section_words + 5 + 2 + 3 == code.size());
+    CHECK(stats.declaration_hits == before.declaration_hits + 1);
+    CHECK(stats.declaration_misses == before.declaration_misses + 1);
+    CHECK(stats.dedup_table_bytes > 0);
+
+    m.ShrinkToFit();
+    const Sirit::ModuleStats shrunk = m.GetStats();
+    for (const Sirit::SectionStats& section : shrunk.sections) {
+        CHECK(section.allocated_bytes == section.words * sizeof(std::uint32_t));
+    }
+    CHECK(m.Assemble() == code);
+    // Emission continues normally after shrinking
+    CHECK(m.Constant(t_float, 123.0f).value == m.Constant(t_float, 123.0f).value);
+    m.Constant(t_float, 456.0f);
+    CHECK(m.Assemble().size() == code.size() + 4);
+}
+
+void test_capacity_profile() {
+    Sirit::CapacityProfile profile;
+    VertexModule small;
+    small.Generate();
+    profile.Record(small);
+    VertexModule learned;
+    learned.Generate();
+    learned.Constant(learned.TypeFloat(32), 12345.0f);
+    profile.Record(learned);
+    profile.Record(small);
+    const Sirit::SectionSizes sizes = profile.Sizes();
+    CHECK(sizes.declarations == learned.GetSectionSizes().declarations);
+    CHECK(sizes.unique_declarations > small.GetSectionSizes().unique_declarations);
+    CHECK(sizes.code > 0);
+
+    VertexModule reserved;
+    reserved.ReserveSections(sizes);
+    reserved.Generate();
+    reserved.Constant(reserved.TypeFloat(32), 12345.0f);
+    for (const Sirit::SectionStats& section : reserved.GetStats().sections) {
+        CHECK(section.growth_events == 0);
+    }
+    CHECK(reserved.Assemble() == learned.Assemble());
+}
+
+void test_mapped_storage() {
+    const auto emit = [](Sirit::Module& m, std::uint32_t num_adds) {
+        const auto t_void = m.TypeVoid();
+        const auto t_float = m.TypeFloat(32);
+        m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+        m.AddLabel();
+        auto value = m.Constant(t_float, 1.0f);
+        for (std::uint32_t i = 0; i < num_adds; ++i) {
+            value = m.OpFAdd(t_float, value, m.Constant(t_float, static_cast<float>(i % 7)));
+        }
+        m.OpReturn();
+        m.OpFunctionEnd();
+    };
+    // Large enough for the code section to move to mapped storage
+    constexpr std::uint32_t num_adds = 80'000;
+    Sirit::Module heap;
+    Sirit::Module mapped;
+    mapped.EnableMappedStorage();
+    emit(heap, num_adds);
+    emit(mapped, num_adds);
+    CHECK(mapped.Assemble() == heap.Assemble());
+
+    mapped.ShrinkToFit();
+    emit(heap, 16);
+    emit(mapped, 16);
+    CHECK(mapped.Assemble() == heap.Assemble());
+    CHECK(mapped.ContentHash() == heap.ContentHash());
+
+    // Passes replace the section, which goes back to the heap until it grows again
+    heap.FoldConstantBranches();
+    mapped.FoldConstantBranches();
+    emit(heap, num_adds);
+    emit(mapped, num_adds);
+    CHECK(mapped.Assemble() == heap.Assemble());
+}
+
+Sirit::EmissionTask EmitSlicedShader(Sirit::Module& m, std::uint32_t num_blocks) {
+    const auto t_void = m.TypeVoid();
+    const auto t_float = m.TypeFloat(32);
+    m.OpFunction(t_void, spv::FunctionControlMask::MaskNone, m.TypeFunction(t_void));
+    auto label = m.AddLabel();
+    auto value = m.Constant(t_float, 1.0f);
+    for (std::uint32_t block = 0; block < num_blocks; ++block) {
+        value = m.OpFMul(t_float, value, m.Constant(t_float, static_cast<float>(block)));
+        const auto next = m.OpLabel();
+        m.OpBranch(next);
+        label = m.AddLabel(next);
+        co_yield label;
+    }
+    m.OpReturn();
+    co_yield m.OpFunctionEnd();
+}
+
+void test_emission_driver() {
+    Sirit::EmissionDriver complete{[](Sirit::Module& m) { return EmitSlicedShader(m, 8); }};
+    CHECK(complete.Run(std::chrono::hours{1}));
+    const std::unique_ptr<Sirit::Module> expected = complete.TakeModule();
+    CHECK(expected != nullptr);
+    CHECK(complete.TakeModule() == nullptr);
+
+    // The capture is read once the coroutine runs, the driver keeps the lambda alive
+    const std::uint32_t num_blocks = 8;
+    Sirit::EmissionDriver sliced{[num_blocks](Sirit::Module& m) -> Sirit::EmissionTask {
+        Sirit::EmissionTask blocks = EmitSlicedShader(m, num_blocks);
+        while (!blocks.Resume()) {
+            co_yield Sirit::Id{};
+        }
+    }};
+    // An empty budget emits one slice per call
+    int num_runs = 1;
+    for (; !sliced.Run(std::chrono::nanoseconds{0}); ++num_runs) {
+        CHECK(!sliced.Done());
+        CHECK(sliced.TakeModule() == nullptr);
+    }
+    // Eight blocks, the function end and the return from the coroutine
+    CHECK(num_runs == 10);
+    const std::unique_ptr<Sirit::Module> module = sliced.TakeModule();
+    CHECK(module != nullptr && module->Assemble() == expected->Assemble());
+
+    Sirit::EmissionDriver cancelled{[](Sirit::Module& m) { return EmitSlicedShader(m, 8); }};
+    CHECK(!cancelled.Run(std::chrono::nanoseconds{0}));
+    cancelled.Cancel();
+    CHECK(!cancelled.Done());
+    CHECK(!cancelled.Run(std::chrono::hours{1}));
+    CHECK(cancelled.TakeModule() == nullptr);
+
+    Sirit::EmissionDriver failed{[](Sirit::Module& m) -> Sirit::EmissionTask {
+        co_yield m.AddLabel();
+        throw std::runtime_error{"emission failed"};
+    }};
+    CHECK(!failed.Run(std::chrono::nanoseconds{0}));
+    bool thrown = false;
+    try {
+        failed.Run(std::chrono::hours{1});
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(!failed.Done());
+    CHECK(!failed.Run(std::chrono::hours{1}));
+    CHECK(failed.TakeModule() == nullptr);
+}
+
+#ifdef SIRIT_TRACING
+class RecordingHooks final : public Sirit::TracingHooks {
+public:
+    void Begin(const char* name, std::uint64_t timestamp_ns) override {
+        events.push_back(std::string{"begin "} + name);
+        ordered &= timestamp_ns >= last_timestamp;
+        last_timestamp = timestamp_ns;
+    }
+
+    void End(const char* name, std::uint64_t timestamp_ns) override {
+        events.push_back(std::string{"end "} + name);
+        ordered &= timestamp_ns >= last_timestamp;
+        last_timestamp = timestamp_ns;
+    }
+
+    void Instant(const char* name, std::uint64_t timestamp_ns) override {
+        events.push_back(name);
+        ordered &= timestamp_ns >= last_timestamp;
+        last_timestamp = timestamp_ns;
+    }
+
+    std::size_t Count(std::string_view event) const {
+        return static_cast<std::size_t>(std::ranges::count(events, event));
+    }
+
+    std::vector<std::string> events;
+    std::uint64_t last_timestamp = 0;
+    bool ordered = true;
+};
+
+void test_tracing_hooks() {
+    RecordingHooks hooks;
+    Sirit::SetTracingHooks(&hooks);
+    {
+        Sirit::Module m{0x00010300};
+        EmitCountedLoop(m, spv::LoopControlMask::Unroll, 4);
+        m.UnrollLoops(8);
+        m.Assemble();
+    }
+    Sirit::SetTracingHooks(nullptr);
+    Sirit::Module untraced;
+
+    CHECK(hooks.Count("Module::Module") == 1);
+    CHECK(hooks.Count("begin Module::PatchDeferredPhi") == 1);
+    CHECK(hooks.Count("end Module::PatchDeferredPhi") == 1);
+    CHECK(hooks.Count("begin Module::UnrollLoops") == 1);
+    CHECK(hooks.Count("begin Module::Assemble") == 1);
+    CHECK(hooks.Count("end Module::Assemble") == 1);
+    // int, function type, bool and the constants 4, 1 and 0
+    CHECK(hooks.Count("Declarations::Insert") == 6);
+    CHECK(hooks.ordered);
+}
+#endif
+
 } // namespace
 
 int main() {
@@ -336,6 +1783,44 @@ int main() {
     RUN_TEST(test_capability_dedup);
     RUN_TEST(test_constant_kinds);
     RUN_TEST(test_compute_shader_execution_mode);
+    RUN_TEST(test_promote_local_variables);
+    RUN_TEST(test_promote_local_variables_address_taken);
+    RUN_TEST(test_forward_local_memory);
+    RUN_TEST(test_forward_local_memory_barrier);
+    RUN_TEST(test_forward_local_memory_index_width);
+    RUN_TEST(test_fold_constant_branches);
+    RUN_TEST(test_fold_constant_branches_loop);
+    RUN_TEST(test_fold_constant_switch_nested_break);
+    RUN_TEST(test_unroll_loops);
+    RUN_TEST(test_unroll_loops_merge_phi);
+    RUN_TEST(test_unroll_loops_limits);
+    RUN_TEST(test_unroll_loops_narrow_induction);
+    RUN_TEST(test_combine_composite_operations);
+    RUN_TEST(test_combine_composite_shuffles);
+    RUN_TEST(test_function_deduplication);
+    RUN_TEST(test_code_sink);
+    RUN_TEST(test_link_library);
+    RUN_TEST(test_link_string_decoration);
+    RUN_TEST(test_fragment_instantiation);
+    RUN_TEST(test_from_binary);
+    RUN_TEST(test_from_binary_lines);
+    RUN_TEST(test_patch_table);
+    RUN_TEST(test_patch_table_spec_constant);
+    RUN_TEST(test_specialize);
+    RUN_TEST(test_canonical_capability_order);
+    RUN_TEST(test_canonicalize);
+    RUN_TEST(test_canonicalize_result_types);
+    RUN_TEST(test_content_hash);
+    RUN_TEST(test_compression);
+    RUN_TEST(test_trace_replay);
+    RUN_TEST(test_trace_replay_code_sink);
+    RUN_TEST(test_module_stats);
+    RUN_TEST(test_capacity_profile);
+    RUN_TEST(test_mapped_storage);
+    RUN_TEST(test_emission_driver);
+#ifdef SIRIT_TRACING
+    RUN_TEST(test_tracing_hooks);
+#endif
 
     std::fprintf(stderr, "\n%d/%d checks passed\n", g_total - g_failures, g_total);
     return g_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;